@@ -0,0 +1,409 @@
+#include "apic.h"
+#include "lib.h"
+#include "i8259.h"
+#include "pit.h"
+#include "syscall.h"
+
+/* CPUID leaf 1 EDX: on-chip local APIC */
+#define CPUID_EDX_APIC (1 << 9)
+
+/* IA32_APIC_BASE MSR */
+#define MSR_APIC_BASE 0x1B
+#define APIC_BASE_ENABLE (1 << 11)
+#define APIC_BASE_ADDR_MASK 0xFFFFF000
+
+/* local APIC registers, byte offsets from LAPIC_BASE */
+#define LAPIC_ID 0x020
+#define LAPIC_TPR 0x080
+#define LAPIC_EOI 0x0B0
+#define LAPIC_SVR 0x0F0
+#define LAPIC_ICR_LOW 0x300
+#define LAPIC_ICR_HIGH 0x310
+#define LAPIC_LVT_TIMER 0x320
+#define LAPIC_LVT_LINT0 0x350
+#define LAPIC_LVT_LINT1 0x360
+#define LAPIC_LVT_ERROR 0x370
+#define LAPIC_TIMER_INIT 0x380
+#define LAPIC_TIMER_CURRENT 0x390
+#define LAPIC_TIMER_DIVIDE 0x3E0
+
+#define LAPIC_ID_SHIFT 24
+#define SVR_APIC_ENABLE 0x100
+#define LVT_MASKED (1 << 16)
+#define LVT_DELIVERY_EXTINT 0x700
+#define LVT_TIMER_PERIODIC (1 << 17)
+#define TIMER_DIVIDE_BY_16 0x3
+#define TIMER_COUNT_MAX 0xFFFFFFFF
+#define ICR_DELIVERY_PENDING (1 << 12)
+
+/* IOAPIC registers, reached through the select/window pair */
+#define IOAPIC_REGSEL 0x00
+#define IOAPIC_WINDOW 0x10
+#define IOAPIC_VERSION 0x01
+#define IOAPIC_REDIR_LOW(pin) (0x10 + 2 * (pin))
+#define IOAPIC_REDIR_HIGH(pin) (0x11 + 2 * (pin))
+#define IOAPIC_MAX_REDIR_SHIFT 16
+#define IOAPIC_MAX_REDIR_MASK 0xFF
+#define IOAPIC_ABSENT 0xFFFFFFFF
+#define IOAPIC_MAX_PINS 24
+#define REDIR_MASKED (1 << 16)
+#define REDIR_DEST_SHIFT 24
+
+/* ISA IRQs on the IOAPIC, one pin each - IRQ 0 is not routed, the local
+APIC timer replaces the PIT */
+#define ISA_IRQS 16
+
+/* PIT periods the local APIC timer is timed over */
+#define APIC_CALIBRATE_PERIODS 2
+
+#ifdef IRQ_MEASURE
+/* IOAPIC pin the boot measurement toggles, nothing is wired to COM2 */
+#define MEASURE_PIN 3
+#define MEASURE_ROUNDS 256
+#endif
+
+int32_t apic_active = false;
+
+/* copies of the redirection entries' low words and of the timer LVT, so
+masking is a write without a read, like the 8259 IMR cache */
+static uint32_t redir_low[IOAPIC_MAX_PINS];
+static uint32_t lvt_timer;
+static uint32_t ioapic_pins;
+/* timer count per tick, the application processors' timers use it too */
+static uint32_t timer_count;
+
+/* interrupts the local APIC reported as spurious */
+static uint32_t spurious_lapic = 0;
+
+/* function prototypes for internal functions */
+static uint32_t lapic_read(uint32_t reg);
+static void lapic_write(uint32_t reg, uint32_t value);
+static uint32_t ioapic_read(uint32_t reg);
+static void ioapic_write(uint32_t reg, uint32_t value);
+static uint32_t lapic_calibrate_timer();
+
+
+/*
+ * lapic_read
+ *   DESCRIPTION: read a local APIC register
+ *   INPUTS: reg: byte offset of the register
+ *   OUTPUTS: none
+ *   RETURN VALUE: the register
+ *   SIDE EFFECTS: none
+ */
+static uint32_t lapic_read(uint32_t reg) {
+	return *(volatile uint32_t*)(LAPIC_BASE + reg);
+}
+
+/*
+ * lapic_write
+ *   DESCRIPTION: write a local APIC register
+ *   INPUTS: reg: byte offset of the register
+ *           value: new contents
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: local APIC state changed
+ */
+static void lapic_write(uint32_t reg, uint32_t value) {
+	*(volatile uint32_t*)(LAPIC_BASE + reg) = value;
+}
+
+/*
+ * ioapic_read
+ *   DESCRIPTION: read an IOAPIC register. Caller holds interrupts off, the
+ *				  select register is shared.
+ *   INPUTS: reg: register index
+ *   OUTPUTS: none
+ *   RETURN VALUE: the register
+ *   SIDE EFFECTS: select register changed
+ */
+static uint32_t ioapic_read(uint32_t reg) {
+	*(volatile uint32_t*)(IOAPIC_BASE + IOAPIC_REGSEL) = reg;
+	return *(volatile uint32_t*)(IOAPIC_BASE + IOAPIC_WINDOW);
+}
+
+/*
+ * ioapic_write
+ *   DESCRIPTION: write an IOAPIC register. Caller holds interrupts off.
+ *   INPUTS: reg: register index
+ *           value: new contents
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: IOAPIC state changed
+ */
+static void ioapic_write(uint32_t reg, uint32_t value) {
+	*(volatile uint32_t*)(IOAPIC_BASE + IOAPIC_REGSEL) = reg;
+	*(volatile uint32_t*)(IOAPIC_BASE + IOAPIC_WINDOW) = value;
+}
+
+/*
+ * init_apic
+ *   DESCRIPTION: switch interrupt delivery from the 8259 to the local APIC
+ *				  and IOAPIC, if the machine has both at the standard
+ *				  addresses. ISA IRQs keep their vectors and mask state, the
+ *				  local APIC timer takes over IRQ 0 with the PIT's period.
+ *				  Must be called with interrupts off after init_pit, the
+ *				  timer is calibrated against it.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 for success, -1 if the 8259 stays in charge
+ *   SIDE EFFECTS: 8259 fully masked, enable_irq/disable_irq/send_eoi go to
+ *				   the APICs from now on
+ */
+int32_t init_apic() {
+	uint32_t eax, ebx, ecx, edx;
+	uint32_t lapic_id, tick_count, enabled, pin;
+
+	asm volatile("cpuid"
+		: "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx)
+		: "a"(CPUID_FEATURES)
+		: "cc");
+	if (!(edx & CPUID_EDX_APIC))
+		return ERR;
+
+	/* only the standard window is mapped */
+	if ((rdmsr(MSR_APIC_BASE) & APIC_BASE_ADDR_MASK) != LAPIC_BASE)
+		return ERR;
+
+	/* nothing answers at the address without an IOAPIC */
+	uint32_t version = ioapic_read(IOAPIC_VERSION);
+	if (version == IOAPIC_ABSENT)
+		return ERR;
+	ioapic_pins = ((version >> IOAPIC_MAX_REDIR_SHIFT) & IOAPIC_MAX_REDIR_MASK)
+		+ 1;
+	if (ioapic_pins > IOAPIC_MAX_PINS)
+		ioapic_pins = IOAPIC_MAX_PINS;
+	if (ioapic_pins < ISA_IRQS)
+		return ERR;
+
+	wrmsr(MSR_APIC_BASE, LAPIC_BASE | APIC_BASE_ENABLE);
+	lapic_write(LAPIC_SVR, SVR_APIC_ENABLE | APIC_SPURIOUS_VECTOR);
+	lapic_write(LAPIC_TPR, 0);
+	/* LINT0 carried the 8259 in virtual wire mode, it goes quiet now */
+	lapic_write(LAPIC_LVT_LINT0, LVT_MASKED);
+	lapic_write(LAPIC_LVT_LINT1, LVT_MASKED);
+	lapic_write(LAPIC_LVT_ERROR, LVT_MASKED);
+	lapic_id = lapic_read(LAPIC_ID) >> LAPIC_ID_SHIFT;
+
+	/* every pin starts masked: edge triggered, active high, fixed delivery
+	to this processor */
+	for (pin = 0; pin < ioapic_pins; pin++) {
+		redir_low[pin] = REDIR_MASKED | (APIC_IRQ_VECTOR_BASE + pin);
+		ioapic_write(IOAPIC_REDIR_HIGH(pin), lapic_id << REDIR_DEST_SHIFT);
+		ioapic_write(IOAPIC_REDIR_LOW(pin), redir_low[pin]);
+	}
+
+	tick_count = lapic_calibrate_timer();
+	if (tick_count == 0) {
+		/* give LINT0 back to the 8259 */
+		lapic_write(LAPIC_LVT_LINT0, LVT_DELIVERY_EXTINT);
+		lapic_write(LAPIC_SVR, APIC_SPURIOUS_VECTOR);
+		return ERR;
+	}
+
+	/* carry the drivers' mask state over, then silence the 8259 */
+	apic_active = true;
+	enabled = i8259_handover();
+	for (pin = 1; pin < ISA_IRQS; pin++) {
+		if (pin != IRQ_2 && (enabled & (1 << pin)))
+			apic_enable_irq(pin);
+	}
+
+	lvt_timer = LVT_TIMER_PERIODIC | APIC_IRQ_VECTOR_BASE;
+	if (!(enabled & (1 << IRQ_0)))
+		lvt_timer |= LVT_MASKED;
+	timer_count = tick_count;
+	lapic_write(LAPIC_TIMER_DIVIDE, TIMER_DIVIDE_BY_16);
+	lapic_write(LAPIC_LVT_TIMER, lvt_timer);
+	lapic_write(LAPIC_TIMER_INIT, tick_count);
+	return SUCCESS;
+}
+
+/*
+ * init_apic_ap
+ *   DESCRIPTION: set up the local APIC of an application processor the way
+ *				  init_apic set up the boot processor's. The IOAPIC only
+ *				  delivers to the boot processor, so this one gets its timer
+ *				  and IPIs. The timer starts masked, enable_irq(IRQ_0) on
+ *				  this processor starts it.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: local APIC of the calling processor enabled
+ */
+void init_apic_ap() {
+	wrmsr(MSR_APIC_BASE, LAPIC_BASE | APIC_BASE_ENABLE);
+	lapic_write(LAPIC_SVR, SVR_APIC_ENABLE | APIC_SPURIOUS_VECTOR);
+	lapic_write(LAPIC_TPR, 0);
+	lapic_write(LAPIC_LVT_LINT0, LVT_MASKED);
+	lapic_write(LAPIC_LVT_LINT1, LVT_MASKED);
+	lapic_write(LAPIC_LVT_ERROR, LVT_MASKED);
+
+	lapic_write(LAPIC_TIMER_DIVIDE, TIMER_DIVIDE_BY_16);
+	lapic_write(LAPIC_LVT_TIMER, lvt_timer | LVT_MASKED);
+	lapic_write(LAPIC_TIMER_INIT, timer_count);
+}
+
+/*
+ * apic_id
+ *   DESCRIPTION: local APIC ID of the calling processor
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: the ID
+ *   SIDE EFFECTS: none
+ */
+uint32_t apic_id() {
+	return lapic_read(LAPIC_ID) >> LAPIC_ID_SHIFT;
+}
+
+/*
+ * apic_send_ipi
+ *   DESCRIPTION: send an interprocessor interrupt. Waits for the previous
+ *				  one to leave the local APIC first.
+ *   INPUTS: dest: local APIC ID of the target, ignored with a shorthand
+ *           icr: low word of the interrupt command, APIC_ICR_* | vector
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: interrupt command register written
+ */
+void apic_send_ipi(uint32_t dest, uint32_t icr) {
+	int32_t flags;
+	cli_and_save(flags);
+	while (lapic_read(LAPIC_ICR_LOW) & ICR_DELIVERY_PENDING);
+	/* the write to the low word sends it */
+	lapic_write(LAPIC_ICR_HIGH, dest << LAPIC_ID_SHIFT);
+	lapic_write(LAPIC_ICR_LOW, icr);
+	restore_flags(flags);
+}
+
+/*
+ * lapic_calibrate_timer
+ *   DESCRIPTION: count how far the local APIC timer runs in one PIT period
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: timer count per PIT period at divide by 16
+ *   SIDE EFFECTS: busy waits APIC_CALIBRATE_PERIODS + 1 PIT periods, leaves
+ *				   the timer masked
+ */
+static uint32_t lapic_calibrate_timer() {
+	int32_t i;
+	uint32_t elapsed;
+
+	lapic_write(LAPIC_LVT_TIMER, LVT_MASKED);
+	lapic_write(LAPIC_TIMER_DIVIDE, TIMER_DIVIDE_BY_16);
+
+	pit_wait_reload();
+	lapic_write(LAPIC_TIMER_INIT, TIMER_COUNT_MAX);
+	for (i = 0; i < APIC_CALIBRATE_PERIODS; i++)
+		pit_wait_reload();
+	elapsed = TIMER_COUNT_MAX - lapic_read(LAPIC_TIMER_CURRENT);
+	lapic_write(LAPIC_TIMER_INIT, 0);
+
+	return elapsed / APIC_CALIBRATE_PERIODS;
+}
+
+/*
+ * apic_enable_irq
+ *   DESCRIPTION: unmask an ISA IRQ at the IOAPIC, IRQ 0 is the local APIC
+ *				  timer
+ *   INPUTS: irq_num: which irq to be unmasked
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: redirection entry or timer LVT modified
+ */
+void apic_enable_irq(uint32_t irq_num) {
+	int32_t flags;
+	cli_and_save(flags);
+	if (irq_num == IRQ_0) {
+		lvt_timer &= ~LVT_MASKED;
+		lapic_write(LAPIC_LVT_TIMER, lvt_timer);
+	} else if (irq_num < ioapic_pins) {
+		redir_low[irq_num] &= ~REDIR_MASKED;
+		ioapic_write(IOAPIC_REDIR_LOW(irq_num), redir_low[irq_num]);
+	}
+	restore_flags(flags);
+}
+
+/*
+ * apic_disable_irq
+ *   DESCRIPTION: mask an ISA IRQ at the IOAPIC, IRQ 0 is the local APIC
+ *				  timer
+ *   INPUTS: irq_num: which irq to be masked
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: redirection entry or timer LVT modified
+ */
+void apic_disable_irq(uint32_t irq_num) {
+	int32_t flags;
+	cli_and_save(flags);
+	if (irq_num == IRQ_0) {
+		lvt_timer |= LVT_MASKED;
+		lapic_write(LAPIC_LVT_TIMER, lvt_timer);
+	} else if (irq_num < ioapic_pins) {
+		redir_low[irq_num] |= REDIR_MASKED;
+		ioapic_write(IOAPIC_REDIR_LOW(irq_num), redir_low[irq_num]);
+	}
+	restore_flags(flags);
+}
+
+/*
+ * apic_send_eoi
+ *   DESCRIPTION: end the interrupt the local APIC is servicing - unlike the
+ *				  8259 there is no specific EOI, the highest priority one
+ *				  in service ends
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: one memory mapped write
+ */
+void apic_send_eoi() {
+	lapic_write(LAPIC_EOI, 0);
+}
+
+/*
+ * spurious_handler_255
+ *   DESCRIPTION: local APIC spurious interrupt handler. The interrupt was
+ *				  withdrawn before it was delivered, so it is not in service
+ *				  and gets no EOI.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: spurious count updated
+ */
+void spurious_handler_255() {
+	spurious_lapic++;
+}
+
+#ifdef IRQ_MEASURE
+/*
+ * apic_measure
+ *   DESCRIPTION: print the cost in TSC cycles of the unmask/mask pair and of
+ *				  the EOI every handler does, see i8259_measure for the 8259
+ *				  numbers. Must run with interrupts off, after init_apic
+ *				  succeeded. Only built with IRQ_MEASURE.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: MEASURE_PIN is left masked
+ */
+void apic_measure() {
+	uint64_t start, mask, eoi;
+	int32_t i;
+
+	start = rdtsc();
+	for (i = 0; i < MEASURE_ROUNDS; i++) {
+		apic_enable_irq(MEASURE_PIN);
+		apic_disable_irq(MEASURE_PIN);
+	}
+	mask = rdtsc() - start;
+
+	/* nothing is in service, the local APIC ignores these */
+	start = rdtsc();
+	for (i = 0; i < MEASURE_ROUNDS; i++)
+		apic_send_eoi();
+	eoi = rdtsc() - start;
+
+	printf("apic: unmask+mask %d cycles, eoi %d cycles\n",
+		div64_32(mask, MEASURE_ROUNDS), div64_32(eoi, MEASURE_ROUNDS));
+}
+#endif /* IRQ_MEASURE */
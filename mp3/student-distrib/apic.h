@@ -0,0 +1,41 @@
+#ifndef _APIC_H
+#define _APIC_H
+
+#include "types.h"
+
+/* physical (and kernel virtual) addresses of the interrupt controllers. Both
+sit in the 4MB page at APIC_WINDOW_START, which paging maps uncached into
+every page directory. */
+#define APIC_WINDOW_START	0xFEC00000
+#define IOAPIC_BASE			0xFEC00000
+#define LAPIC_BASE			0xFEE00000
+
+/* vector the IOAPIC delivers ISA IRQ n on, the same as the 8259 used */
+#define APIC_IRQ_VECTOR_BASE 0x20
+/* vector the local APIC reports spurious interrupts on, low 4 bits set */
+#define APIC_SPURIOUS_VECTOR 0xFF
+
+/* interprocessor interrupt command, the low word of the ICR */
+#define APIC_ICR_FIXED			0x00000
+#define APIC_ICR_INIT			0x00500
+#define APIC_ICR_STARTUP		0x00600
+#define APIC_ICR_ASSERT			0x04000
+#define APIC_ICR_ALL_BUT_SELF	0xC0000
+
+/* true once interrupts come through the APICs instead of the 8259 */
+extern int32_t apic_active;
+
+//see c file for more
+extern int32_t init_apic();
+extern void init_apic_ap();
+extern uint32_t apic_id();
+extern void apic_send_ipi(uint32_t dest, uint32_t icr);
+extern void apic_enable_irq(uint32_t irq_num);
+extern void apic_disable_irq(uint32_t irq_num);
+extern void apic_send_eoi();
+extern void spurious_handler_255();
+#ifdef IRQ_MEASURE
+extern void apic_measure();
+#endif
+
+#endif /* _APIC_H */
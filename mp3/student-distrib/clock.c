@@ -0,0 +1,106 @@
+#include "clock.h"
+#include "lib.h"
+#include "timepage.h"
+#include "timer.h"
+#include "syscall.h"
+#include "task.h"
+
+/*
+ * clock_cycles
+ *   DESCRIPTION: cheapest timestamp available, for instrumentation that
+ *				  converts to time later. Not comparable between CPUs.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: current TSC value
+ *   SIDE EFFECTS: none
+ */
+uint64_t clock_cycles() {
+	return rdtsc();
+}
+
+/*
+ * clock_cycles_to_ns
+ *   DESCRIPTION: convert a TSC interval to time using the boot calibration.
+ *				  The product needs up to 96 bits, so each half of cycles is
+ *				  scaled on its own. The high half's product is a multiple
+ *				  of 2^32, so shifting it separately loses nothing.
+ *   INPUTS: cycles: length of the interval in TSC cycles
+ *   OUTPUTS: none
+ *   RETURN VALUE: length of the interval in nanoseconds
+ *   SIDE EFFECTS: none
+ */
+uint64_t clock_cycles_to_ns(uint64_t cycles) {
+	uint32_t mult = time_page->tsc_mult;
+	uint32_t shift = time_page->tsc_shift;
+	uint64_t lo = (uint64_t)(uint32_t)cycles * mult;
+	uint64_t hi = (uint64_t)(uint32_t)(cycles >> 32) * mult;
+
+	return (hi << (32 - shift)) + (lo >> shift);
+}
+
+/*
+ * clock_cycles_to_us
+ *   DESCRIPTION: convert a TSC interval of any length to microseconds, for
+ *				  totals reported in 32 bits
+ *   INPUTS: cycles: length of the interval in TSC cycles
+ *   OUTPUTS: none
+ *   RETURN VALUE: length of the interval in microseconds, 0xFFFFFFFF if it
+ *				   does not fit 32 bits (over an hour)
+ *   SIDE EFFECTS: none
+ */
+uint32_t clock_cycles_to_us(uint64_t cycles) {
+	uint64_t scaled = cycles * US_PER_MS;
+	/* the quotient of divl must fit 32 bits */
+	if ((uint32_t)(scaled >> 32) >= time_page->tsc_khz)
+		return CLOCK_US_MAX;
+	return div64_32(scaled, time_page->tsc_khz);
+}
+
+/*
+ * clock_ns
+ *   DESCRIPTION: monotonic time since boot, from the TSC alone. The tick
+ *				  count is not used: the handler may run late, e.g. after a
+ *				  long cli section, and time built on it would step back
+ *				  when it catches up. Same clock user programs read from
+ *				  the time page.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: nanoseconds since boot
+ *   SIDE EFFECTS: none
+ */
+uint64_t clock_ns() {
+	/* the calibration never changes after boot, no need for seq */
+	return clock_cycles_to_ns(rdtsc() - time_page->tsc_at_boot);
+}
+
+/*
+ * do_clock_gettime
+ *   DESCRIPTION: clock_gettime syscall, reads the high resolution clock
+ *   INPUTS: clock_id: which clock to read, only CLOCK_MONOTONIC exists
+ *   OUTPUTS: ts: seconds and nanoseconds since boot
+ *   RETURN VALUE: 0 for success, -1 for fail
+ *   SIDE EFFECTS: none
+ */
+int32_t do_clock_gettime(int32_t clock_id, timespec_t* ts) {
+	if (ts == NULL)
+		return ERR;
+
+	/* no process is running, should not occur */
+	if(!current_pcb[active_task_idx]) {
+		return ERR;
+	}
+
+	/* don't allow to user to read/write kernel memory */
+	if (!((uint32_t)ts >= USR_PRG_VIRTUAL_START && 
+		(uint32_t)ts + sizeof(timespec_t) <= USR_PRG_VIRTUAL_END))
+		return ERR;
+
+	if (clock_id != CLOCK_MONOTONIC)
+		return ERR;
+
+	uint64_t ns = clock_ns();
+	/* good for 136 years of uptime */
+	ts->tv_sec = div64_32(ns, NS_PER_SEC);
+	ts->tv_nsec = (uint32_t)(ns - (uint64_t)ts->tv_sec * NS_PER_SEC);
+	return SUCCESS;
+}
@@ -0,0 +1,24 @@
+#ifndef _CLOCK_H
+#define _CLOCK_H
+
+#include "types.h"
+
+/* clock ids accepted by clock_gettime, numbered as on Linux */
+#define CLOCK_MONOTONIC 1
+
+/* clock_cycles_to_us result when the interval is too long */
+#define CLOCK_US_MAX 0xFFFFFFFF
+
+typedef struct timespec {
+	uint32_t tv_sec;
+	uint32_t tv_nsec;
+} timespec_t;
+
+//see c file for more
+extern uint64_t clock_ns();
+extern uint64_t clock_cycles();
+extern uint64_t clock_cycles_to_ns(uint64_t cycles);
+extern uint32_t clock_cycles_to_us(uint64_t cycles);
+extern int32_t do_clock_gettime(int32_t clock_id, timespec_t* ts);
+
+#endif /* _CLOCK_H */
@@ -5,6 +5,12 @@
 #include "syscall.h"
 #include "task.h"
 #include "terminal.h"
+#include "syscall_stat.h"
+#include "prof.h"
+#include "trace.h"
+#include "procstat.h"
+#include "serial.h"
+#include "spinlock.h"
 
 /* FS constants */
 #define BLOCK_SIZE 4096
@@ -21,6 +27,7 @@
 #define FLAG_RTC 0x02
 #define FLAG_FILE 0x04
 #define FLAG_DIR 0x08
+#define FLAG_DEV 0x10
 #define FILE_ARRAY_LENGTH 8
 #define MAX_DATA_BLOCK 200
 #define MAX_INODE 22
@@ -36,6 +43,28 @@ static operations_t rtc_operations = {
 	rtc_close
 };
 
+/* pseudo files that are backed by the kernel rather than the file system
+image - open looks here before searching the directory */
+typedef struct device_n {
+	const int8_t* name;
+	operations_t operations;
+} device_t;
+
+static device_t devices[] = {
+	{ "syscalls", { syscall_stat_open, syscall_stat_read, syscall_stat_write,
+		syscall_stat_close } },
+	{ "profile", { prof_open, prof_read, prof_write, prof_close } },
+	{ "trace", { trace_open, trace_read, trace_write, trace_close } },
+	{ "procstat", { procstat_open, procstat_read, procstat_write,
+		procstat_close } },
+	{ "ttyS0", { serial_open, serial_read, serial_write, serial_close } },
+	{ "kbd", { kbd_open, kbd_read, kbd_write, kbd_close } },
+	{ "locks", { spinlock_open, spinlock_read, spinlock_write,
+		spinlock_close } }
+};
+
+#define NUM_DEVICES (sizeof(devices) / sizeof(device_t))
+
 /* directory fops table */
 static operations_t dir_operations= {
 	directory_open,
@@ -122,14 +151,29 @@ int32_t filesystem_open(const uint8_t* fname) {
 	if (i == FILE_ARRAY_LENGTH)
 		return ERR;
 
+	/* pseudo files shadow the file system image */
+	uint32_t dev;
+	for (dev = 0; dev < NUM_DEVICES; dev++) {
+		if (strncmp((const int8_t*)fname_normalized, devices[dev].name,
+			FILE_NAME_LEN) == 0)
+			break;
+	}
+
 	/* file not found */
-    if (read_dentry_by_name((const int8_t*)fname_normalized, &dentry) == ERR) {
+    if (dev == NUM_DEVICES && 
+    	read_dentry_by_name((const int8_t*)fname_normalized, &dentry) == ERR) {
     	return ERR;
     }
 
 
     // Set flags based on file type - dev file, dir file, or normal file
-    if (dentry.file_type == TYPE_RTC) {
+    if (dev < NUM_DEVICES) {
+    	current_pcb[active_task_idx]->file_descriptors[i].operations = devices[dev].operations;
+    	current_pcb[active_task_idx]->file_descriptors[i].inode = NULL;
+    	current_pcb[active_task_idx]->file_descriptors[i].report = NULL;
+    	current_pcb[active_task_idx]->file_descriptors[i].pos = 0;
+    	current_pcb[active_task_idx]->file_descriptors[i].flags = FLAG_DEV | FLAG_IN_USE;
+    } else if (dentry.file_type == TYPE_RTC) {
         int j;
 
         /* Has RTC has already been opened? */
@@ -0,0 +1,201 @@
+#include "fpu.h"
+#include "lib.h"
+#include "task.h"
+#include "smp.h"
+
+/* CPUID leaf 1 feature bits */
+#define CPUID_EDX_FXSR (1 << 24)
+#define CPUID_EDX_SSE (1 << 25)
+
+#define CR0_MP 0x00000002	/* wait/fwait trap on TS too */
+#define CR0_EM 0x00000004	/* every FPU instruction traps, no FPU */
+#define CR0_TS 0x00000008	/* task switched, the next FPU use traps */
+#define CR0_NE 0x00000020	/* FPU errors raise exception 16, not IRQ 13 */
+#define CR4_OSFXSR 0x00000200		/* fxsave/fxrstor and SSE allowed */
+#define CR4_OSXMMEXCPT 0x00000400	/* SSE errors raise exception 19 */
+
+/* MXCSR after reset: every SIMD exception masked, round to nearest */
+#define MXCSR_DEFAULT 0x1F80
+
+/* the FPU registers are switched lazily: a context switch only sets CR0.TS
+unless the next task already owns the registers on this processor, and the
+first FPU instruction after that traps to fpu_trap, which saves the owner's
+registers into its PCB and loads the running task's. A task never changes
+processor once init_smp has split the terminals, so its registers can only
+be live on the processor that runs it. */
+static int32_t fpu_fxsr = false;
+static int32_t fpu_sse = false;
+
+/* function prototypes for internal functions */
+static void fpu_save(pcb_t* pcb);
+static void fpu_load(pcb_t* pcb);
+static void set_ts();
+static void clear_ts();
+
+
+/*
+ * init_fpu
+ *   DESCRIPTION: turn on the FPU, and SSE if there is one, for the calling
+ *				  processor. Every processor calls this for itself, with no
+ *				  owner and TS set so the first user traps.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: CR0 and CR4 written, the FPU registers reset
+ */
+void init_fpu() {
+	uint32_t eax, ebx, ecx, edx, cr0, cr4;
+
+	asm volatile("cpuid"
+		: "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx)
+		: "a"(CPUID_FEATURES)
+		: "cc");
+	fpu_fxsr = (edx & CPUID_EDX_FXSR) != 0;
+	fpu_sse = fpu_fxsr && (edx & CPUID_EDX_SSE) != 0;
+
+	asm volatile("movl %%cr0, %0" : "=r"(cr0));
+	cr0 = (cr0 & ~(CR0_EM | CR0_TS)) | CR0_MP | CR0_NE;
+	asm volatile("movl %0, %%cr0" : : "r"(cr0) : "memory");
+
+	if (fpu_fxsr) {
+		asm volatile("movl %%cr4, %0" : "=r"(cr4));
+		cr4 |= CR4_OSFXSR;
+		if (fpu_sse)
+			cr4 |= CR4_OSXMMEXCPT;
+		asm volatile("movl %0, %%cr4" : : "r"(cr4) : "memory");
+	}
+
+	asm volatile("fninit" ::: "memory");
+	this_cpu()->fpu_owner = ERR;
+	set_ts();
+}
+
+/*
+ * fpu_trap
+ *   DESCRIPTION: called by the device not available handler when the
+ *				  running task uses the FPU with TS set. The registers of
+ *				  the last task that used them here go to its PCB, then the
+ *				  running task's come back, or start out reset on its
+ *				  first use.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: TS cleared, the running task owns the FPU registers
+ */
+void fpu_trap() {
+	cpu_t* cpu = this_cpu();
+	pcb_t* pcb = current_pcb[active_task_idx];
+
+	clear_ts();
+	if (cpu->fpu_owner == (int32_t)pcb->pid)
+		return;
+
+	if (cpu->fpu_owner != ERR)
+		fpu_save(pcb_array[cpu->fpu_owner]);
+
+	if (pcb->fpu_used) {
+		fpu_load(pcb);
+	} else {
+		asm volatile("fninit" ::: "memory");
+		if (fpu_sse) {
+			uint32_t mxcsr = MXCSR_DEFAULT;
+			asm volatile("ldmxcsr %0" : : "m"(mxcsr));
+		}
+		pcb->fpu_used = true;
+	}
+	cpu->fpu_owner = pcb->pid;
+}
+
+/*
+ * fpu_switch
+ *   DESCRIPTION: called whenever a task is about to run on this processor.
+ *				  TS is cleared only if the task's registers are the ones
+ *				  loaded, otherwise its first FPU instruction traps.
+ *   INPUTS: pcb: the task that runs next
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: CR0.TS set or cleared
+ */
+void fpu_switch(pcb_t* pcb) {
+	if (this_cpu()->fpu_owner == (int32_t)pcb->pid)
+		clear_ts();
+	else
+		set_ts();
+}
+
+/*
+ * fpu_release
+ *   DESCRIPTION: forget the FPU registers of a process that halts, so its
+ *				  PCB is not saved into and its registers are not handed to
+ *				  the next process that gets the PID
+ *   INPUTS: pcb: the halting process
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: the process owns the registers on no processor
+ */
+void fpu_release(pcb_t* pcb) {
+	int32_t i;
+
+	pcb->fpu_used = false;
+	for (i = 0; i < MAX_CPUS; i++) {
+		if (cpus[i].fpu_owner == (int32_t)pcb->pid)
+			cpus[i].fpu_owner = ERR;
+	}
+}
+
+/*
+ * fpu_save
+ *   DESCRIPTION: store the FPU registers in a PCB. Caller has cleared TS.
+ *   INPUTS: pcb: the owner of the registers
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: fnsave also resets the FPU
+ */
+static void fpu_save(pcb_t* pcb) {
+	if (fpu_fxsr)
+		asm volatile("fxsave %0" : "=m"(pcb->fpu_state));
+	else
+		asm volatile("fnsave %0" : "=m"(pcb->fpu_state));
+}
+
+/*
+ * fpu_load
+ *   DESCRIPTION: load the FPU registers from a PCB. Caller has cleared TS.
+ *   INPUTS: pcb: a process whose registers fpu_save stored
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: FPU registers overwritten
+ */
+static void fpu_load(pcb_t* pcb) {
+	if (fpu_fxsr)
+		asm volatile("fxrstor %0" : : "m"(pcb->fpu_state));
+	else
+		asm volatile("frstor %0" : : "m"(pcb->fpu_state));
+}
+
+/*
+ * set_ts
+ *   DESCRIPTION: make the next FPU instruction trap
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: CR0.TS set
+ */
+static void set_ts() {
+	uint32_t cr0;
+	asm volatile("movl %%cr0, %0" : "=r"(cr0));
+	if (!(cr0 & CR0_TS))
+		asm volatile("movl %0, %%cr0" : : "r"(cr0 | CR0_TS) : "memory");
+}
+
+/*
+ * clear_ts
+ *   DESCRIPTION: let FPU instructions run
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: CR0.TS cleared
+ */
+static void clear_ts() {
+	asm volatile("clts" ::: "memory");
+}
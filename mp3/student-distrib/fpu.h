@@ -0,0 +1,18 @@
+#ifndef _FPU_H
+#define _FPU_H
+
+#include "types.h"
+
+/* x87/SSE register image saved by fxsave, fnsave needs 108 bytes of it */
+#define FPU_STATE_SIZE 512
+#define FPU_STATE_ALIGN 16
+
+struct pcb_n;
+
+//see c file for more
+extern void init_fpu();
+extern void fpu_trap();
+extern void fpu_switch(struct pcb_n* pcb);
+extern void fpu_release(struct pcb_n* pcb);
+
+#endif /* _FPU_H */
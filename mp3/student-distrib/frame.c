@@ -0,0 +1,133 @@
+#include "frame.h"
+#include "lib.h"
+#include "mem.h"
+#include "spinlock.h"
+
+/* the 4KB frames of the pool, by index from FRAME_POOL_START. A free frame
+is on one of two stacks: zeroed ones are ready to hand out, dirty ones
+still hold what their last owner left. Processors waiting for an
+interrupt move frames from dirty to zeroed, see frame_zero_idle, so
+do_execute rarely has to zero one itself. A frame being zeroed is on
+neither stack. */
+static uint16_t zeroed[NUM_FRAMES];
+static uint32_t num_zeroed = 0;
+static uint16_t dirty[NUM_FRAMES];
+static volatile uint32_t num_dirty = 0;
+
+static spinlock_t frame_lock = SPINLOCK_INIT("frames");
+
+/* function prototypes for internal functions */
+static uint32_t frame_addr(uint16_t idx);
+
+
+/*
+ * init_frames
+ *   DESCRIPTION: put every frame of the pool on the dirty stack, nothing is
+ *				  known about what memory holds at boot
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void init_frames() {
+	uint32_t i;
+
+	/* popped from the top, so the lowest frames go first */
+	for (i = 0; i < NUM_FRAMES; i++)
+		dirty[i] = NUM_FRAMES - 1 - i;
+	num_dirty = NUM_FRAMES;
+	num_zeroed = 0;
+}
+
+/*
+ * frame_alloc
+ *   DESCRIPTION: take a zeroed frame. Normally one the idle loops zeroed,
+ *				  which is O(1), otherwise a dirty one is zeroed here.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: physical address of the frame, which the frame window
+ *				   maps at the same address, or 0 if the pool is empty
+ *   SIDE EFFECTS: none
+ */
+uint32_t frame_alloc() {
+	int32_t flags;
+	uint32_t frame = 0;
+
+	spin_lock_irqsave(&frame_lock, flags);
+	if (num_zeroed > 0) {
+		frame = frame_addr(zeroed[--num_zeroed]);
+		spin_unlock_irqrestore(&frame_lock, flags);
+		return frame;
+	}
+	if (num_dirty > 0)
+		frame = frame_addr(dirty[--num_dirty]);
+	spin_unlock_irqrestore(&frame_lock, flags);
+
+	/* the caller is about to use it, so zero it through the cache */
+	if (frame != 0)
+		memset((void*)frame, 0, PAGE_SIZE);
+	return frame;
+}
+
+/*
+ * frame_free
+ *   DESCRIPTION: give a frame back to the pool, to be zeroed when some
+ *				  processor has nothing else to do
+ *   INPUTS: frame: physical address frame_alloc returned
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void frame_free(uint32_t frame) {
+	int32_t flags;
+
+	spin_lock_irqsave(&frame_lock, flags);
+	dirty[num_dirty++] = (frame - FRAME_POOL_START) / PAGE_SIZE;
+	spin_unlock_irqrestore(&frame_lock, flags);
+}
+
+/*
+ * frame_zero_idle
+ *   DESCRIPTION: zero one dirty frame, called by loops that wait for an
+ *				  interrupt. The stores go around the cache, the frame is
+ *				  not read until a process gets it.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: true if a frame was zeroed, false if none was dirty
+ *   SIDE EFFECTS: none
+ */
+int32_t frame_zero_idle() {
+	int32_t flags;
+	uint16_t idx;
+
+	/* checked without the lock first, most calls find nothing to do */
+	if (num_dirty == 0)
+		return false;
+
+	spin_lock_irqsave(&frame_lock, flags);
+	if (num_dirty == 0) {
+		spin_unlock_irqrestore(&frame_lock, flags);
+		return false;
+	}
+	idx = dirty[--num_dirty];
+	spin_unlock_irqrestore(&frame_lock, flags);
+
+	memzero_nt((void*)frame_addr(idx), PAGE_SIZE);
+
+	spin_lock_irqsave(&frame_lock, flags);
+	zeroed[num_zeroed++] = idx;
+	spin_unlock_irqrestore(&frame_lock, flags);
+	return true;
+}
+
+/*
+ * frame_addr
+ *   DESCRIPTION: physical address of a frame of the pool
+ *   INPUTS: idx: index of the frame
+ *   OUTPUTS: none
+ *   RETURN VALUE: the address
+ *   SIDE EFFECTS: none
+ */
+static uint32_t frame_addr(uint16_t idx) {
+	return FRAME_POOL_START + idx * PAGE_SIZE;
+}
@@ -0,0 +1,15 @@
+#ifndef _FRAME_H
+#define _FRAME_H
+
+#include "types.h"
+#include "paging.h"
+
+#define NUM_FRAMES (FRAME_POOL_SIZE / PAGE_SIZE)
+
+//see c file for more
+extern void init_frames();
+extern uint32_t frame_alloc();
+extern void frame_free(uint32_t frame);
+extern int32_t frame_zero_idle();
+
+#endif /* _FRAME_H */
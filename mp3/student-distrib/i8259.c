@@ -5,6 +5,8 @@
 
 #include "i8259.h"
 #include "lib.h"
+#include "trace.h"
+#include "apic.h"
 
 /* IRQ 8-15 are on slave IR 0-7 */
 #define IRQ_NUM_SLAVE_OFFSET 8
@@ -15,6 +17,29 @@
 /* mask all interrupts on slave */
 #define SLAVE_MASK_VALUE 0xFF
 
+/* mask every IR of a PIC */
+#define ALL_MASKED 0xFF
+
+/* OCW3 - the next read of the command port returns the ISR */
+#define OCW3_READ_ISR 0x0B
+/* IR7 is where a PIC reports an interrupt that went away before the ack */
+#define SPURIOUS_IR 7
+
+#ifdef IRQ_MEASURE
+/* IRQ the boot measurement toggles - nothing is wired to COM2 */
+#define MEASURE_IRQ 3
+#define MEASURE_ROUNDS 256
+#endif
+
+/* copies of the IMRs, so masking is a single port write instead of a read
+and a write. The IMRs are only ever changed through these. */
+static uint8_t master_mask = MASTER_MASK_VALUE;
+static uint8_t slave_mask = SLAVE_MASK_VALUE;
+
+/* interrupts on IR7 of each PIC that no device raised */
+static uint32_t spurious_master = 0;
+static uint32_t spurious_slave = 0;
+
 /*
  * delay_for_PIC
  *   DESCRIPTION: wait for IO
@@ -67,9 +92,11 @@ i8259_init(void)
     delay_for_PIC();
 
     /* mask all execpt IRQ2 */
-    outb(MASTER_MASK_VALUE, MASTER_8259_DATA);
+    master_mask = MASTER_MASK_VALUE;
+    slave_mask = SLAVE_MASK_VALUE;
+    outb(master_mask, MASTER_8259_DATA);
     delay_for_PIC();
-    outb(SLAVE_MASK_VALUE, SLAVE_8259_DATA);
+    outb(slave_mask, SLAVE_8259_DATA);
     delay_for_PIC();
 
 }
@@ -87,19 +114,25 @@ i8259_init(void)
 void
 enable_irq(uint32_t irq_num)
 {
-    uint16_t port;
-    uint8_t value;
+    int32_t flags;
 
+    if (apic_active) {
+        apic_enable_irq(irq_num);
+        return;
+    }
+
+    /* a handler nesting between the update and the write would have its
+    change overwritten with a stale mask */
+    cli_and_save(flags);
     if (irq_num < IRQ_NUM_SLAVE_OFFSET) { //IRQ is IRx on master
-        port = MASTER_8259_DATA;
+        master_mask &= ~(1 << irq_num);  //set bit in IMR to zero
+        outb(master_mask, MASTER_8259_DATA);
     } else { //IRQ is IR2 on master
-        port = SLAVE_8259_DATA;
-        irq_num = irq_num - IRQ_NUM_SLAVE_OFFSET;
         /* IRQ 8-15 are on slave IR 0-7 */
+        slave_mask &= ~(1 << (irq_num - IRQ_NUM_SLAVE_OFFSET));
+        outb(slave_mask, SLAVE_8259_DATA);
     }
-
-    value = inb(port) & ~(1 << irq_num);  //set bit in IMR to zero
-    outb(value, port);
+    restore_flags(flags);
 }
 
 
@@ -115,19 +148,23 @@ enable_irq(uint32_t irq_num)
 void
 disable_irq(uint32_t irq_num)
 {
-    uint16_t port;
-    uint8_t value;
+    int32_t flags;
+
+    if (apic_active) {
+        apic_disable_irq(irq_num);
+        return;
+    }
 
+    cli_and_save(flags);
     if (irq_num < IRQ_NUM_SLAVE_OFFSET) { //master
-        port = MASTER_8259_DATA;
+        master_mask |= 1 << irq_num;   //set bit in IMR to one
+        outb(master_mask, MASTER_8259_DATA);
     } else { //slave
-        port = SLAVE_8259_DATA;
-        irq_num = irq_num - IRQ_NUM_SLAVE_OFFSET; 
         /* IRQ 8-15 are on slave IR 0-7 */
+        slave_mask |= 1 << (irq_num - IRQ_NUM_SLAVE_OFFSET);
+        outb(slave_mask, SLAVE_8259_DATA);
     }
-
-    value = inb(port) | (1 << irq_num);   //set bit in IMR to one
-    outb(value, port);
+    restore_flags(flags);
 }
 
 
@@ -143,6 +180,11 @@ disable_irq(uint32_t irq_num)
 void
 send_eoi(uint32_t irq_num)
 {
+    if (apic_active) {
+        apic_send_eoi();
+        return;
+    }
+
     if (irq_num < IRQ_NUM_SLAVE_OFFSET) {
         outb(EOI|irq_num, MASTER_8259_PORT);
     } else { /* IRQ 8-15 are on slave IR 0-7 */
@@ -151,3 +193,158 @@ send_eoi(uint32_t irq_num)
         outb(EOI|IRQ_2, MASTER_8259_PORT);
     }
 }
+
+
+/*
+ * i8259_handover
+ *   DESCRIPTION: mask every IRQ on both PICs, when the APICs take over
+ *                interrupt delivery
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: bit n set if IRQ n was unmasked
+ *   SIDE EFFECTS: both IMRs written
+ */
+uint16_t
+i8259_handover(void)
+{
+    uint16_t enabled = (uint16_t)~(master_mask |
+        (slave_mask << IRQ_NUM_SLAVE_OFFSET));
+
+    master_mask = ALL_MASKED;
+    slave_mask = ALL_MASKED;
+    outb(master_mask, MASTER_8259_DATA);
+    outb(slave_mask, SLAVE_8259_DATA);
+    return enabled;
+}
+
+
+/*
+ * read_isr
+ *   DESCRIPTION: read the in-service register of one PIC
+ *   INPUTS: port: MASTER_8259_PORT or SLAVE_8259_PORT
+ *   OUTPUTS: none
+ *   RETURN VALUE: the ISR, bit n set while IRn is being serviced
+ *   SIDE EFFECTS: command port accessed
+ */
+static uint8_t
+read_isr(uint16_t port)
+{
+    outb(OCW3_READ_ISR, port);
+    return inb(port);
+}
+
+
+/*
+ * spurious_handler_39
+ *   DESCRIPTION: IRQ7 handler. Nothing is wired to IRQ7, but the master
+ *                reports here when an interrupt request goes away before
+ *                the processor acknowledges it. Such an interrupt is not
+ *                in service and must not get an EOI.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: spurious count updated, EOI sent for a real IRQ7
+ */
+void
+spurious_handler_39(void)
+{
+    if (!(read_isr(MASTER_8259_PORT) & (1 << SPURIOUS_IR))) {
+        spurious_master++;
+        trace_event(TRACE_IRQ, IRQ_7, spurious_master);
+        return;
+    }
+    send_eoi(IRQ_7);
+}
+
+
+/*
+ * spurious_handler_47
+ *   DESCRIPTION: IRQ15 handler, the slave's counterpart of
+ *                spurious_handler_39. The master did see a real request
+ *                from the slave on IR2, so that one still needs its EOI.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: spurious count updated, EOI sent
+ */
+void
+spurious_handler_47(void)
+{
+    if (!(read_isr(SLAVE_8259_PORT) & (1 << SPURIOUS_IR))) {
+        spurious_slave++;
+        trace_event(TRACE_IRQ, IRQ_15, spurious_slave);
+        outb(EOI|IRQ_2, MASTER_8259_PORT);
+        return;
+    }
+    send_eoi(IRQ_15);
+}
+
+
+#ifdef IRQ_MEASURE
+/*
+ * mask_by_port
+ *   DESCRIPTION: mask or unmask an irq with a read-modify-write of the IMR,
+ *                the way enable_irq and disable_irq used to. Only kept so
+ *                i8259_measure can compare against it.
+ *   INPUTS: irq_num: master irq to change
+ *           masked: 1 to mask, 0 to unmask
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: IMR of master modified, the cached copy is not
+ */
+static void
+mask_by_port(uint32_t irq_num, uint32_t masked)
+{
+    uint8_t value = inb(MASTER_8259_DATA);
+    if (masked)
+        value |= 1 << irq_num;
+    else
+        value &= ~(1 << irq_num);
+    outb(value, MASTER_8259_DATA);
+}
+
+
+/*
+ * i8259_measure
+ *   DESCRIPTION: time the unmask/mask pair every handler does, with the
+ *                cached IMR and with the port read-modify-write, and the
+ *                EOI, and print the average cost of each in TSC cycles.
+ *                Must run with interrupts off since it briefly unmasks an
+ *                unused irq, so it is only built with IRQ_MEASURE. See
+ *                apic_measure for the APIC numbers.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: MEASURE_IRQ is left masked
+ */
+void
+i8259_measure(void)
+{
+    uint64_t start, cached, port, eoi;
+    int32_t i;
+
+    start = rdtsc();
+    for (i = 0; i < MEASURE_ROUNDS; i++) {
+        enable_irq(MEASURE_IRQ);
+        disable_irq(MEASURE_IRQ);
+    }
+    cached = rdtsc() - start;
+
+    start = rdtsc();
+    for (i = 0; i < MEASURE_ROUNDS; i++) {
+        mask_by_port(MEASURE_IRQ, 0);
+        mask_by_port(MEASURE_IRQ, 1);
+    }
+    port = rdtsc() - start;
+
+    /* the irq is not in service, a specific EOI for it changes nothing */
+    start = rdtsc();
+    for (i = 0; i < MEASURE_ROUNDS; i++)
+        send_eoi(MEASURE_IRQ);
+    eoi = rdtsc() - start;
+
+    printf("8259: unmask+mask %d cycles cached, %d by port, eoi %d cycles\n",
+        div64_32(cached, MEASURE_ROUNDS), div64_32(port, MEASURE_ROUNDS),
+        div64_32(eoi, MEASURE_ROUNDS));
+}
+#endif /* IRQ_MEASURE */
@@ -44,11 +44,22 @@
 /* bitmask to access master IR2 */
 #define IRQ_2_MASK		(0x01 << 2)
 
+/* constant for C functions to access IRQ 4 - COM1 */
+#define IRQ_4			4
+/* bitmask to access master IR4 */
+#define IRQ_4_MASK		(0x01 << 4)
+
+/* constant for C functions to access IRQ 7 - spurious master interrupts */
+#define IRQ_7			7
+
 /* constant for C functions to access IRQ 8 - RTC */
 #define IRQ_8			8
 /* bitmask to access slave IR0 */
 #define IRQ_8_MASK		(0x01 << 8)
 
+/* constant for C functions to access IRQ 15 - spurious slave interrupts */
+#define IRQ_15			15
+
 
 /* Externally-visible functions */
 
@@ -60,5 +71,14 @@ void enable_irq(uint32_t irq_num);
 void disable_irq(uint32_t irq_num);
 /* Send end-of-interrupt signal for the specified IRQ */
 void send_eoi(uint32_t irq_num);
+/* Handlers for the spurious vectors of each PIC */
+void spurious_handler_39(void);
+void spurious_handler_47(void);
+#ifdef IRQ_MEASURE
+/* Print the cost of masking with and without the IMR cache */
+void i8259_measure(void);
+#endif
+/* Mask both PICs for the APICs, returns the IRQs that were unmasked */
+uint16_t i8259_handover(void);
 
 #endif /* _I8259_H */
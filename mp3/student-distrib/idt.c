@@ -9,6 +9,11 @@
 #define PIT_ENTRY       0x20
 #define RTC_ENTRY       0x28
 #define KEYBOARD_ENTRY  0x21
+#define SERIAL_ENTRY    0x24
+#define SPURIOUS_MASTER_ENTRY 0x27
+#define SPURIOUS_SLAVE_ENTRY  0x2F
+#define SPURIOUS_APIC_ENTRY   0xFF
+#define TLB_SHOOTDOWN_ENTRY   0xFD
 #define SYS_CALL_ENTRY  0x80
 
 /* IDT loop constants - for different entry types */
@@ -82,6 +87,24 @@ void init_idt(idt_desc_t* idt) {
     SET_IDT_ENTRY(idt[KEYBOARD_ENTRY], __wrapped__keyboard_handler_33);
     idt[KEYBOARD_ENTRY].present=HANDLER_PRESENT;
 
+    //add serial port handler
+    SET_IDT_ENTRY(idt[SERIAL_ENTRY], __wrapped__serial_handler_36);
+    idt[SERIAL_ENTRY].present=HANDLER_PRESENT;
+
+    //add handlers for the vectors the PICs raise spurious interrupts on
+    SET_IDT_ENTRY(idt[SPURIOUS_MASTER_ENTRY], __wrapped__spurious_handler_39);
+    idt[SPURIOUS_MASTER_ENTRY].present=HANDLER_PRESENT;
+    SET_IDT_ENTRY(idt[SPURIOUS_SLAVE_ENTRY], __wrapped__spurious_handler_47);
+    idt[SPURIOUS_SLAVE_ENTRY].present=HANDLER_PRESENT;
+    SET_IDT_ENTRY(idt[SPURIOUS_APIC_ENTRY], __wrapped__spurious_handler_255);
+    idt[SPURIOUS_APIC_ENTRY].present=HANDLER_PRESENT;
+
+    //add the TLB shootdown IPI handler, an interrupt gate so it runs with
+    //interrupts off like the exceptions
+    SET_IDT_ENTRY(idt[TLB_SHOOTDOWN_ENTRY], __wrapped__tlb_shootdown_handler_253);
+    idt[TLB_SHOOTDOWN_ENTRY].present=HANDLER_PRESENT;
+    idt[TLB_SHOOTDOWN_ENTRY].reserved3 = 0;
+
     //add system call handler
     SET_IDT_ENTRY(idt[SYS_CALL_ENTRY], __wrapped__system_call_handler_128);
     idt[SYS_CALL_ENTRY].present=HANDLER_PRESENT;
@@ -3,7 +3,8 @@
 #include "i8259.h"    
 #include "syscall.h"
 #include "task.h"
-#include "interrupt.h"                        
+#include "interrupt.h"
+#include "fpu.h"                        
 
 //0-7
 /*
@@ -101,15 +102,15 @@ void invalid_op_6() {
 
 /*
  * device_not_available_7
- *   DESCRIPTION: no FPU exists handler
+ *   DESCRIPTION: FPU used with CR0.TS set, i.e. by a task whose registers
+ *                are not loaded
  *   INPUTS: none
  *   OUTPUTS: none
  *   RETURN VALUE: none
- *   SIDE EFFECTS: return to parent with code 256, prints message
+ *   SIDE EFFECTS: see fpu_trap, the instruction is retried on return
  */
 void device_not_available_7() {
-    printf("device_not_available_7\n");
-    do_halt_exception(); //return to parent with code 256
+    fpu_trap();
 }
 
 //8-15
@@ -205,6 +206,7 @@ void general_protection_13() {
  */
 void page_fault_14() {
     printf("page_fault_14\n");
+    current_pcb[active_task_idx]->page_faults++;
     current_pcb[active_task_idx]->signal_flag[SEGFAULT] = SIGNAL_PENDING;
     return; //return to parent with code 256
 }
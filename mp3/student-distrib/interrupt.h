@@ -40,9 +40,15 @@ extern void __wrapped__intel_reserved_31();
 extern void __wrapped__pit_handler_32();
 extern void __wrapped__rtc_handler_40();
 extern void __wrapped__keyboard_handler_33();
+extern void __wrapped__serial_handler_36();
+extern void __wrapped__spurious_handler_39();
+extern void __wrapped__spurious_handler_47();
+extern void __wrapped__spurious_handler_255();
+extern void __wrapped__tlb_shootdown_handler_253();
 extern void __wrapped__system_call_handler_128();
 
 extern void system_call_handler_128();
+extern void sysenter_entry();
 
 /* syscalls */
 extern int32_t halt(uint8_t status);
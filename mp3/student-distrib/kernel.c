@@ -16,6 +16,15 @@
 #include "terminal.h"
 #include "interrupt.h"
 #include "pit.h"
+#include "timepage.h"
+#include "serial.h"
+#include "klog.h"
+#include "softirq.h"
+#include "apic.h"
+#include "smp.h"
+#include "fpu.h"
+#include "mem.h"
+#include "frame.h"
 
 #define PID_1 1
 #define PID_2 2
@@ -49,6 +58,7 @@ entry (unsigned long magic, unsigned long addr)
 	if (magic != MULTIBOOT_BOOTLOADER_MAGIC)
 	{
 		printf ("Invalid magic number: 0x%#x\n", (unsigned) magic);
+		klog_flush();
 		return;
 	}
 
@@ -174,20 +184,43 @@ entry (unsigned long magic, unsigned long addr)
 	init_idt(idt);
 	lidt(idt_desc_ptr);
 
+	/* memcpy and memset take the fastest way the processor has from here */
+	init_mem();
+
 	i8259_init();
+#ifdef IRQ_MEASURE
+	/* interrupts are still off, which the measurement needs */
+	i8259_measure();
+#endif
+
+	/* before the drivers, they register their deferred work with it */
+	init_softirq();
 	/* Initialize devices, memory, filesystem, enable device interrupts on the
 	 * PIC, any other initialization stuff... */
 
+	/* console mirror and trace dumps go out on it */
+	init_serial();
+
 	init_keyboard();
 	
 	init_rtc();
 
 	init_paging();
 
+	/* frames for malloc slabs, zeroed while processors wait */
+	init_frames();
+
 	init_pcb();
 
 	init_syscall();
 
+	/* optional, programs fall back to int $0x80 */
+	if (init_sysenter() != SUCCESS)
+		printf("sysenter not supported\n");
+
+	/* programs get the FPU and SSE, switched lazily */
+	init_fpu();
+
 	init_filesystem(disk_start_addr);
 
 	init_terminal();
@@ -196,6 +229,24 @@ entry (unsigned long magic, unsigned long addr)
 
 	init_pit();
 
+	/* calibrates the TSC against the PIT, so interrupts must still be off */
+	init_time_page();
+
+	/* same for the local APIC timer, the 8259 stays in charge without one */
+	if (init_apic() != SUCCESS)
+		printf("no APIC, using the 8259\n");
+#ifdef IRQ_MEASURE
+	else
+		apic_measure();
+#endif
+
+	/* the other processors start here and wait for the first shell to run,
+	times its IPIs with the TSC */
+	init_smp();
+
+	/* show the boot messages before the shells start printing */
+	klog_flush();
+
 	disable_irq (IRQ_0);
 	launch_shell(PID_1);
 	launch_shell(PID_2);
@@ -4,6 +4,9 @@
 #include "terminal.h"
 #include "filesystem.h"
 #include "task.h"
+#include "trace.h"
+#include "softirq.h"
+#include "spinlock.h"
 
 /* keyboard port constants */
 #define KEYBOARD_DATA_PORT 0x60
@@ -34,11 +37,56 @@
 #define F2_PRESSED 0x3C
 #define F3_PRESSED 0x3D
 #define C_PRESSED 0x2E
+#define PAGE_UP_PRESSED 0x49
+#define PAGE_DOWN_PRESSED 0x51
+/* set in the scancode of a key release */
+#define SCANCODE_RELEASE_BIT 0x80
+
+/* rows Shift+PgUp/PgDn move the console through its history */
+#define SCROLLBACK_STEP (NUM_ROWS / 2)
+
+/* scancodes waiting for the bottom half, must be a power of 2 */
+#define SCANCODE_RING_SIZE 256
+#define SCANCODE_RING_MASK (SCANCODE_RING_SIZE - 1)
 
 //keyboard state
 static volatile keyboard_state_t keyboard_state;
 static uint8_t alt_on;
 
+/* single producer, single consumer ring - scancode_head is only written by
+the interrupt handler and scancode_tail only by the bottom half, so neither
+needs to hold off interrupts. The indices run freely and wrap. */
+static volatile uint8_t scancode_ring[SCANCODE_RING_SIZE];
+/* TSC when each scancode arrived, for the raw event timestamps */
+static volatile uint64_t scancode_tsc[SCANCODE_RING_SIZE];
+static volatile uint32_t scancode_head = 0;
+static volatile uint32_t scancode_tail = 0;
+/* scancodes lost because the ring was full */
+static volatile uint32_t scancode_dropped = 0;
+
+/* raw events for one terminal, queued by the keyboard softirq while a
+program on the terminal has the kbd pseudo file open and drained by kbd_read.
+Single producer and single consumer like the scancode ring; events that do
+not fit are dropped. */
+typedef struct kbd_queue {
+    kbd_event_t events[KBD_QUEUE_SIZE];
+    volatile uint32_t head;
+    volatile uint32_t tail;
+    int32_t open;   /* kbd descriptors open on the terminal */
+} kbd_queue_t;
+
+static kbd_queue_t kbd_queues[NUM_TERMINAL];
+/* the last scancode was an 0xE0 prefix */
+static uint8_t kbd_extended = false;
+/* guards scancode_dropped and the open counts of the raw event queues */
+static spinlock_t kbd_lock = SPINLOCK_INIT("keyboard");
+
+/* function prototypes for internal functions */
+static void keyboard_process(uint8_t curr_key, uint64_t tsc);
+static void keyboard_bottom_half();
+static void kbd_queue_event(kbd_queue_t* queue, uint8_t curr_key,
+    uint64_t tsc, uint8_t extended);
+
 //set of operations
 //==================================
 /*
@@ -109,6 +157,100 @@ int32_t keyboard_close (int32_t fd) {
         return ERR;
     return SUCCESS;
 }
+
+/*
+ * kbd_open
+ *   DESCRIPTION: open the kbd pseudo file. While any program on a terminal
+ *                has it open, keys typed on that terminal are queued as raw
+ *                press and release events instead of going to the line
+ *                editor.
+ *   INPUTS: fname: unused
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 for success, -1 if no task is running
+ *   SIDE EFFECTS: the terminal's queue is emptied on the first open
+ */
+int32_t kbd_open (const uint8_t* fname) {
+    int32_t flags;
+    kbd_queue_t* queue;
+
+    if (active_task_idx < 0 || active_task_idx >= NUM_TERMINAL)
+        return ERR;
+    queue = &kbd_queues[active_task_idx];
+
+    spin_lock_irqsave(&kbd_lock, flags);
+    /* keys queued for an earlier reader are stale */
+    if (queue->open++ == 0)
+        queue->tail = queue->head;
+    spin_unlock_irqrestore(&kbd_lock, flags);
+    return SUCCESS;
+}
+
+/*
+ * kbd_read
+ *   DESCRIPTION: take the queued raw events of the caller's terminal, whole
+ *                kbd_event_t's only. Never blocks, so a program can poll
+ *                once per frame.
+ *   INPUTS: fd: unused
+ *           nbytes: size of buf, at least one kbd_event_t
+ *   OUTPUTS: buf: the events, oldest first
+ *   RETURN VALUE: number of bytes read, 0 if no key was pressed or released
+ *                 since the last read, -1 for a bad buffer
+ *   SIDE EFFECTS: events removed from the queue
+ */
+int32_t kbd_read (int32_t fd, void* buf, int32_t nbytes) {
+    kbd_queue_t* queue;
+    kbd_event_t* events = (kbd_event_t*)buf;
+    int32_t count = 0;
+
+    if (buf == NULL || nbytes < (int32_t)sizeof(kbd_event_t))
+        return ERR;
+    if (active_task_idx < 0 || active_task_idx >= NUM_TERMINAL)
+        return ERR;
+    queue = &kbd_queues[active_task_idx];
+
+    while (count < nbytes / (int32_t)sizeof(kbd_event_t) &&
+        queue->tail != queue->head) {
+        events[count++] = queue->events[queue->tail & KBD_QUEUE_MASK];
+        /* the slot must be copied out before the producer can reuse it */
+        barrier();
+        queue->tail++;
+    }
+    return count * sizeof(kbd_event_t);
+}
+
+/*
+ * kbd_write
+ *   DESCRIPTION: write to the kbd pseudo file - not possible
+ *   INPUTS: All arguments ignored.
+ *   OUTPUTS: none
+ *   RETURN VALUE: always fails with -1
+ *   SIDE EFFECTS: none
+ */
+int32_t kbd_write (int32_t fd, const void* buf, int32_t nbytes) {
+    return ERR;
+}
+
+/*
+ * kbd_close
+ *   DESCRIPTION: close the kbd pseudo file, the terminal goes back to line
+ *                editing once the last one is closed
+ *   INPUTS: fd: unused
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 for success, -1 if no task is running
+ *   SIDE EFFECTS: none
+ */
+int32_t kbd_close (int32_t fd) {
+    int32_t flags;
+
+    if (active_task_idx < 0 || active_task_idx >= NUM_TERMINAL)
+        return ERR;
+
+    spin_lock_irqsave(&kbd_lock, flags);
+    if (kbd_queues[active_task_idx].open > 0)
+        kbd_queues[active_task_idx].open--;
+    spin_unlock_irqrestore(&kbd_lock, flags);
+    return SUCCESS;
+}
 //==================================
 //set of operations done
 
@@ -140,6 +282,12 @@ void init_keyboard () {
 
     inb(KEYBOARD_DATA_PORT); /* flush the current data leftover in the buffer */
 
+    scancode_head = 0;
+    scancode_tail = 0;
+    scancode_dropped = 0;
+    kbd_extended = false;
+    open_softirq(SOFTIRQ_KEYBOARD, keyboard_bottom_half);
+
     /* initalize the keyboard status struct with default values */
     keyboard_state.last_key = false;
     keyboard_state.caps_lock_on = false;
@@ -152,23 +300,90 @@ void init_keyboard () {
 
 /*
  * keyboard_handler_33
- *   DESCRIPTION: keyboard interrupt handler
+ *   DESCRIPTION: keyboard interrupt handler. The top half only queues the
+ *                scancode, translation and echo happen in the keyboard
+ *                softirq with the keyboard unmasked.
  *   INPUTS: none
  *   OUTPUTS: none
  *   RETURN VALUE: none
- *   SIDE EFFECTS: reads from KEYBOARD_DATA_PORT, prints to screen last key
- *                 pressed. keyboard status variable updated and terminal may be
- 8                  switched
+ *   SIDE EFFECTS: reads from KEYBOARD_DATA_PORT, see keyboard_bottom_half
  */
 void keyboard_handler_33() {
-    // printf("keyboard interrupt\n");
+    int32_t flags;
+
     disable_irq(IRQ_1);
     send_eoi(IRQ_1);
     uint8_t curr_key = inb(KEYBOARD_DATA_PORT);
+    trace_event(TRACE_IRQ, IRQ_1, curr_key);
+
+    if (scancode_head - scancode_tail >= SCANCODE_RING_SIZE) {
+        spin_lock_irqsave(&kbd_lock, flags);
+        scancode_dropped++;
+        spin_unlock_irqrestore(&kbd_lock, flags);
+    } else {
+        scancode_ring[scancode_head & SCANCODE_RING_MASK] = curr_key;
+        scancode_tsc[scancode_head & SCANCODE_RING_MASK] = rdtsc();
+        barrier();
+        scancode_head++;
+    }
+    raise_softirq(SOFTIRQ_KEYBOARD);
+    enable_irq(IRQ_1);
+}
+
+
+/*
+ * keyboard_bottom_half
+ *   DESCRIPTION: SOFTIRQ_KEYBOARD handler - run the queued scancodes through
+ *                keyboard_process. do_softirq never runs it twice at once, a
+ *                keyboard interrupt that comes in meanwhile just queues its
+ *                scancode and raises the softirq again.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: see keyboard_process
+ */
+static void keyboard_bottom_half() {
+    uint8_t curr_key;
+    uint64_t tsc;
+    uint32_t dropped;
+    int32_t flags;
+
+    while (scancode_tail != scancode_head) {
+        curr_key = scancode_ring[scancode_tail & SCANCODE_RING_MASK];
+        tsc = scancode_tsc[scancode_tail & SCANCODE_RING_MASK];
+        barrier();
+        scancode_tail++;
+        keyboard_process(curr_key, tsc);
+    }
+
+    if (scancode_dropped != 0) {
+        spin_lock_irqsave(&kbd_lock, flags);
+        dropped = scancode_dropped;
+        scancode_dropped = 0;
+        spin_unlock_irqrestore(&kbd_lock, flags);
+        printf("keyboard: %d scancodes dropped\n", dropped);
+    }
+}
+
+
+/*
+ * keyboard_process
+ *   DESCRIPTION: handle one scancode - update the modifier state, switch
+ *                terminals or pass the key on to the terminal, or to the raw
+ *                event queue if a program on the terminal has it open
+ *   INPUTS: curr_key: scancode read from the keyboard
+ *           tsc: TSC when the scancode arrived
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: keyboard status variable updated, terminal may be switched
+ *                 and the key echoed
+ */
+static void keyboard_process(uint8_t curr_key, uint64_t tsc) {
+    uint8_t extended = kbd_extended;
+    kbd_extended = (curr_key == KEY_RELEASE_PREFIX);
 
     if (keyboard_state.control_on && curr_key == C_PRESSED) {
         current_pcb[active_terminal_idx]->signal_flag[INTERRUPT] = SIGNAL_PENDING;
-        enable_irq(IRQ_1);
         return;
     }
 
@@ -209,25 +424,87 @@ void keyboard_handler_33() {
         alt_on = false;
 
     else if (alt_on && keyboard_state.last_key==F1_PRESSED) {
-        enable_irq(IRQ_1);
         switch_terminal(TERM_0);
         //printf("switch to terminal 1\n");
     } 
 
     else if (alt_on && keyboard_state.last_key==F2_PRESSED) {
-        enable_irq(IRQ_1);
         switch_terminal(TERM_1);
         // printf("switch to terminal 2\n");
     } 
     
     else if (alt_on && keyboard_state.last_key==F3_PRESSED) {
-        enable_irq(IRQ_1);
         switch_terminal(TERM_2);
         //printf("switch to terminal 3\n");
     }
 
+    else if (keyboard_state.shift_on && keyboard_state.last_key==PAGE_UP_PRESSED)
+        console_scrollback(SCROLLBACK_STEP);
+
+    else if (keyboard_state.shift_on && keyboard_state.last_key==PAGE_DOWN_PRESSED)
+        console_scrollback(-SCROLLBACK_STEP);
+
+    /* a program reading raw events gets every key instead of the line
+    editor, Ctrl+C and terminal switching still work */
+    if (kbd_queues[active_terminal_idx].open > 0) {
+        if (curr_key != KEY_RELEASE_PREFIX && curr_key != ACK)
+            kbd_queue_event(&kbd_queues[active_terminal_idx], curr_key, tsc,
+                extended);
+        return;
+    }
+
     /* terminal handles line editing */
     keyboard_to_terminal(keyboard_state);
+}
 
-    enable_irq(IRQ_1);
+
+/*
+ * kbd_queue_event
+ *   DESCRIPTION: turn a scancode into a raw event on a terminal's queue.
+ *                Called from the keyboard softirq after keyboard_process
+ *                has updated the modifier state.
+ *   INPUTS: queue: queue of the terminal on screen
+ *           curr_key: scancode read from the keyboard
+ *           tsc: TSC when the scancode arrived
+ *           extended: the scancode followed an 0xE0 prefix
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: one event added to the queue, dropped if the queue is full
+ */
+static void kbd_queue_event(kbd_queue_t* queue, uint8_t curr_key,
+    uint64_t tsc, uint8_t extended) {
+    uint32_t head = queue->head;
+    kbd_event_t* event;
+
+    if (head - queue->tail >= KBD_QUEUE_SIZE)
+        return;
+
+    event = &queue->events[head & KBD_QUEUE_MASK];
+    event->tsc = tsc;
+    event->scancode = curr_key & ~SCANCODE_RELEASE_BIT;
+    event->flags = 0;
+    if (curr_key & SCANCODE_RELEASE_BIT)
+        event->flags |= KBD_EVENT_RELEASE;
+    if (extended)
+        event->flags |= KBD_EVENT_EXTENDED;
+
+    /* keypad keys behind the prefix share make codes with the main block,
+    they do not get a character */
+    event->ascii = 0;
+    if (event->flags == 0)
+        event->ascii = terminal_key_char(keyboard_state);
+
+    event->modifiers = 0;
+    if (keyboard_state.shift_on)
+        event->modifiers |= KBD_MOD_SHIFT;
+    if (keyboard_state.control_on)
+        event->modifiers |= KBD_MOD_CTRL;
+    if (alt_on)
+        event->modifiers |= KBD_MOD_ALT;
+    if (keyboard_state.caps_lock_on)
+        event->modifiers |= KBD_MOD_CAPS;
+
+    /* the event must be complete before the reader can see it */
+    barrier();
+    queue->head = head + 1;
 }
@@ -3,6 +3,31 @@
 
 #include "types.h"
 
+/* raw events each terminal's kbd queue holds, must be a power of 2 */
+#define KBD_QUEUE_SIZE 64
+#define KBD_QUEUE_MASK (KBD_QUEUE_SIZE - 1)
+
+/* kbd_event_t flags */
+#define KBD_EVENT_RELEASE 0x01
+#define KBD_EVENT_EXTENDED 0x02	/* the scancode followed an 0xE0 prefix */
+
+/* kbd_event_t modifiers, the state after the event */
+#define KBD_MOD_SHIFT 0x01
+#define KBD_MOD_CTRL 0x02
+#define KBD_MOD_ALT 0x04
+#define KBD_MOD_CAPS 0x08
+
+/* one event as read from the kbd pseudo file - ece391keys.c in the syscalls
+library must agree */
+typedef struct kbd_event {
+	uint64_t tsc;		/* TSC when the interrupt arrived */
+	uint8_t scancode;	/* set 1 make code, the release bit is in flags */
+	uint8_t ascii;		/* character a press types, 0 for releases and
+						keys that type nothing */
+	uint8_t flags;
+	uint8_t modifiers;
+} kbd_event_t;
+
 //see c files for more
 extern void init_keyboard ();
 extern void keyboard_handler_33();
@@ -10,5 +35,9 @@ extern int32_t keyboard_read (int32_t fd, void* buf, int32_t nbytes);
 extern int32_t keyboard_write (int32_t fd, const void* buf, int32_t nbytes);
 extern int32_t keyboard_open (const uint8_t* fname);
 extern int32_t keyboard_close (int32_t fd);
+extern int32_t kbd_open (const uint8_t* fname);
+extern int32_t kbd_read (int32_t fd, void* buf, int32_t nbytes);
+extern int32_t kbd_write (int32_t fd, const void* buf, int32_t nbytes);
+extern int32_t kbd_close (int32_t fd);
 
 #endif /* _KEYBOARD_H */
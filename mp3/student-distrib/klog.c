@@ -0,0 +1,117 @@
+#include "klog.h"
+#include "lib.h"
+#include "spinlock.h"
+
+#define NUM_BUF_LEN 12
+
+/* printf appends here and returns, the console is written later by
+klog_drain. Indices run freely and are masked on use. Producers exclude each
+other only for the copy into the ring; the drainer never locks them out, it
+just trails klog_head. */
+static int8_t klog_ring[KLOG_SIZE];
+static volatile uint32_t klog_head = 0;
+static volatile uint32_t klog_tail = 0;
+/* bytes dropped because the ring was full, reported by the drainer */
+static volatile uint32_t klog_dropped = 0;
+static volatile int32_t klog_draining = false;
+/* guards klog_head, klog_dropped and klog_draining */
+static spinlock_t klog_lock = SPINLOCK_INIT("klog");
+
+
+/*
+ * klog_write
+ *   DESCRIPTION: append text to the log ring. Safe from any context and
+ *				  never waits - what does not fit is dropped and counted.
+ *   INPUTS: s: text to append, need not be terminated
+ *           len: number of bytes
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: log ring modified
+ */
+void klog_write(const int8_t* s, uint32_t len) {
+	int32_t flags;
+	uint32_t head, room, first;
+
+	spin_lock_irqsave(&klog_lock, flags);
+	head = klog_head;
+	room = KLOG_SIZE - (head - klog_tail);
+	if (len > room) {
+		klog_dropped += len - room;
+		len = room;
+	}
+
+	/* the copy may wrap around the end of the ring */
+	first = KLOG_SIZE - (head & KLOG_MASK);
+	if (first > len)
+		first = len;
+	memcpy(&klog_ring[head & KLOG_MASK], s, first);
+	memcpy(klog_ring, s + first, len - first);
+
+	/* the text must be in place before the drainer can see it */
+	barrier();
+	klog_head = head + len;
+	spin_unlock_irqrestore(&klog_lock, flags);
+}
+
+/*
+ * klog_drain
+ *   DESCRIPTION: write pending log text to the console. Called from the
+ *				  timer interrupt with a budget, so a burst of messages is
+ *				  spread over several ticks, and in full by console_write so
+ *				  kernel messages keep their place among user output.
+ *   INPUTS: budget: most bytes to write in this call
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: screen and serial port written, see putc
+ */
+void klog_drain(uint32_t budget) {
+	int32_t flags;
+	uint32_t dropped;
+	int8_t num[NUM_BUF_LEN];
+
+	/* checked without the lock first, console_write calls this for every
+	write and there is rarely anything pending */
+	if (klog_tail == klog_head && klog_dropped == 0)
+		return;
+
+	/* one drainer at a time, a nested call just leaves the work to it */
+	spin_lock_irqsave(&klog_lock, flags);
+	if (klog_draining) {
+		spin_unlock_irqrestore(&klog_lock, flags);
+		return;
+	}
+	klog_draining = true;
+	dropped = klog_dropped;
+	klog_dropped = 0;
+	spin_unlock_irqrestore(&klog_lock, flags);
+
+	if (dropped != 0) {
+		puts("[klog: ");
+		puts(itoa(dropped, num, 10));
+		puts(" bytes dropped]\n");
+	}
+
+	/* putc takes the console lock itself, an interrupt handler that prints
+	only appends to the ring */
+	while (budget-- > 0 && klog_tail != klog_head) {
+		putc(klog_ring[klog_tail & KLOG_MASK]);
+		barrier();
+		klog_tail++;
+	}
+
+	klog_draining = false;
+}
+
+/*
+ * klog_flush
+ *   DESCRIPTION: write all pending log text to the console now, for when
+ *				  the output must not wait for the timer, e.g. at boot
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: see klog_drain
+ */
+void klog_flush() {
+	klog_drain(KLOG_SIZE);
+	console_flush();
+}
@@ -0,0 +1,18 @@
+#ifndef _KLOG_H
+#define _KLOG_H
+
+#include "types.h"
+
+/* size of the kernel log ring, must be a power of 2 */
+#define KLOG_SIZE (16 * 1024)
+#define KLOG_MASK (KLOG_SIZE - 1)
+
+/* bytes klog_drain writes to the console per timer tick */
+#define KLOG_DRAIN_BUDGET 1024
+
+//see c file for more
+extern void klog_write(const int8_t* s, uint32_t len);
+extern void klog_drain(uint32_t budget);
+extern void klog_flush();
+
+#endif /* _KLOG_H */
@@ -3,24 +3,193 @@
  */
 
 #include "lib.h"
+#include "serial.h"
+#include "klog.h"
+#include "spinlock.h"
+
+/* printf formats this much at a time before handing it to the log ring */
+#define PRINTF_BUF_LEN 128
+
+typedef struct printf_out {
+	int8_t buf[PRINTF_BUF_LEN];
+	uint32_t len;
+} printf_out_t;
+
+/* a console is the screen of one terminal. Output is rendered into a RAM
+ring of SHADOW_ROWS rows - the screen is the NUM_ROWS rows starting at ring
+row head, the rows before it are the history. The console also owns
+CONSOLE_ROWS rows of the text window, the screen shows at cell top in there.
+console_flush brings video memory up to date with the ring, copying only
+the rows marked dirty and scrolling by moving top. */
+typedef struct console_n {
+	uint16_t shadow[SHADOW_ROWS][NUM_COLS];
+	int32_t head;		/* ring row of the top row of the screen */
+	int32_t filled;		/* ring rows holding output, for the history */
+	uint32_t dirty;		/* screen rows changed since the last flush */
+	int32_t scrolled;	/* rows scrolled since the last flush */
+	int32_t top;		/* cell at the upper left corner of the screen, counted
+						from the start of the console's region */
+	int32_t view;		/* rows the display is scrolled back */
+	int32_t direct;		/* screen drawn in place at the vidmap page */
+	int32_t x;			/* cursor position on the screen */
+	int32_t y;
+} console_t;
+
+#define CONSOLE_CELLS (CONSOLE_ROWS * NUM_COLS)
+#define SCREEN_CELLS (NUM_ROWS * NUM_COLS)
+#define ALL_ROWS_DIRTY ((1 << NUM_ROWS) - 1)
+/* a blank cell is a linefeed marker, see search_line_feed */
+#define BLANK_CELL (NORMAL_ATTRIB << LOW_BYTE)
 
-//cursor position
-static int32_t screen_x;
-static int32_t screen_y;
 //pointer to the video memory
 static int8_t* video_mem = (int8_t *)VIDEO;
 
+static console_t consoles[NUM_CONSOLES];
+/* console on display, the one putc and the cursor functions work on */
+static int32_t console_shown = 0;
+/* last location written to the cursor registers */
+static int32_t cursor_cell = -1;
+/* guards the consoles, console_shown and the VGA registers */
+static spinlock_t console_lock = SPINLOCK_INIT("console");
+
+/* function prototypes for internal functions */
+static int32_t console_base(console_t* c);
+static uint8_t* console_cell(console_t* c, int32_t row, int32_t col);
+static int8_t* window_cell(console_t* c, int32_t row, int32_t col);
+static int32_t console_home(console_t* c);
+static void console_clear_row(console_t* c, int32_t row);
+static void console_scroll(console_t* c);
+static void console_putc(console_t* c, uint8_t ch);
+static void console_flush_one(console_t* c);
+static void set_display_start(int32_t cell);
+static void set_cursor_cell(int32_t cell);
+
 
 //text mode support functions for terminal
 //===========================================
+/*
+ * console_base
+ *   DESCRIPTION: first cell of a console's region of the text window, the
+ *				  regions are in console order
+ *   INPUTS: c: the console
+ *   OUTPUTS: none
+ *   RETURN VALUE: cell index from the window start
+ *   SIDE EFFECTS: none
+ */
+static int32_t
+console_base(console_t* c) {
+	return (c - consoles) * CONSOLE_CELLS;
+}
+
+
+/*
+ * console_cell
+ *   DESCRIPTION: address of a character cell of a console's screen - in the
+ *				  ring, or in video memory while the console is direct
+ *   INPUTS: c: the console
+ *           row, col: position on the screen, rows above the screen are
+ *					   negative
+ *   OUTPUTS: none
+ *   RETURN VALUE: pointer to the character byte, the attribute follows it
+ *   SIDE EFFECTS: none
+ */
+static uint8_t*
+console_cell(console_t* c, int32_t row, int32_t col) {
+	if (c->direct)
+		return (uint8_t*)window_cell(c, row, col);
+	/* the ring size is a power of 2 so negative rows wrap too */
+	return (uint8_t*)&c->shadow[(c->head + row) & (SHADOW_ROWS - 1)][col];
+}
+
+
+/*
+ * window_cell
+ *   DESCRIPTION: address in video memory of a character cell of a console's
+ *				  screen
+ *   INPUTS: c: the console
+ *           row, col: position on the screen
+ *   OUTPUTS: none
+ *   RETURN VALUE: pointer to the character byte, the attribute follows it
+ *   SIDE EFFECTS: none
+ */
+static int8_t*
+window_cell(console_t* c, int32_t row, int32_t col) {
+	/* each character consists of two bytes - character shown is at every even
+	address, the odd address following adjusts the attributes */
+	return video_mem + ((console_base(c) + c->top + row * NUM_COLS + col) << 1);
+}
+
+
+/*
+ * console_home
+ *   DESCRIPTION: cell where the screen of a console sits in direct mode, the
+ *				  first page boundary in its region. The regions are large
+ *				  enough for a whole screen to fit after it.
+ *   INPUTS: c: the console
+ *   OUTPUTS: none
+ *   RETURN VALUE: cell index from the region start
+ *   SIDE EFFECTS: none
+ */
+static int32_t
+console_home(console_t* c) {
+	int32_t base = console_base(c);
+	return ((((base << 1) + TEXT_PAGE_SIZE - 1) & ~(TEXT_PAGE_SIZE - 1)) >> 1) - base;
+}
+
+
+/*
+ * set_display_start
+ *   DESCRIPTION: show the text window starting at a given cell
+ *   INPUTS: cell: cell shown at the upper left corner of the display
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: VGA start address registers written to
+ */
+static void
+set_display_start(int32_t cell) {
+	uint16_t position = cell;
+
+	outb(START_ADDR_HIGH, VGA_ADDR_PORT);
+	outb((uint8_t)((position >> LOW_BYTE) & LOW_BYTE_MASK), VGA_DATA_PORT);
+	outb(START_ADDR_LOW, VGA_ADDR_PORT);
+	outb((uint8_t)(position & LOW_BYTE_MASK), VGA_DATA_PORT);
+}
+
+
+/*
+ * set_cursor_cell
+ *   DESCRIPTION: move the hardware cursor, skipping the slow port writes if
+ *				  it is already there
+ *   INPUTS: cell: cell index from the window start
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: VGA cursor location registers may be written to
+ */
+static void
+set_cursor_cell(int32_t cell) {
+	if (cell == cursor_cell)
+		return;
+	cursor_cell = cell;
+
+	uint16_t position = cell;
+	// cursor LOW port to vga INDEX register
+    outb(CURSOR_LOC_LOW, VGA_ADDR_PORT);
+    outb((uint8_t)(position & LOW_BYTE_MASK), VGA_DATA_PORT);
+
+    // cursor HIGH port to vga INDEX register
+    outb(CURSOR_LOC_HIGH, VGA_ADDR_PORT);
+    outb((uint8_t)((position >> LOW_BYTE) & LOW_BYTE_MASK), VGA_DATA_PORT);
+}
+
+
 /*
  * update_cursor
- *   DESCRIPTION: update the curson position in the terminal
+ *   DESCRIPTION: update the curson position in the terminal on screen
  *   INPUTS: row, col: current position
  *   OUTPUTS: none
  *   RETURN VALUE: none
- *   SIDE EFFECTS: cursor position changed, VGA cursor location registers 
- *				   written to
+ *   SIDE EFFECTS: cursor position changed, the hardware cursor follows on
+ *				   the next console_flush
  */
 void 
 update_cursor(int32_t row, int32_t col) {
@@ -28,17 +197,196 @@ update_cursor(int32_t row, int32_t col) {
 	if ((row < 0 || row >= NUM_ROWS) || (col < 0 || col >= NUM_COLS))
 		return;
 
-	screen_y = row;
-	screen_x = col;
+	console_t* c = &consoles[console_shown];
+	c->y = row;
+	c->x = col;
+}
 
-	uint16_t position = (row * NUM_COLS) + col;
-	// cursor LOW port to vga INDEX register
-    outb(CURSOR_LOC_LOW, VGA_ADDR_PORT);
-    outb((uint8_t)(position & LOW_BYTE_MASK), VGA_DATA_PORT);
 
-    // cursor HIGH port to vga INDEX register
-    outb(CURSOR_LOC_HIGH, VGA_ADDR_PORT);
-    outb((uint8_t)((position >> LOW_BYTE) & LOW_BYTE_MASK), VGA_DATA_PORT);
+/*
+ * console_flush_one
+ *   DESCRIPTION: bring a console's region of video memory up to date with
+ *				  its ring. Scrolls since the last flush move top down the
+ *				  region, the rows already in video memory move with it for
+ *				  free. Then only the dirty rows are copied. When the region
+ *				  runs out top returns to the region start and the whole
+ *				  screen is copied, there is no history to keep in there.
+ *				  Caller holds console_lock.
+ *   INPUTS: c: the console
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: writes to video memory, display start and cursor follow if
+ *				   the console is on display
+ */
+static void
+console_flush_one(console_t* c) {
+	int32_t row, start;
+
+	/* a direct console is drawn in place */
+	if (!c->direct) {
+		if (c->scrolled > 0) {
+			if (c->scrolled >= NUM_ROWS)
+				c->scrolled = NUM_ROWS;
+			c->top += c->scrolled * NUM_COLS;
+			if (c->top + SCREEN_CELLS > CONSOLE_CELLS) {
+				c->top = 0;
+				c->dirty = ALL_ROWS_DIRTY;
+			}
+			c->scrolled = 0;
+		}
+
+		/* rows are copied from where the display looks, the history if it
+		is scrolled back */
+		for (row = 0; c->dirty != 0; row++, c->dirty >>= 1) {
+			if (c->dirty & 1)
+				memcpy(window_cell(c, row, 0), console_cell(c, row - c->view, 0),
+					NUM_COLS << 1);
+		}
+	}
+
+	if (c == &consoles[console_shown]) {
+		start = console_base(c) + c->top;
+		set_display_start(start);
+		/* the cursor is parked just below the display while looking at the
+		history, so it is not shown */
+		set_cursor_cell(c->view != 0 ? start + SCREEN_CELLS :
+			start + c->y * NUM_COLS + c->x);
+	}
+}
+
+
+/*
+ * console_flush
+ *   DESCRIPTION: bring the console on display up to date. Called every
+ *				  timer tick, and right after keyboard echo. Hidden consoles
+ *				  are flushed when they are shown.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: see console_flush_one
+ */
+void
+console_flush() {
+	int32_t flags;
+	spin_lock_irqsave(&console_lock, flags);
+	console_flush_one(&consoles[console_shown]);
+	spin_unlock_irqrestore(&console_lock, flags);
+}
+
+
+/*
+ * console_show
+ *   DESCRIPTION: put a console on display. Every console has its own region
+ *				  of video memory, so only the rows it changed while hidden
+ *				  are copied.
+ *   INPUTS: idx: console to show
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: video memory, VGA start address and cursor registers 
+ *				   written to
+ */
+void
+console_show(int32_t idx) {
+	if (idx < 0 || idx >= NUM_CONSOLES)
+		return;
+
+	int32_t flags;
+	spin_lock_irqsave(&console_lock, flags);
+	console_shown = idx;
+	console_flush_one(&consoles[idx]);
+	spin_unlock_irqrestore(&console_lock, flags);
+}
+
+
+/*
+ * console_scrollback
+ *   DESCRIPTION: scroll the display through the history of the console on
+ *				  display. The screen is redrawn from the ring.
+ *   INPUTS: rows: rows to move back, negative to move forward
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: video memory written to, the cursor is hidden while
+ *				   scrolled back
+ */
+void
+console_scrollback(int32_t rows) {
+	int32_t flags, limit;
+	spin_lock_irqsave(&console_lock, flags);
+
+	console_t* c = &consoles[console_shown];
+	limit = c->direct ? 0 : c->filled - NUM_ROWS;
+	c->view += rows;
+	if (c->view > limit)
+		c->view = limit;
+	if (c->view < 0)
+		c->view = 0;
+	c->dirty = ALL_ROWS_DIRTY;
+	console_flush_one(c);
+
+	spin_unlock_irqrestore(&console_lock, flags);
+}
+
+
+/*
+ * console_set_direct
+ *   DESCRIPTION: switch a console in or out of direct mode, used while its
+ *				  program has video memory mapped with vidmap. The mapping
+ *				  is the console's page, see console_page, so the screen is
+ *				  moved there and drawn in place until direct mode ends.
+ *   INPUTS: idx: the console
+ *           direct: true to enter direct mode, false to leave it
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: video memory or the ring copied, start address and cursor
+ *				   may change
+ */
+void
+console_set_direct(int32_t idx, int32_t direct) {
+	int32_t row;
+
+	if (idx < 0 || idx >= NUM_CONSOLES)
+		return;
+
+	int32_t flags;
+	spin_lock_irqsave(&console_lock, flags);
+
+	console_t* c = &consoles[idx];
+	if (direct && !c->direct) {
+		/* put the screen at the vidmap page, nothing is pending after that */
+		c->top = console_home(c);
+		c->view = 0;
+		for (row = 0; row < NUM_ROWS; row++)
+			memcpy(window_cell(c, row, 0), console_cell(c, row, 0), NUM_COLS << 1);
+		c->dirty = 0;
+		c->scrolled = 0;
+		c->direct = true;
+	} else if (!direct && c->direct) {
+		/* take back what the program drew */
+		c->direct = false;
+		for (row = 0; row < NUM_ROWS; row++)
+			memcpy(console_cell(c, row, 0), window_cell(c, row, 0), NUM_COLS << 1);
+		c->dirty = 0;
+	}
+	if (idx == console_shown)
+		console_flush_one(c);
+
+	spin_unlock_irqrestore(&console_lock, flags);
+}
+
+
+/*
+ * console_page
+ *   DESCRIPTION: the page of video memory vidmap maps for a console's
+ *				  program, see console_set_direct
+ *   INPUTS: idx: the console
+ *   OUTPUTS: none
+ *   RETURN VALUE: physical address of the page
+ *   SIDE EFFECTS: none
+ */
+uint32_t
+console_page(int32_t idx) {
+	console_t* c = &consoles[idx];
+	return (uint32_t)(video_mem + ((console_base(c) + console_home(c)) << 1));
 }
 
 
@@ -52,7 +400,7 @@ update_cursor(int32_t row, int32_t col) {
  */
 int32_t 
 get_screen_y() {
-	return screen_y;
+	return consoles[console_shown].y;
 }
 
 
@@ -66,35 +414,76 @@ get_screen_y() {
  */
 int32_t 
 get_screen_x() {
-	return screen_x;
+	return consoles[console_shown].x;
+}
+
+
+/*
+ * console_clear
+ *   DESCRIPTION: clear a console
+ *   INPUTS: idx: the console
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: ring cleared, history dropped, cursor moved to the upper
+ *				   left corner. Video memory follows at once if the console is
+ *				   on display.
+ */
+void
+console_clear(int32_t idx) {
+	if (idx < 0 || idx >= NUM_CONSOLES)
+		return;
+
+	int32_t flags;
+	spin_lock_irqsave(&console_lock, flags);
+
+	/* clear the character at each location, by setting the character stored
+	at each location to NULL and the color back to default */
+	console_t* c = &consoles[idx];
+	memset_word(c->shadow, BLANK_CELL, SHADOW_ROWS * NUM_COLS);
+	if (c->direct)
+		memset_word(window_cell(c, 0, 0), BLANK_CELL, SCREEN_CELLS);
+
+	c->head = 0;
+	c->filled = NUM_ROWS;
+	c->dirty = ALL_ROWS_DIRTY;
+	c->view = 0;
+	c->x = 0;
+	c->y = 0;
+	if (idx == console_shown)
+		console_flush_one(c);
+
+	spin_unlock_irqrestore(&console_lock, flags);
 }
 
 
 /*
  * clear
- *   DESCRIPTION: clear video memory
+ *   DESCRIPTION: clear the console on screen
  *   INPUTS: none
  *   OUTPUTS: none
  *   RETURN VALUE: none
- *   SIDE EFFECTS: video memory cleared
+ *   SIDE EFFECTS: see console_clear
  */
 void
 clear(void)
 {
-    int32_t i;
-
-    for(i=0; i<NUM_ROWS*NUM_COLS; i++) {
-    	/* clear the character at each location, by setting the character 
-    	stored at each location to NULL */
-        *(uint8_t *)(video_mem + (i << 1)) = '\0';
-        /* reset the color at each location back to default */
-        *(uint8_t *)(video_mem + (i << 1) + 1) = NORMAL_ATTRIB;
-    }
+	console_clear(console_shown);
+}
 
-    /* reset cursor to upper left corner */
-    screen_x = 0;
-    screen_y = 0;
-    update_cursor(screen_y, screen_x);
+
+/*
+ * console_clear_row
+ *   DESCRIPTION: blank a row of a console's screen
+ *   INPUTS: c: the console
+ *           row: the row
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: writes to the ring, or video memory if direct
+ */
+static void
+console_clear_row(console_t* c, int32_t row) {
+	memset_word(console_cell(c, row, 0), BLANK_CELL, NUM_COLS);
+	c->dirty |= 1 << row;
 }
 
 
@@ -104,8 +493,7 @@ clear(void)
  *   INPUTS: pos_y: the y coordinate of the row to be cleared
  *   OUTPUTS: none
  *   RETURN VALUE: none
- *   SIDE EFFECTS: clears by writing to a row of video memory with the 
- *				   specified y coordinate
+ *   SIDE EFFECTS: clears a row of the screen on display
  */
 void
 clear_horiz_line(int32_t pos_y) {
@@ -113,19 +501,7 @@ clear_horiz_line(int32_t pos_y) {
 	if (pos_y >= NUM_ROWS || pos_y < 0)
 		return;
 
-	int32_t i;
-
-	/* advance the pointer to the correct row - see below for why shift by 1 
-	(multiply by 2)*/
-	char* mem_base = video_mem + ((pos_y * NUM_COLS) << 1);
-    for(i=0; i<NUM_COLS; i++) {
-
-    	/* character shown is at every even address, the odd address following 
-    	adjusts the attributes of the displayed character at the previous even 
-    	address */
-        *(uint8_t *)(mem_base + (i << 1)) = '\0';
-        *(uint8_t *)(mem_base + (i << 1) + 1) = NORMAL_ATTRIB;
-    }
+	console_clear_row(&consoles[console_shown], pos_y);
 }
 
 
@@ -133,25 +509,19 @@ clear_horiz_line(int32_t pos_y) {
  * search_line_feed
  *   DESCRIPTION: search for the position of the line feed in a row i.e. the 
  *				  number of characters in a row
- *   INPUTS: pos_y: the row to be searched
+ *   INPUTS: pos_y: the row of the screen on display to be searched
  *   OUTPUTS: none
  *   RETURN VALUE: the position of the line feed
- *   SIDE EFFECTS: Reads video memory.
+ *   SIDE EFFECTS: none
  */
 static int32_t
 search_line_feed(int32_t pos_y) {
 	uint32_t i;
 	
 	for (i=0; i<NUM_COLS; i++) {
-		/* character shown is at every even address, the odd address following 
-    	adjusts the attributes of the displayed character at the previous even 
-    	address */
-
     	/* we print a null in the buffer to denote a linefeed - see putc and
     	empty_char */
-    	/* advance the pointer to the correct row - see above for why shift by 1 
-		(multiply by 2)*/
-		if (*(uint8_t *)(video_mem + ((NUM_COLS*pos_y + i) << 1)) == '\0')
+		if (*console_cell(&consoles[console_shown], pos_y, i) == '\0')
 			return i;
 	}
 	/* otherwise, the whole line has characters and the linefeed must be at the
@@ -162,27 +532,28 @@ search_line_feed(int32_t pos_y) {
 
 /*
  * left_shift_cursor
- *   DESCRIPTION: left shift the cursor
+ *   DESCRIPTION: left shift the cursor. Caller holds console_lock.
  *   INPUTS: none
  *   OUTPUTS: none
  *   RETURN VALUE: none
- *   SIDE EFFECTS: cursor shifted, video memory and VGA registers written to
+ *   SIDE EFFECTS: cursor shifted
  */
 void 
 left_shift_cursor() {
+	console_t* c = &consoles[console_shown];
 	/* validate current cursor location */
-	if (screen_x <= 0 && screen_y <= 0)
+	if (c->x <= 0 && c->y <= 0)
 		return;
 	/* cursor is at left edge of screen - move cursor to location of last 
 	linefeed in the line above */
-	if (screen_x <= 0) {
-		screen_x = search_line_feed(screen_y - 1);
-        	if (screen_y > 0)
-        		screen_y--;
+	if (c->x <= 0) {
+		c->x = search_line_feed(c->y - 1);
+        	if (c->y > 0)
+        		c->y--;
 	}
 	else /* x coordinates is in bounds, simply decrement x position */
-		screen_x--;
-    update_cursor(screen_y, screen_x);
+		c->x--;
+    update_cursor(c->y, c->x);
 }
 
 /*
@@ -193,10 +564,14 @@ left_shift_cursor() {
  *   INPUTS: none
  *   OUTPUTS: none
  *   RETURN VALUE: none
- *   SIDE EFFECTS: Writes to video memory and VGA registers
+ *   SIDE EFFECTS: Writes to the console on display
  */
 void 
 keyboard_backspace() {
+	int32_t flags;
+	spin_lock_irqsave(&console_lock, flags);
+
+	console_t* c = &consoles[console_shown];
 	/* shift cursor left */
 	left_shift_cursor();
 
@@ -204,34 +579,61 @@ keyboard_backspace() {
 	/* character shown is at every even address, the odd address following 
     	adjusts the attributes of the displayed character at the previous even 
     	address */
-	*(uint8_t *)(video_mem + ((NUM_COLS*screen_y + screen_x) << 1)) = '\0';
-    *(uint8_t *)(video_mem + ((NUM_COLS*screen_y + screen_x) << 1) + 1) = 
-    NORMAL_ATTRIB;
+	*console_cell(c, c->y, c->x) = '\0';
+    *(console_cell(c, c->y, c->x) + 1) = NORMAL_ATTRIB;
+    c->dirty |= 1 << c->y;
 
-    update_cursor(screen_y, screen_x);
+    update_cursor(c->y, c->x);
+    spin_unlock_irqrestore(&console_lock, flags);
+}
+
+
+/*
+ * console_scroll
+ *   DESCRIPTION: scroll a console's screen down by a line. In the ring that
+ *				  is moving head, video memory catches up on the next flush.
+ *   INPUTS: c: the console
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Writes to the ring, or to video memory if direct
+ */
+static void
+console_scroll(console_t* c) {
+	if (c->direct) {
+		/* moves all rows to the row above, except for the first row, which
+		is simply truncated - the screen is the vidmap page so it cannot move */
+		memmove(window_cell(c, 0, 0), window_cell(c, 1, 0), 
+			NUM_COLS * (NUM_ROWS - 1) * 2);
+
+		/* blank the bottommost row so that we can now write to it */
+		console_clear_row(c, NUM_ROWS - 1);
+		return;
+	}
+
+	/* the old top row stays behind in the ring as history */
+	c->head = (c->head + 1) & (SHADOW_ROWS - 1);
+	if (c->filled < SHADOW_ROWS)
+		c->filled++;
+	c->scrolled++;
+
+	/* dirty rows move up with the screen, the new bottom row is blanked so
+	that we can now write to it */
+	c->dirty >>= 1;
+	console_clear_row(c, NUM_ROWS - 1);
 }
 
 
 /*
  * scroll_screen_down
- *   DESCRIPTION: scroll the screen down
+ *   DESCRIPTION: scroll the screen on display down by a line
  *   INPUTS: none
  *   OUTPUTS: none
  *   RETURN VALUE: none
- *   SIDE EFFECTS: Writes to video memory and VGA registers
+ *   SIDE EFFECTS: see console_scroll
  */
 void
 scroll_screen_down () {
-	/* moves all rows to the row above, except for the first row, which is 
-	simply truncated */
-	/* each character consists of two bytes - character shown is at every even
-    address, the odd address following adjusts the attributes of the displayed
-    character at the previous even address */
-	memmove (video_mem, video_mem + (NUM_COLS << 1), 
-		NUM_COLS * (NUM_ROWS - 1) * 2);
-
-	/* blank the bottommost row so that we can now write to it */
-	clear_horiz_line (NUM_ROWS - 1);
+	console_scroll(&consoles[console_shown]);
 }
 //===========================================
 //text mode support functions for terminal done
@@ -239,6 +641,43 @@ scroll_screen_down () {
 
 
 
+/*
+ * printf_putc
+ *   DESCRIPTION: add a character to printf's output, handing full buffers
+ *				  to the log ring
+ *   INPUTS: out: printf's output buffer
+ *           c: character to add
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: may append to the log ring
+ */
+static void
+printf_putc(printf_out_t* out, int8_t c)
+{
+	if (out->len == PRINTF_BUF_LEN) {
+		klog_write(out->buf, out->len);
+		out->len = 0;
+	}
+	out->buf[out->len++] = c;
+}
+
+/*
+ * printf_puts
+ *   DESCRIPTION: add a string to printf's output
+ *   INPUTS: out: printf's output buffer
+ *           s: string to add
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: may append to the log ring
+ */
+static void
+printf_puts(printf_out_t* out, int8_t* s)
+{
+	while (*s != '\0')
+		printf_putc(out, *s++);
+}
+
+
 /* Standard printf().
  * Only supports the following format strings:
  * %%  - print a literal '%' character
@@ -256,6 +695,8 @@ scroll_screen_down () {
  *       the beginning), but I think it's more flexible this way.
  *       Also note: %x is the only conversion specifier that can use
  *       the "#" modifier to alter output.
+ * The text goes to the kernel log ring and reaches the screen on a later
+ * timer tick, see klog.c, so printf never waits on the console.
  * */
 int32_t
 printf(int8_t *format, ...)
@@ -267,6 +708,9 @@ printf(int8_t *format, ...)
 	int32_t* esp = (void *)&format;
 	esp++;
 
+	printf_out_t out;
+	out.len = 0;
+
 	while(*buf != '\0') {
 		switch(*buf) {
 			case '%':
@@ -279,7 +723,7 @@ format_char_switch:
 					switch(*buf) {
 						/* Print a literal '%' character */
 						case '%':
-							putc('%');
+							printf_putc(&out, '%');
 							break;
 
 						/* Use alternate formatting */
@@ -297,7 +741,7 @@ format_char_switch:
 								int8_t conv_buf[64];
 								if(alternate == 0) {
 									itoa(*((uint32_t *)esp), conv_buf, 16);
-									puts(conv_buf);
+									printf_puts(&out, conv_buf);
 								} else {
 									int32_t starting_index;
 									int32_t i;
@@ -307,7 +751,7 @@ format_char_switch:
 										conv_buf[i] = '0';
 										i++;
 									}
-									puts(&conv_buf[starting_index]);
+									printf_puts(&out, &conv_buf[starting_index]);
 								}
 								esp++;
 							}
@@ -318,7 +762,7 @@ format_char_switch:
 							{
 								int8_t conv_buf[36];
 								itoa(*((uint32_t *)esp), conv_buf, 10);
-								puts(conv_buf);
+								printf_puts(&out, conv_buf);
 								esp++;
 							}
 							break;
@@ -334,20 +778,20 @@ format_char_switch:
 								} else {
 									itoa(value, conv_buf, 10);
 								}
-								puts(conv_buf);
+								printf_puts(&out, conv_buf);
 								esp++;
 							}
 							break;
 
 						/* Print a single character */
 						case 'c':
-							putc( (uint8_t) *((int32_t *)esp) );
+							printf_putc(&out, (uint8_t) *((int32_t *)esp));
 							esp++;
 							break;
 
 						/* Print a NULL-terminated string */
 						case 's':
-							puts( *((int8_t **)esp) );
+							printf_puts(&out, *((int8_t **)esp));
 							esp++;
 							break;
 
@@ -359,12 +803,13 @@ format_char_switch:
 				break;
 
 			default:
-				putc(*buf);
+				printf_putc(&out, *buf);
 				break;
 		}
 		buf++;
 	}
 
+	klog_write(out.buf, out.len);
 	return (buf - format);
 }
 
@@ -393,134 +838,198 @@ puts(int8_t* s)
 * void putc(uint8_t c);
 *   Inputs: uint_8* c = character to print
 *   Return Value: void
-*	Function: Output a character to the console. Video memory written to.
+*	Function: Output a character to the console on screen. It shows up in
+*			  video memory on the next console_flush.
 */
 
 void
 putc(uint8_t c)
 {	
+	int32_t flags;
+
+	/* mirror the console so it can be captured when running headless. Not
+	under console_lock, the serial port is slower than the screen. */
+	serial_console_write(&c, 1);
+
+	spin_lock_irqsave(&console_lock, flags);
+	console_putc(&consoles[console_shown], c);
+	spin_unlock_irqrestore(&console_lock, flags);
+}
+
+
+/*
+ * console_putc
+ *   DESCRIPTION: put a character on a console's screen, scrolling when the
+ *				  cursor passes the bottom row
+ *   INPUTS: c: the console
+ *           ch: character to print, newlines start a new row
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: the ring (video memory if direct) written, the display
+ *				   returns to the screen if it was scrolled back
+ */
+static void
+console_putc(console_t* c, uint8_t ch)
+{
+	/* output always shows up on screen, not in the history */
+	if (c->view != 0) {
+		c->view = 0;
+		c->dirty = ALL_ROWS_DIRTY;
+	}
+	c->dirty |= 1 << c->y;
+
 	/* starting printing at the next (lower by one) row when we get a 
 	linefeed */
-    if(c == '\n' || c == '\r') {
-    	/* character shown is at every even address, the odd address following 
-    	adjusts the attributes of the displayed character at the previous even 
-    	address */
-
+    if(ch == '\n' || ch == '\r') {
     	/* we print a null in the buffer to denote a linefeed - see
     	search_line_feed */
-    	*(uint8_t *)(video_mem + ((NUM_COLS*screen_y + screen_x) << 1)) = '\0';
-        *(uint8_t *)(video_mem + ((NUM_COLS*screen_y + screen_x) << 1) + 1) = 
-        	NORMAL_ATTRIB;
+    	*console_cell(c, c->y, c->x) = '\0';
+        *(console_cell(c, c->y, c->x) + 1) = NORMAL_ATTRIB;
 
         /* start printing at the next row */
-        screen_y++;
-        if (screen_y >= NUM_ROWS) {
+        c->y++;
+        if (c->y >= NUM_ROWS) {
         	/* at bottommost row, scroll so we get more space to print */
-        	scroll_screen_down();
-        	screen_y = NUM_ROWS - 1; /* row numbering starts at zero */
+        	console_scroll(c);
+        	c->y = NUM_ROWS - 1; /* row numbering starts at zero */
         }
         /* reset cursor/next character to be printed coordinates to the left 
         side of the screen */
-        screen_x=0;
+        c->x = 0;
     } else {
-    	/* character shown is at every even address, the odd address following 
-    	adjusts the attributes of the displayed character at the previous even 
-    	address */
     	/* print the character */
-        *(uint8_t *)(video_mem + ((NUM_COLS*screen_y + screen_x) << 1)) = c;
-        *(uint8_t *)(video_mem + ((NUM_COLS*screen_y + screen_x) << 1) + 1) = 
-        	NORMAL_ATTRIB;
-        screen_x++;
+        *console_cell(c, c->y, c->x) = ch;
+        *(console_cell(c, c->y, c->x) + 1) = NORMAL_ATTRIB;
+        c->x++;
         /* reset cursor/next character to be printed coordinates if we reach 
         the lower right corner of the screen */
-        if (screen_x >= NUM_COLS) {
-        	screen_x %= NUM_COLS;
-        	screen_y++;
-        	if (screen_y >= NUM_ROWS) {
+        if (c->x >= NUM_COLS) {
+        	c->x %= NUM_COLS;
+        	c->y++;
+        	if (c->y >= NUM_ROWS) {
         		/* at bottommost row, scroll so we get more space to print */
-        		scroll_screen_down();
-        		screen_y = NUM_ROWS - 1; /* row numbering starts at zero */
+        		console_scroll(c);
+        		c->y = NUM_ROWS - 1; /* row numbering starts at zero */
         	}
         }
     }
-    update_cursor(screen_y, screen_x);
 }
 
 
 /*
- * scroll_screen_down
- *   DESCRIPTION: scroll the screen down
- *   INPUTS: none
+ * render_span
+ *   DESCRIPTION: render a run of characters into a text buffer the way
+ *				  console_putc would, but scroll once for the whole run: a first
+ *				  pass works out how many rows the run advances, the buffer
+ *				  is shifted up by that much in one move, and the second
+ *				  pass only writes the characters that stay on screen
+ *   INPUTS: s: characters to render, newlines start a new row
+ *           len: number of characters
+ *           buffer: text buffer, NUM_ROWS by NUM_COLS cells
+ *           x, y: cursor position, updated
  *   OUTPUTS: none
  *   RETURN VALUE: none
- *   SIDE EFFECTS: Writes to video memory and VGA registers
+ *   SIDE EFFECTS: writes to buffer, does not move the hardware cursor
  */
 static void
-shift_screen (int8_t* buffer, int32_t y) {
-	/* moves all rows to the row above, except for the first row, which is 
-	simply truncated */
-	/* each character consists of two bytes - character shown is at every even
-    address, the odd address following adjusts the attributes of the displayed
-    character at the previous even address */
-	memmove (buffer, buffer + (NUM_COLS << 1), NUM_COLS * (NUM_ROWS - 1) * 2);
+render_span(const uint8_t* s, int32_t len, int8_t* buffer, int32_t* x, int32_t* y)
+{
+	int32_t i, col, row, advance = 0, scroll;
+	/* a blank cell is a linefeed marker, see search_line_feed */
+	uint16_t blank = NORMAL_ATTRIB << LOW_BYTE;
+
+	/* count the row advances, including wraps at the right edge */
+	col = *x;
+	for (i = 0; i < len; i++) {
+		if (s[i] == '\n' || s[i] == '\r' || ++col >= NUM_COLS) {
+			col = 0;
+			advance++;
+		}
+	}
 
-	/* blank the bottommost row so that we can now write to it */
-	memset(buffer + ((y * NUM_COLS) << 1), '\0', NUM_COLS << 1);
+	/* rows that scroll off the top - if the whole screen goes, just blank it */
+	scroll = *y + advance - (NUM_ROWS - 1);
+	if (scroll >= NUM_ROWS) {
+		memset_word(buffer, blank, NUM_ROWS * NUM_COLS);
+	} else if (scroll > 0) {
+		memmove(buffer, buffer + ((scroll * NUM_COLS) << 1),
+			((NUM_ROWS - scroll) * NUM_COLS) << 1);
+		memset_word(buffer + (((NUM_ROWS - scroll) * NUM_COLS) << 1), blank,
+			scroll * NUM_COLS);
+	} else {
+		scroll = 0;
+	}
+
+	/* rows are relative to the scrolled buffer, negative ones are gone */
+	col = *x;
+	row = *y - scroll;
+	for (i = 0; i < len; i++) {
+		/* character shown is at every even address, the odd address following 
+		adjusts the attributes of the displayed character at the previous even 
+		address */
+		int8_t* cell = buffer + ((NUM_COLS * row + col) << 1);
+		if (s[i] == '\n' || s[i] == '\r') {
+			if (row >= 0) {
+				cell[0] = '\0';
+				cell[1] = NORMAL_ATTRIB;
+			}
+			col = 0;
+			row++;
+			continue;
+		}
+		if (row >= 0) {
+			cell[0] = s[i];
+			cell[1] = NORMAL_ATTRIB;
+		}
+		if (++col >= NUM_COLS) {
+			col = 0;
+			row++;
+		}
+	}
+
+	*x = col;
+	*y = row;
 }
 
 /*
-* void putc(uint8_t c);
-*   Inputs:
-*   Return Value: void
-*	Function: performs no error checking, put c onto designated video buffer
-*/
-
+ * console_write
+ *   DESCRIPTION: put a run of characters on a console, shown or not - same
+ *				  result as calling putc for each on that console. This only
+ *				  writes RAM, the console on display is copied to video
+ *				  memory on the next console_flush. In direct mode the
+ *				  screen cannot move, so the run is scrolled once with
+ *				  render_span. Pending kernel log text goes out first.
+ *   INPUTS: idx: the console
+ *           s: characters to print
+ *           len: number of characters
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: the ring written, or video memory if direct
+ */
 void
-putchar(uint8_t c, int8_t* buffer, int32_t* x, int32_t* y)
-{	
-	/* starting printing at the next (lower by one) row when we get a 
-	linefeed */
-    if(c == '\n' || c == '\r') {
-    	/* character shown is at every even address, the odd address following 
-    	adjusts the attributes of the displayed character at the previous even 
-    	address */
+console_write(int32_t idx, const uint8_t* s, int32_t len)
+{
+	int32_t i, flags;
 
-    	/* we print a null in the buffer to denote a linefeed - see
-    	search_line_feed */
-    	*(uint8_t *)(buffer + ((NUM_COLS * (*y) + (*x)) << 1)) = '\0';
-        *(uint8_t *)(buffer + ((NUM_COLS * (*y) + (*x)) << 1) + 1) = NORMAL_ATTRIB;
+	if (idx < 0 || idx >= NUM_CONSOLES)
+		return;
+	console_t* c = &consoles[idx];
 
-        /* start printing at the next row */
-        *y+=1;
-        if (*y >= NUM_ROWS) {
-        	/* at bottommost row, scroll so we get more space to print */
-        	shift_screen(buffer, *y - 1);
-        	*y = NUM_ROWS - 1; /* row numbering starts at zero */
-        }
-        /* reset cursor/next character to be printed coordinates to the left 
-        side of the screen */
-        *x=0;
-    } else {
-    	/* character shown is at every even address, the odd address following 
-    	adjusts the attributes of the displayed character at the previous even 
-    	address */
-    	/* print the character */
-        *(uint8_t *)(buffer + ((NUM_COLS * (*y) + (*x)) << 1)) = c;
-        *(uint8_t *)(buffer + ((NUM_COLS * (*y) + (*x)) << 1) + 1) = NORMAL_ATTRIB;
-        *x+=1;
-        /* reset cursor/next character to be printed coordinates if we reach 
-        the lower right corner of the screen */
-        if (*x >= NUM_COLS) {
-        	*x %= NUM_COLS;
-        	*y+=1;
-        	if (*y >= NUM_ROWS) {
-        		/* at bottommost row, scroll so we get more space to print */
-        		shift_screen(buffer, *y - 1);
-        		*y = NUM_ROWS - 1; /* row numbering starts at zero */
-        	}
-        }
-    }
-    //do not update cursor here!!!
+	/* kernel messages printed before this output must show before it */
+	klog_drain(KLOG_SIZE);
+
+	/* mirror the console so it can be captured when running headless */
+	if (idx == console_shown)
+		serial_console_write(s, len);
+
+	spin_lock_irqsave(&console_lock, flags);
+	if (c->direct) {
+		render_span(s, len, window_cell(c, 0, 0), &c->x, &c->y);
+	} else {
+		for (i = 0; i < len; i++)
+			console_putc(c, s[i]);
+	}
+	spin_unlock_irqrestore(&console_lock, flags);
 }
 
 
@@ -610,54 +1119,6 @@ strlen(const int8_t* s)
 	return len;
 }
 
-/*
-* void* memset(void* s, int32_t c, uint32_t n);
-*   Inputs: void* s = pointer to memory
-*			int32_t c = value to set memory to
-*			uint32_t n = number of bytes to set
-*   Return Value: new string
-*	Function: set n consecutive bytes of pointer s to value c
-*/
-
-void*
-memset(void* s, int32_t c, uint32_t n)
-{
-	c &= 0xFF;
-	asm volatile("                  \n\
-			.memset_top:            \n\
-			testl   %%ecx, %%ecx    \n\
-			jz      .memset_done    \n\
-			testl   $0x3, %%edi     \n\
-			jz      .memset_aligned \n\
-			movb    %%al, (%%edi)   \n\
-			addl    $1, %%edi       \n\
-			subl    $1, %%ecx       \n\
-			jmp     .memset_top     \n\
-			.memset_aligned:        \n\
-			movw    %%ds, %%dx      \n\
-			movw    %%dx, %%es      \n\
-			movl    %%ecx, %%edx    \n\
-			shrl    $2, %%ecx       \n\
-			andl    $0x3, %%edx     \n\
-			cld                     \n\
-			rep     stosl           \n\
-			.memset_bottom:         \n\
-			testl   %%edx, %%edx    \n\
-			jz      .memset_done    \n\
-			movb    %%al, (%%edi)   \n\
-			addl    $1, %%edi       \n\
-			subl    $1, %%edx       \n\
-			jmp     .memset_bottom  \n\
-			.memset_done:           \n\
-			"
-			:
-			: "a"(c << 24 | c << 16 | c << 8 | c), "D"(s), "c"(n)
-			: "edx", "memory", "cc"
-			);
-
-	return s;
-}
-
 /*
 * void* memset_word(void* s, int32_t c, uint32_t n);
 *   Inputs: void* s = pointer to memory
@@ -711,91 +1172,6 @@ memset_dword(void* s, int32_t c, uint32_t n)
 	return s;
 }
 
-/*
-* void* memcpy(void* dest, const void* src, uint32_t n);
-*   Inputs: void* dest = destination of copy
-*			const void* src = source of copy
-*			uint32_t n = number of byets to copy
-*   Return Value: pointer to dest
-*	Function: copy n bytes of src to dest
-*/
-
-void*
-memcpy(void* dest, const void* src, uint32_t n)
-{
-	asm volatile("                  \n\
-			.memcpy_top:            \n\
-			testl   %%ecx, %%ecx    \n\
-			jz      .memcpy_done    \n\
-			testl   $0x3, %%edi     \n\
-			jz      .memcpy_aligned \n\
-			movb    (%%esi), %%al   \n\
-			movb    %%al, (%%edi)   \n\
-			addl    $1, %%edi       \n\
-			addl    $1, %%esi       \n\
-			subl    $1, %%ecx       \n\
-			jmp     .memcpy_top     \n\
-			.memcpy_aligned:        \n\
-			movw    %%ds, %%dx      \n\
-			movw    %%dx, %%es      \n\
-			movl    %%ecx, %%edx    \n\
-			shrl    $2, %%ecx       \n\
-			andl    $0x3, %%edx     \n\
-			cld                     \n\
-			rep     movsl           \n\
-			.memcpy_bottom:         \n\
-			testl   %%edx, %%edx    \n\
-			jz      .memcpy_done    \n\
-			movb    (%%esi), %%al   \n\
-			movb    %%al, (%%edi)   \n\
-			addl    $1, %%edi       \n\
-			addl    $1, %%esi       \n\
-			subl    $1, %%edx       \n\
-			jmp     .memcpy_bottom  \n\
-			.memcpy_done:           \n\
-			"
-			:
-			: "S"(src), "D"(dest), "c"(n)
-			: "eax", "edx", "memory", "cc"
-			);
-
-	return dest;
-}
-
-/*
-* void* memmove(void* dest, const void* src, uint32_t n);
-*   Inputs: void* dest = destination of move
-*			const void* src = source of move
-*			uint32_t n = number of byets to move
-*   Return Value: pointer to dest
-*	Function: move n bytes of src to dest
-*/
-
-/* Optimized memmove (used for overlapping memory areas) */
-void*
-memmove(void* dest, const void* src, uint32_t n)
-{
-	asm volatile("                  \n\
-			movw    %%ds, %%dx      \n\
-			movw    %%dx, %%es      \n\
-			cld                     \n\
-			cmp     %%edi, %%esi    \n\
-			jae     .memmove_go     \n\
-			leal    -1(%%esi, %%ecx), %%esi    \n\
-			leal    -1(%%edi, %%ecx), %%edi    \n\
-			std                     \n\
-			.memmove_go:            \n\
-			rep     movsb           \n\
-			"
-			:
-			: "D"(dest), "S"(src), "c"(n)
-			: "edx", "memory", "cc"
-			);
-
-	return dest;
-}
-
-
 /*
 * int32_t strncmp(const int8_t* s1, const int8_t* s2, uint32_t n)
 *   Inputs: const int8_t* s1 = first string to compare
@@ -888,7 +1264,9 @@ void
 test_interrupts(void)
 {
 	int32_t i;
+	console_t* c = &consoles[console_shown];
 	for (i=0; i < NUM_ROWS*NUM_COLS; i++) {
-		video_mem[i<<1]++;
+		(*console_cell(c, i / NUM_COLS, i % NUM_COLS))++;
 	}
+	c->dirty = ALL_ROWS_DIRTY;
 }
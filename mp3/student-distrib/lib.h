@@ -13,9 +13,22 @@
 #define NUM_ROWS 25
 #define NORMAL_ATTRIB 0x07
 
+/* the text mode window, 0xB8000 - 0xBFFFF, is split into one region per
+console (terminal). Consoles render into RAM, see console_flush_one. */
+#define VIDEO_WINDOW_SIZE 0x8000
+#define NUM_CONSOLES 3
+#define CONSOLE_ROWS (VIDEO_WINDOW_SIZE / (NUM_COLS << 1) / NUM_CONSOLES)
+/* rows of the RAM ring behind each console - the screen plus its history,
+must be a power of 2 */
+#define SHADOW_ROWS 128
+/* vidmap hands out the first page boundary in a console's region */
+#define TEXT_PAGE_SIZE 0x1000
+
 /* VGA register constants */
 #define CURSOR_LOC_LOW 0x0F
 #define CURSOR_LOC_HIGH 0x0E
+#define START_ADDR_HIGH 0x0C
+#define START_ADDR_LOW 0x0D
 #define VGA_ADDR_PORT 0x3D4
 #define VGA_DATA_PORT 0x3D5
 
@@ -44,8 +57,15 @@ void clear_horiz_line(int pos_y);
 void left_shift_cursor();
 void right_shift_cursor();
 void update_cursor(int row, int col);
+void console_flush();
+void console_scrollback(int32_t rows);
+void console_set_direct(int32_t idx, int32_t direct);
+void console_show(int32_t idx);
+void console_clear(int32_t idx);
+uint32_t console_page(int32_t idx);
 
 //see c file for details
+/* memset, memcpy and memmove are in mem.c */
 void* memset(void* s, int32_t c, uint32_t n);
 void* memset_word(void* s, int32_t c, uint32_t n);
 void* memset_dword(void* s, int32_t c, uint32_t n);
@@ -64,7 +84,7 @@ int32_t safe_strncpy(int8_t* dest, const int8_t* src, int32_t n);
 int32_t get_screen_y();
 int32_t get_screen_x();
 
-void putchar(uint8_t c, int8_t* buffer, int32_t* x, int32_t* y);
+void console_write(int32_t idx, const uint8_t* s, int32_t len);
 
 /* mp1 rtc interrupt test function */
 void test_interrupts();
@@ -109,6 +129,44 @@ static inline uint32_t inl(port)
 	return val;
 }
 
+/* Divides a 64-bit value by a 32-bit value with a single divl, so no
+ * libgcc helper is needed. The quotient must fit in 32 bits. */
+static inline uint32_t div64_32(uint64_t dividend, uint32_t divisor)
+{
+	uint32_t quot, rem;
+	asm volatile("divl  %4"
+			: "=a"(quot), "=d"(rem)
+			: "a"((uint32_t)dividend), "d"((uint32_t)(dividend >> 32)),
+			  "rm"(divisor)
+			: "cc" );
+	return quot;
+}
+
+/* Reads the time stamp counter */
+static inline uint64_t rdtsc(void)
+{
+	uint64_t tsc;
+	asm volatile("rdtsc" : "=A"(tsc));
+	return tsc;
+}
+
+/* Reads the low 32 bits of a model specific register */
+static inline uint32_t rdmsr(uint32_t msr)
+{
+	uint32_t low, high;
+	asm volatile("rdmsr" : "=a"(low), "=d"(high) : "c"(msr));
+	return low;
+}
+
+/* Writes a model specific register */
+#define wrmsr(msr, value)                   \
+do {                                        \
+	asm volatile("wrmsr"                    \
+			:                               \
+			: "c"(msr), "a"(value), "d"(0)  \
+			: "memory");                    \
+} while(0)
+
 /* Writes a byte to a port */
 #define outb(data, port)                \
 do {                                    \
@@ -183,4 +241,8 @@ do {                                    \
 			);                      \
 } while(0)
 
+/* compiler barrier - orders ring accesses against the index update in rings
+shared with an interrupt handler */
+#define barrier() asm volatile("" : : : "memory")
+
 #endif /* _LIB_H */
@@ -0,0 +1,415 @@
+/* mem.c - memcpy, memset and memmove. Each picks a way to copy by the
+ * length and by what init_mem found the processor can do. Only types.h is
+ * included so tools/membench.c can build this file on the host.
+ * vim:ts=4 noexpandtab
+ */
+
+#include "mem.h"
+
+/* CPUID leaves and feature bits, lib.h is not included here */
+#define CPUID_MAX_LEAF 0
+#define CPUID_FEATURES 1
+#define CPUID_EXT_FEATURES 7
+#define CPUID_EDX_SSE2 (1 << 26)
+#define CPUID_EBX_ERMS (1 << 9)
+
+/* both start out off so anything copied before init_mem takes the path
+every processor has */
+int32_t mem_erms = 0;
+int32_t mem_sse2 = 0;
+
+/* function prototypes for internal functions */
+static void copy_dwords(void* dest, const void* src, uint32_t n);
+static void copy_erms(void* dest, const void* src, uint32_t n);
+static void copy_nt(void* dest, const void* src, uint32_t n);
+static void copy_backward(void* dest, const void* src, uint32_t n);
+static void set_dwords(void* s, uint32_t pattern, uint32_t n);
+static void set_erms(void* s, uint32_t pattern, uint32_t n);
+static void set_nt(void* s, uint32_t pattern, uint32_t n);
+
+
+/*
+ * init_mem
+ *   DESCRIPTION: ask the processor whether it has fast rep movsb/stosb
+ *				  (ERMS) and movnti (SSE2). Neither touches the FPU or XMM
+ *				  registers, so the lazy FPU switch is not involved.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: mem_erms and mem_sse2 set
+ */
+void init_mem() {
+	uint32_t eax, ebx, ecx, edx, max_leaf;
+
+	asm volatile("cpuid"
+		: "=a"(max_leaf), "=b"(ebx), "=c"(ecx), "=d"(edx)
+		: "a"(CPUID_MAX_LEAF)
+		: "cc");
+
+	asm volatile("cpuid"
+		: "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx)
+		: "a"(CPUID_FEATURES)
+		: "cc");
+	mem_sse2 = (edx & CPUID_EDX_SSE2) != 0;
+
+	if (max_leaf >= CPUID_EXT_FEATURES) {
+		asm volatile("cpuid"
+			: "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx)
+			: "a"(CPUID_EXT_FEATURES), "c"(0)
+			: "cc");
+		mem_erms = (ebx & CPUID_EBX_ERMS) != 0;
+	}
+}
+
+/*
+ * memcpy
+ *   DESCRIPTION: copy n bytes of src to dest, the two must not overlap
+ *				  unless dest is below src
+ *   INPUTS: dest: destination of copy
+ *           src: source of copy
+ *           n: number of bytes to copy
+ *   OUTPUTS: none
+ *   RETURN VALUE: pointer to dest
+ *   SIDE EFFECTS: copies of MEM_NT_MIN bytes or more bypass the cache
+ */
+void* memcpy(void* dest, const void* src, uint32_t n) {
+	if (n >= MEM_NT_MIN && mem_sse2)
+		copy_nt(dest, src, n);
+	else if (n >= MEM_ERMS_MIN && mem_erms)
+		copy_erms(dest, src, n);
+	else
+		copy_dwords(dest, src, n);
+	return dest;
+}
+
+/*
+ * memset
+ *   DESCRIPTION: set n consecutive bytes of s to c
+ *   INPUTS: s: pointer to memory
+ *           c: value to set memory to, only the low byte is used
+ *           n: number of bytes to set
+ *   OUTPUTS: none
+ *   RETURN VALUE: pointer to s
+ *   SIDE EFFECTS: fills of MEM_NT_MIN bytes or more bypass the cache
+ */
+void* memset(void* s, int32_t c, uint32_t n) {
+	uint32_t pattern = (uint32_t)(c & 0xFF) * 0x01010101;
+
+	if (n >= MEM_NT_MIN && mem_sse2)
+		set_nt(s, pattern, n);
+	else if (n >= MEM_ERMS_MIN && mem_erms)
+		set_erms(s, pattern, n);
+	else
+		set_dwords(s, pattern, n);
+	return s;
+}
+
+/*
+ * memzero_nt
+ *   DESCRIPTION: zero memory around the cache whatever its length, for
+ *				  memory that is filled now but read much later, e.g. free
+ *				  page frames. Falls back to rep stosl without SSE2.
+ *   INPUTS: s: pointer to memory, best cache line aligned
+ *           n: number of bytes to zero
+ *   OUTPUTS: none
+ *   RETURN VALUE: pointer to s
+ *   SIDE EFFECTS: the stores are fenced before returning
+ */
+void* memzero_nt(void* s, uint32_t n) {
+	if (n >= 2 * MEM_NT_BLOCK && mem_sse2)
+		set_nt(s, 0, n);
+	else
+		set_dwords(s, 0, n);
+	return s;
+}
+
+/*
+ * memmove
+ *   DESCRIPTION: copy n bytes of src to dest, which may overlap. Copying
+ *				  forward is safe unless dest starts inside src, so only
+ *				  that case copies backward.
+ *   INPUTS: dest: destination of move
+ *           src: source of move
+ *           n: number of bytes to move
+ *   OUTPUTS: none
+ *   RETURN VALUE: pointer to dest
+ *   SIDE EFFECTS: none
+ */
+void* memmove(void* dest, const void* src, uint32_t n) {
+	if ((uint32_t)dest - (uint32_t)src >= n)
+		return memcpy(dest, src, n);
+	copy_backward(dest, src, n);
+	return dest;
+}
+
+/*
+ * copy_dwords
+ *   DESCRIPTION: copy bytes until dest is 4 byte aligned, then dwords with
+ *				  rep movsl, then the last bytes. Every processor runs this
+ *				  well, and it has the shortest start up for short copies.
+ *   INPUTS: dest, src, n: as for memcpy
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void copy_dwords(void* dest, const void* src, uint32_t n) {
+	asm volatile("                  \n\
+			movw    %%ds, %%dx      \n\
+			movw    %%dx, %%es      \n\
+			cld                     \n\
+			movl    %%edi, %%edx    \n\
+			negl    %%edx           \n\
+			andl    $0x3, %%edx     \n\
+			cmpl    %%ecx, %%edx    \n\
+			jbe     1f              \n\
+			movl    %%ecx, %%edx    \n\
+			1:                      \n\
+			subl    %%edx, %%ecx    \n\
+			xchgl   %%edx, %%ecx    \n\
+			rep     movsb           \n\
+			movl    %%edx, %%ecx    \n\
+			shrl    $2, %%ecx       \n\
+			andl    $0x3, %%edx     \n\
+			rep     movsl           \n\
+			movl    %%edx, %%ecx    \n\
+			rep     movsb           \n\
+			"
+			: "+S"(src), "+D"(dest), "+c"(n)
+			:
+			: "edx", "memory", "cc"
+			);
+}
+
+/*
+ * copy_erms
+ *   DESCRIPTION: copy with one rep movsb, which ERMS processors run a cache
+ *				  line at a time whatever the alignment
+ *   INPUTS: dest, src, n: as for memcpy
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void copy_erms(void* dest, const void* src, uint32_t n) {
+	asm volatile("                  \n\
+			movw    %%ds, %%dx      \n\
+			movw    %%dx, %%es      \n\
+			cld                     \n\
+			rep     movsb           \n\
+			"
+			: "+S"(src), "+D"(dest), "+c"(n)
+			:
+			: "edx", "memory", "cc"
+			);
+}
+
+/*
+ * copy_nt
+ *   DESCRIPTION: copy with movnti, a cache line per loop with the source
+ *				  prefetched ahead. The stores go around the cache, which a
+ *				  copy this large would otherwise flush. movnti stores from
+ *				  general registers, so no FPU or XMM state is used.
+ *   INPUTS: dest, src, n: as for memcpy, n at least MEM_NT_BLOCK
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: the stores are fenced before returning
+ */
+static void copy_nt(void* dest, const void* src, uint32_t n) {
+	uint32_t head = -(uint32_t)dest & (MEM_NT_BLOCK - 1);
+	uint32_t blocks;
+
+	/* whole lines are written, so the write combining buffers fill */
+	copy_dwords(dest, src, head);
+	dest = (uint8_t*)dest + head;
+	src = (const uint8_t*)src + head;
+	n -= head;
+
+	blocks = n / MEM_NT_BLOCK;
+	asm volatile("                          \n\
+			1:                              \n\
+			prefetchnta 512(%%esi)          \n\
+			movl    0(%%esi), %%eax         \n\
+			movl    4(%%esi), %%edx         \n\
+			movnti  %%eax, 0(%%edi)         \n\
+			movnti  %%edx, 4(%%edi)         \n\
+			movl    8(%%esi), %%eax         \n\
+			movl    12(%%esi), %%edx        \n\
+			movnti  %%eax, 8(%%edi)         \n\
+			movnti  %%edx, 12(%%edi)        \n\
+			movl    16(%%esi), %%eax        \n\
+			movl    20(%%esi), %%edx        \n\
+			movnti  %%eax, 16(%%edi)        \n\
+			movnti  %%edx, 20(%%edi)        \n\
+			movl    24(%%esi), %%eax        \n\
+			movl    28(%%esi), %%edx        \n\
+			movnti  %%eax, 24(%%edi)        \n\
+			movnti  %%edx, 28(%%edi)        \n\
+			movl    32(%%esi), %%eax        \n\
+			movl    36(%%esi), %%edx        \n\
+			movnti  %%eax, 32(%%edi)        \n\
+			movnti  %%edx, 36(%%edi)        \n\
+			movl    40(%%esi), %%eax        \n\
+			movl    44(%%esi), %%edx        \n\
+			movnti  %%eax, 40(%%edi)        \n\
+			movnti  %%edx, 44(%%edi)        \n\
+			movl    48(%%esi), %%eax        \n\
+			movl    52(%%esi), %%edx        \n\
+			movnti  %%eax, 48(%%edi)        \n\
+			movnti  %%edx, 52(%%edi)        \n\
+			movl    56(%%esi), %%eax        \n\
+			movl    60(%%esi), %%edx        \n\
+			movnti  %%eax, 56(%%edi)        \n\
+			movnti  %%edx, 60(%%edi)        \n\
+			addl    $64, %%esi              \n\
+			addl    $64, %%edi              \n\
+			decl    %%ecx                   \n\
+			jnz     1b                      \n\
+			sfence                          \n\
+			"
+			: "+S"(src), "+D"(dest), "+c"(blocks)
+			:
+			: "eax", "edx", "memory", "cc"
+			);
+
+	copy_dwords(dest, src, n & (MEM_NT_BLOCK - 1));
+}
+
+/*
+ * copy_backward
+ *   DESCRIPTION: copy from the last byte down, for a dest that starts
+ *				  inside src. The odd bytes at the end go first so the
+ *				  dwords line up with the start. The direction flag is
+ *				  cleared again before returning, the compiler assumes it.
+ *   INPUTS: dest, src, n: as for memmove
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void copy_backward(void* dest, const void* src, uint32_t n) {
+	asm volatile("                          \n\
+			movw    %%ds, %%dx              \n\
+			movw    %%dx, %%es              \n\
+			leal    -1(%%esi, %%ecx), %%esi \n\
+			leal    -1(%%edi, %%ecx), %%edi \n\
+			movl    %%ecx, %%edx            \n\
+			andl    $0x3, %%ecx             \n\
+			std                             \n\
+			rep     movsb                   \n\
+			subl    $3, %%esi               \n\
+			subl    $3, %%edi               \n\
+			movl    %%edx, %%ecx            \n\
+			shrl    $2, %%ecx               \n\
+			rep     movsl                   \n\
+			cld                             \n\
+			"
+			: "+S"(src), "+D"(dest), "+c"(n)
+			:
+			: "edx", "memory", "cc"
+			);
+}
+
+/*
+ * set_dwords
+ *   DESCRIPTION: set bytes until s is 4 byte aligned, then dwords with rep
+ *				  stosl, then the last bytes
+ *   INPUTS: s, n: as for memset
+ *           pattern: the byte to set, repeated in all four bytes
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void set_dwords(void* s, uint32_t pattern, uint32_t n) {
+	asm volatile("                  \n\
+			movw    %%ds, %%dx      \n\
+			movw    %%dx, %%es      \n\
+			cld                     \n\
+			movl    %%edi, %%edx    \n\
+			negl    %%edx           \n\
+			andl    $0x3, %%edx     \n\
+			cmpl    %%ecx, %%edx    \n\
+			jbe     1f              \n\
+			movl    %%ecx, %%edx    \n\
+			1:                      \n\
+			subl    %%edx, %%ecx    \n\
+			xchgl   %%edx, %%ecx    \n\
+			rep     stosb           \n\
+			movl    %%edx, %%ecx    \n\
+			shrl    $2, %%ecx       \n\
+			andl    $0x3, %%edx     \n\
+			rep     stosl           \n\
+			movl    %%edx, %%ecx    \n\
+			rep     stosb           \n\
+			"
+			: "+D"(s), "+c"(n)
+			: "a"(pattern)
+			: "edx", "memory", "cc"
+			);
+}
+
+/*
+ * set_erms
+ *   DESCRIPTION: set with one rep stosb
+ *   INPUTS: s, pattern, n: as for set_dwords
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void set_erms(void* s, uint32_t pattern, uint32_t n) {
+	asm volatile("                  \n\
+			movw    %%ds, %%dx      \n\
+			movw    %%dx, %%es      \n\
+			cld                     \n\
+			rep     stosb           \n\
+			"
+			: "+D"(s), "+c"(n)
+			: "a"(pattern)
+			: "edx", "memory", "cc"
+			);
+}
+
+/*
+ * set_nt
+ *   DESCRIPTION: set with movnti a cache line per loop, around the cache
+ *   INPUTS: s, pattern, n: as for set_dwords, n at least MEM_NT_BLOCK
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: the stores are fenced before returning
+ */
+static void set_nt(void* s, uint32_t pattern, uint32_t n) {
+	uint32_t head = -(uint32_t)s & (MEM_NT_BLOCK - 1);
+	uint32_t blocks;
+
+	set_dwords(s, pattern, head);
+	s = (uint8_t*)s + head;
+	n -= head;
+
+	blocks = n / MEM_NT_BLOCK;
+	asm volatile("                          \n\
+			1:                              \n\
+			movnti  %%eax, 0(%%edi)         \n\
+			movnti  %%eax, 4(%%edi)         \n\
+			movnti  %%eax, 8(%%edi)         \n\
+			movnti  %%eax, 12(%%edi)        \n\
+			movnti  %%eax, 16(%%edi)        \n\
+			movnti  %%eax, 20(%%edi)        \n\
+			movnti  %%eax, 24(%%edi)        \n\
+			movnti  %%eax, 28(%%edi)        \n\
+			movnti  %%eax, 32(%%edi)        \n\
+			movnti  %%eax, 36(%%edi)        \n\
+			movnti  %%eax, 40(%%edi)        \n\
+			movnti  %%eax, 44(%%edi)        \n\
+			movnti  %%eax, 48(%%edi)        \n\
+			movnti  %%eax, 52(%%edi)        \n\
+			movnti  %%eax, 56(%%edi)        \n\
+			movnti  %%eax, 60(%%edi)        \n\
+			addl    $64, %%edi              \n\
+			decl    %%ecx                   \n\
+			jnz     1b                      \n\
+			sfence                          \n\
+			"
+			: "+D"(s), "+c"(blocks)
+			: "a"(pattern)
+			: "memory", "cc"
+			);
+
+	set_dwords(s, pattern, n & (MEM_NT_BLOCK - 1));
+}
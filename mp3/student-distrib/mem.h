@@ -0,0 +1,24 @@
+#ifndef _MEM_H
+#define _MEM_H
+
+#include "types.h"
+
+/* copies and fills at least this long use rep movsb/stosb on processors
+with enhanced rep movsb (ERMS), shorter ones do not make up for its start
+up cost */
+#define MEM_ERMS_MIN 64
+/* copies and fills at least this long bypass the cache with movnti, they
+would only evict everything else from it */
+#define MEM_NT_MIN (256 * 1024)
+/* movnti stores this much per loop, one cache line */
+#define MEM_NT_BLOCK 64
+
+/* what init_mem found, the host benchmark changes them to compare */
+extern int32_t mem_erms;
+extern int32_t mem_sse2;
+
+//see c file for more, memcpy, memset and memmove are declared in lib.h
+extern void init_mem();
+extern void* memzero_nt(void* s, uint32_t n);
+
+#endif /* _MEM_H */
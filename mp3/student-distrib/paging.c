@@ -1,5 +1,7 @@
 #include "paging.h"
 #include "lib.h"
+#include "apic.h"
+#include "smp.h"
 
 #define TEN_HIGH_BIT_MASK		0xFFC00000		/* mask to get 10 high bits of linear address */
 #define TEN_MID_BIT_MASK		0x003FF000		/* mask to get 10 mid bits of linear address */
@@ -61,6 +63,7 @@ uint32_t page_table[NUM_PAGE_TABLE][NUM_PTE]
  8				    paging enabled and TLB flushed, CR3 changed
  */
 void init_paging() {
+	uint32_t i;
 
 	/* clear all page tables for all processes to ensure we don't crash and 
 	for security reasons by avoiding uninitalized values. */
@@ -71,7 +74,13 @@ void init_paging() {
  	to 1 4kb page and kernel to 1 4mb page, with kernel space 
  	permissions to allow kernel direct access */
 	map_mega_page(KERNEL_START, KERNEL_START, TASK_KERNEL, DPL_KERNEL);
-	map_kilo_page(VIDEO_MEM_START, VIDEO_MEM_START, TASK_KERNEL, DPL_KERNEL);
+	map_video_window(TASK_KERNEL);
+	map_apic_window(TASK_KERNEL);
+
+	/* the frame pool is zeroed from whatever address space is loaded when a
+	processor waits, so every directory has it from the start */
+	for (i = 0; i < NUM_PAGE_DIR; i++)
+		map_frame_window(i);
 
 	/* enable paging */
 	asm volatile (
@@ -122,6 +131,8 @@ void map_mega_page (uint32_t virtual_addr, uint32_t physical_addr, uint32_t
 	PDE |= (physical_addr & TEN_HIGH_BIT_MASK);
 	/* task 0 is kernel */
 	page_directory[task_id][virtual_addr>>VADDR_PDE_NUM] = PDE;
+	/* other processors may have the directory loaded */
+	smp_flush_tlb(task_id);
 }
 
 /*
@@ -169,6 +180,129 @@ void map_kilo_page (uint32_t virtual_addr, uint32_t physical_addr, uint32_t
 	PTE |= (physical_addr & TWENTY_HIGH_BIT_MASK);
 
 	page_table[task_id][(virtual_addr & TEN_MID_BIT_MASK) >> VADDR_PTE_NUM] = PTE;
+	smp_flush_tlb(task_id);
+}
+
+/*
+ * map_kilo_page_read_only
+ *   DESCRIPTION: map a 4KB page that user code may read but not write, e.g.
+ *				  data the kernel publishes to every process. Unlike
+ *				  map_kilo_page the page is cached, it is ordinary memory.
+ *   INPUTS: virtual_addr: virtual address of the page
+ *           physical_addr: physical address of the page
+ *           task_id: index of the page directory to change
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: changes page directory and page table of task_id. The
+ *				   kernel can still write the page since CR0.WP is clear.
+ */
+void map_kilo_page_read_only (uint32_t virtual_addr, uint32_t physical_addr, 
+	uint32_t task_id) {
+
+	/* the PDE is shared with the other 4KB pages of the region, so it has to
+	stay writable - the PTE alone makes this page read only */
+	uint32_t PDE = PAGE_DIR_LOW_DEFAULT;
+	PDE |= PRESENT_FLAG;
+	PDE &= SIZE_FLAG;
+	PDE |= USR_SPVR_FLAG;
+	PDE |= (uint32_t)page_table[task_id];
+	page_directory[task_id][(virtual_addr) >> VADDR_PDE_NUM] = PDE;
+
+	uint32_t PTE = PAGE_TABLE_LOW_DEFAULT;
+	PTE |= PRESENT_FLAG;
+	PTE |= USR_SPVR_FLAG;
+	PTE &= READ_WRITE_FLAG;
+	PTE &= CACHE_FLAG;
+	PTE &= WRITE_FLAG;
+	PTE |= (physical_addr & TWENTY_HIGH_BIT_MASK);
+
+	page_table[task_id][(virtual_addr & TEN_MID_BIT_MASK) >> VADDR_PTE_NUM] = PTE;
+	smp_flush_tlb(task_id);
+}
+
+/*
+ * map_video_window
+ *   DESCRIPTION: map the whole 32KB text mode window to itself for kernel
+ *				  access. The console scrolls through all of it by moving
+ *				  the CRTC start address, see lib.c.
+ *   INPUTS: task_id: index of the page directory to change
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: changes page directory and page table of task_id
+ */
+void map_video_window (uint32_t task_id) {
+	uint32_t i;
+	for (i = 0; i < VIDEO_WINDOW_PAGES; i++)
+		map_kilo_page(VIDEO_MEM_START + i * PAGE_SIZE,
+			VIDEO_MEM_START + i * PAGE_SIZE, task_id, DPL_KERNEL);
+}
+
+/*
+ * map_apic_window
+ *   DESCRIPTION: map the 4MB page holding the IOAPIC and local APIC
+ *				  registers to itself for kernel access. Large pages are
+ *				  mapped uncached, which memory mapped registers need.
+ *				  Harmless on machines without APICs, nothing touches it.
+ *   INPUTS: task_id: index of the page directory to change
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: changes page directory of task_id
+ */
+void map_apic_window (uint32_t task_id) {
+	map_mega_page(APIC_WINDOW_START, APIC_WINDOW_START, task_id, DPL_KERNEL);
+}
+
+/*
+ * map_frame_window
+ *   DESCRIPTION: map the 4MB the page frame pool lives in to itself for
+ *				  kernel access, so frames can be zeroed from any address
+ *				  space. Cached, like the user mappings of its frames.
+ *   INPUTS: task_id: index of the page directory to change
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: changes page directory of task_id
+ */
+void map_frame_window (uint32_t task_id) {
+	uint32_t PDE = PAGE_DIR_LOW_DEFAULT;
+	PDE |= PRESENT_FLAG;
+	PDE &= CACHE_FLAG;
+	PDE &= WRITE_FLAG;
+	PDE |= (FRAME_POOL_START & TEN_HIGH_BIT_MASK);
+	page_directory[task_id][FRAME_POOL_START >> VADDR_PDE_NUM] = PDE;
+	smp_flush_tlb(task_id);
+}
+
+/*
+ * map_frame
+ *   DESCRIPTION: map a frame of the pool for user code to read and write.
+ *				  Unlike map_kilo_page the page is cached, it is ordinary
+ *				  memory and the kernel reaches it cached too.
+ *   INPUTS: virtual_addr: virtual address of the page
+ *           physical_addr: physical address of the frame, from frame_alloc
+ *           task_id: index of the page directory to change
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: changes page directory and page table of task_id
+ */
+void map_frame (uint32_t virtual_addr, uint32_t physical_addr, 
+	uint32_t task_id) {
+
+	uint32_t PDE = PAGE_DIR_LOW_DEFAULT;
+	PDE |= PRESENT_FLAG;
+	PDE &= SIZE_FLAG;
+	PDE |= USR_SPVR_FLAG;
+	PDE |= (uint32_t)page_table[task_id];
+	page_directory[task_id][(virtual_addr) >> VADDR_PDE_NUM] = PDE;
+
+	uint32_t PTE = PAGE_TABLE_LOW_DEFAULT;
+	PTE |= PRESENT_FLAG;
+	PTE |= USR_SPVR_FLAG;
+	PTE &= CACHE_FLAG;
+	PTE &= WRITE_FLAG;
+	PTE |= (physical_addr & TWENTY_HIGH_BIT_MASK);
+
+	page_table[task_id][(virtual_addr & TEN_MID_BIT_MASK) >> VADDR_PTE_NUM] = PTE;
+	smp_flush_tlb(task_id);
 }
 
 /*
@@ -189,6 +323,8 @@ void update_page_directory(uint32_t task_id) {
 		:"r"(new_page_directory)
 		:"cc"
 	);
+	/* so TLB shootdowns know who uses which directory */
+	this_cpu()->page_dir = task_id;
 	return;
 }
 
@@ -18,8 +18,13 @@
 #define KERNEL_END			(8 * MEGA)
 #define VIDEO_MEM_START		VIDEO 		/* 0xA0000 base addr of vid mem VGA */
 #define VIDEO_MEM_END		(VIDEO_MEM_START + 1 * PAGE_SIZE)	
+#define VIDEO_WINDOW_PAGES	(VIDEO_WINDOW_SIZE / PAGE_SIZE)	/* whole text window */
 /* end at 0xAFFFF 64k planes * 4 planes / 4 planes = > 64k addrs = > 64k / 4k => 16 pages */
 
+/* 4KB frames handed to processes come from this 4MB, see frame.c */
+#define FRAME_POOL_START	(32 * MEGA)
+#define FRAME_POOL_SIZE		(4 * MEGA)
+
 #define NUM_TASK			6
 #define NUM_PAGE_DIR		(NUM_TASK + 1)
 #define NUM_PAGE_TABLE		(NUM_TASK + 1)
@@ -37,6 +42,11 @@ extern void init_paging (void);
 /* be careful that user program task_id should start from 1, task_id 0 reserved to kernel */
 extern void map_mega_page (uint32_t virtual_addr, uint32_t physical_addr, uint32_t task_id, uint32_t dpl);
 extern void map_kilo_page (uint32_t virtual_addr, uint32_t physical_addr, uint32_t task_id, uint32_t dpl);
+extern void map_kilo_page_read_only (uint32_t virtual_addr, uint32_t physical_addr, uint32_t task_id);
+extern void map_video_window (uint32_t task_id);
+extern void map_apic_window (uint32_t task_id);
+extern void map_frame_window (uint32_t task_id);
+extern void map_frame (uint32_t virtual_addr, uint32_t physical_addr, uint32_t task_id);
 extern void update_page_directory(uint32_t task_id);
 
 #endif /* _PAGING_H */
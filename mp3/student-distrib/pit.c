@@ -5,6 +5,13 @@
 #include "paging.h"
 #include "x86_desc.h"
 #include "terminal.h"
+#include "timer.h"
+#include "timepage.h"
+#include "trace.h"
+#include "procstat.h"
+#include "klog.h"
+#include "softirq.h"
+#include "fpu.h"
 
 /* PIT port/register constants */
 #define PIT_CHAN_0_PORT	0x40
@@ -20,6 +27,15 @@
 // 20000 * (1/1.1931816666MHz) = 16.76ms
 const uint16_t TICKS_16_MS = 50000;
 
+/* latch command for channel 0, the count is then read low byte first */
+#define CMD_CHAN_0_LATCH 0x00
+
+/* number of PIT periods the TSC is timed over at boot, ~84ms */
+#define TSC_CALIBRATE_PERIODS 2
+
+static uint16_t pit_read_count();
+static void pit_console_softirq();
+
 /*
  * init_pit
  *   DESCRIPTION: init programmable interval timer
@@ -34,6 +50,10 @@ void init_pit () {
 	/* mask interrupts so no handler gets called while
 	settings are changed */
 
+	/* the timer wheel advances once per PIT interrupt */
+	init_timer(pit_tick_ns() / NS_PER_US);
+	open_softirq(SOFTIRQ_CONSOLE, pit_console_softirq);
+
 	/* initalize to 8ms periodic interrupts*/
 	pit_change_freq(TICKS_16_MS);
 
@@ -47,28 +67,66 @@ void init_pit () {
  *   INPUTS: none
  *   OUTPUTS: none
  *   RETURN VALUE: none
- *   SIDE EFFECTS: may change the currently running task.
+ *   SIDE EFFECTS: may change the currently running task, unless the tick
+ *				   interrupted do_softirq on this processor
  */
 void pit_handler_32() {
 	// avoid nesting pit handlers
 	disable_irq(IRQ_0);
 	send_eoi(IRQ_0);
+	trace_event(TRACE_IRQ, IRQ_0, timer_ticks);
+
+	/* looked up once, active_task_idx would do it on every use */
+	cpu_t* cpu = this_cpu();
+
+	/* charge this tick to whoever it interrupted - we are called straight
+	from the interrupt wrapper, so its saved registers sit above our frame */
+	uint32_t ebp;
+	int32_t prev_task_idx;
+	asm volatile(
+		"movl %%ebp, %0;"
+		: "=r"(ebp)
+		:
+		: "cc");
+	procstat_tick(ebp + 2*4);
+
+	/* expired sleep and interval timers and the console refresh run from
+	softirqs once the interrupt is unmasked, the tick count and the time page
+	are published here so they stay exact. Every processor has its own timer
+	for scheduling, only the boot processor's keeps time. */
+	if (cpu->id == BOOT_CPU) {
+		timer_tick();
+		time_page_tick(timer_ticks);
+		raise_softirq(SOFTIRQ_CONSOLE);
+	}
+
+	/* softirq handlers run with interrupts on, so this tick may have cut
+	into one. Every other task's softirqs wait for that drainer to finish,
+	so it keeps the processor and the switch waits for the next tick. */
+	if (cpu->in_softirq) {
+		enable_irq(IRQ_0);
+		return;
+	}
 
 	//save current stack ptr to pcb
 	asm volatile(
 		"movl %%ebp, %0;"
 		"movl %%esp, %1;"
-		: "=r"(current_pcb[active_task_idx]->ebp), "=r"(current_pcb[active_task_idx]->esp)
+		: "=r"(current_pcb[cpu->task_idx]->ebp), "=r"(current_pcb[cpu->task_idx]->esp)
 		: /* no inputs */
 		: "cc");
 
 	//regs already saved by handler, do not save registers here
 	//save page tables of current process to pcb
 	update_page_directory((get_cur_pid() + 1));
+	current_pcb[cpu->task_idx]->switches++;
 
-	//always run the task of the next terminal
-	active_task_idx = (active_task_idx + 1) % NUM_TERMINAL;
+	//always run the task of the next terminal this processor owns
+	prev_task_idx = cpu->task_idx;
+	cpu->task_idx = smp_next_task(prev_task_idx);
 	//ASSUMES at least ONE task is active!!!
+	trace_event(TRACE_SWITCH, current_pcb[prev_task_idx]->pid,
+		current_pcb[cpu->task_idx]->pid);
 
 	//registers restored by handler, do not resotre registers here
 
@@ -79,15 +137,18 @@ void pit_handler_32() {
 	//no need to check if active_terminal_idx == active_task_idx
 
 	//reload tss with the correct k stack values
-	tss.ss0 = KERNEL_DS;
-	tss.esp0 = KERNEL_END - (get_cur_pid() * 8 * KILO) - KMODE_STACK_OFFSET;
+	cpu->tss->ss0 = KERNEL_DS;
+	cpu->tss->esp0 = KERNEL_END - (get_cur_pid() * 8 * KILO) -
+		KMODE_STACK_OFFSET;
+	//the FPU registers follow lazily
+	fpu_switch(current_pcb[cpu->task_idx]);
 
 	//restore the new process's kernel stack context, iret will restore registers
 	asm volatile(
 		"movl %0, %%esp;"
 		"movl %1, %%ebp;"
 		: /* no outputs */
-		: "r"(current_pcb[active_task_idx]->esp), "r"(current_pcb[active_task_idx]->ebp)
+		: "r"(current_pcb[cpu->task_idx]->esp), "r"(current_pcb[cpu->task_idx]->ebp)
 		: "cc");
 
 	enable_irq(IRQ_0);
@@ -102,6 +163,21 @@ void pit_handler_32() {
 }
 
 
+/*
+ * pit_console_softirq
+ *   DESCRIPTION: SOFTIRQ_CONSOLE handler, raised every tick - put some of
+ *				  the queued printf text on the screen and copy the rows
+ *				  written since the last tick to video memory
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: see klog_drain and console_flush
+ */
+static void pit_console_softirq() {
+	klog_drain(KLOG_DRAIN_BUDGET);
+	console_flush();
+}
+
 /*
  * pit_change_freq
  *   DESCRIPTION: change the frequency of the pit
@@ -120,3 +196,72 @@ void pit_change_freq(uint16_t freq) {
 
 	enable_irq (IRQ_0);
 }
+
+/*
+ * pit_tick_ns
+ *   DESCRIPTION: length of one PIT interrupt period
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: period in nanoseconds
+ *   SIDE EFFECTS: none
+ */
+uint32_t pit_tick_ns() {
+	return div64_32((uint64_t)TICKS_16_MS * NS_PER_SEC, PIT_BASE_FREQ_HZ);
+}
+
+/*
+ * pit_read_count
+ *   DESCRIPTION: latch and read the current count of channel 0
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: the count, runs from TICKS_16_MS down to 1 in mode 2
+ *   SIDE EFFECTS: none
+ */
+static uint16_t pit_read_count() {
+	uint16_t count;
+	outb(CMD_CHAN_0_LATCH, PIT_CMD_PORT);
+	count = inb(PIT_CHAN_0_PORT);
+	count |= inb(PIT_CHAN_0_PORT) << HIGH_BYTE;
+	return count;
+}
+
+/*
+ * pit_wait_reload
+ *   DESCRIPTION: spin until channel 0 reloads its count, i.e. the start of a
+ *				  new period
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void pit_wait_reload() {
+	uint16_t prev = pit_read_count();
+	uint16_t count;
+	while ((count = pit_read_count()) <= prev)
+		prev = count;
+}
+
+/*
+ * pit_calibrate_tsc_khz
+ *   DESCRIPTION: time the TSC against whole periods of channel 0. Must be
+ *				  called after init_pit with interrupts off, before scheduling
+ *				  starts.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: TSC frequency in kHz
+ *   SIDE EFFECTS: busy waits for TSC_CALIBRATE_PERIODS + 1 PIT periods
+ */
+uint32_t pit_calibrate_tsc_khz() {
+	uint64_t start, end;
+
+	pit_wait_reload();
+	start = rdtsc();
+	int32_t i;
+	for (i = 0; i < TSC_CALIBRATE_PERIODS; i++)
+		pit_wait_reload();
+	end = rdtsc();
+
+	/* cycles / (periods * TICKS_16_MS / PIT_BASE_FREQ_HZ) / 1000 */
+	return div64_32((end - start) * (PIT_BASE_FREQ_HZ / TSC_CALIBRATE_PERIODS),
+		(uint32_t)TICKS_16_MS * MS_PER_SEC);
+}
@@ -5,10 +5,16 @@
 #include "x86_desc.h"
 #include "terminal.h"
 
+/* PIT input clock */
+#define PIT_BASE_FREQ_HZ 1193182
+
 //see c file for more
 extern void init_pit ();
 extern void pit_handler_32();
 extern void pit_change_freq(uint16_t freq);
+extern uint32_t pit_tick_ns();
+extern uint32_t pit_calibrate_tsc_khz();
+extern void pit_wait_reload();
 
 
 #endif /* _PIT_H */
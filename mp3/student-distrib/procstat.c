@@ -0,0 +1,177 @@
+#include "procstat.h"
+#include "lib.h"
+#include "x86_desc.h"
+#include "pit.h"
+#include "timer.h"
+#include "report.h"
+
+/* the pushed cs slot is 32 bits wide, only the selector is meaningful */
+#define SELECTOR_MASK 0xFFFF
+
+/* function prototypes for internal functions */
+static void report_field(report_t* report, uint32_t value);
+static void render_report(report_t* report);
+
+
+/*
+ * procstat_reset
+ *   DESCRIPTION: start the accounting of a freshly executed program
+ *   INPUTS: pcb: PCB of the new process
+ *           name: program name, truncated to PROC_NAME_LEN - 1 characters
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: all cpu counters of the PCB zeroed
+ */
+void procstat_reset(pcb_t* pcb, const uint8_t* name) {
+	strncpy((int8_t*)pcb->name, (const int8_t*)name, PROC_NAME_LEN - 1);
+	pcb->name[PROC_NAME_LEN - 1] = '\0';
+	pcb->start_tick = timer_ticks;
+	pcb->user_ticks = 0;
+	pcb->kernel_ticks = 0;
+	pcb->idle_ticks = 0;
+	pcb->switches = 0;
+	pcb->page_faults = 0;
+	pcb->blocked = false;
+}
+
+/*
+ * procstat_tick
+ *   DESCRIPTION: charge the current timer tick to the running process.
+ *				  Called from pit_handler_32 before it switches tasks.
+ *   INPUTS: context_top: address of the registers saved by the interrupt
+ *			 wrapper, see CONTEXT_SIZE in task.h
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: one of the tick counters of the PCB incremented
+ */
+void procstat_tick(uint32_t context_top) {
+	pcb_t* pcb = current_pcb[active_task_idx];
+	if (pcb == NULL)
+		return;
+
+	/* blocking calls spin with interrupts on, that is waiting, not work */
+	if (pcb->blocked)
+		pcb->idle_ticks++;
+	else if ((*(uint32_t*)(context_top + CS_OFFSET) & SELECTOR_MASK) == USER_CS)
+		pcb->user_ticks++;
+	else
+		pcb->kernel_ticks++;
+}
+
+/*
+ * procstat_open
+ *   DESCRIPTION: open the process statistics pseudo file
+ *   INPUTS: fname: unused
+ *   OUTPUTS: none
+ *   RETURN VALUE: always succeeds and returns 0
+ *   SIDE EFFECTS: none
+ */
+int32_t procstat_open(const uint8_t* fname) {
+	return SUCCESS;
+}
+
+/*
+ * procstat_close
+ *   DESCRIPTION: close the process statistics pseudo file
+ *   INPUTS: fd: file descriptor being closed
+ *   OUTPUTS: none
+ *   RETURN VALUE: always succeeds and returns 0
+ *   SIDE EFFECTS: its report given back
+ */
+int32_t procstat_close(int32_t fd) {
+	report_close(fd);
+	return SUCCESS;
+}
+
+/*
+ * procstat_read
+ *   DESCRIPTION: read the statistics as text - a line with the current
+ *				  timer tick and the tick length, a header, then one line
+ *				  per live process:
+ *				  pid ppid term user kernel idle switches syscalls faults
+ *				  start name
+ *				  The counters are in ticks since the process started at
+ *				  tick start, ppid is - for the base shells.
+ *   INPUTS: fd: file descriptor, its pos is the offset into the report
+ *           nbytes: length in bytes to be read
+ *   OUTPUTS: buf: destination of the data
+ *   RETURN VALUE: number of bytes read, 0 at the end of the report
+ *   SIDE EFFECTS: see report_read
+ */
+int32_t procstat_read(int32_t fd, void* buf, int32_t nbytes) {
+	return report_read(fd, buf, nbytes, render_report);
+}
+
+/*
+ * procstat_write
+ *   DESCRIPTION: the statistics are read-only
+ *   INPUTS: ignored
+ *   OUTPUTS: none
+ *   RETURN VALUE: always -1
+ *   SIDE EFFECTS: none
+ */
+int32_t procstat_write(int32_t fd, const void* buf, int32_t nbytes) {
+	return ERR;
+}
+
+/*
+ * report_field
+ *   DESCRIPTION: append a decimal number and a separating space
+ *   INPUTS: report: the report being rendered
+ *           value: number to append
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: the report's text and len updated
+ */
+static void report_field(report_t* report, uint32_t value) {
+	report_num(report, value);
+	report_str(report, " ");
+}
+
+/*
+ * render_report
+ *   DESCRIPTION: format a snapshot of the statistics into the report buffer
+ *   INPUTS: report: the report to append to, empty
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: the report's text and len updated
+ */
+static void render_report(report_t* report) {
+	static pcb_t snapshot[MAX_PCB];
+	int32_t flags, i;
+	uint32_t now;
+
+	/* copy first so every line is from the same tick */
+	cli_and_save(flags);
+	now = timer_ticks;
+	for (i = 0; i < MAX_PCB; i++)
+		memcpy(&snapshot[i], pcb_array[i], sizeof(pcb_t));
+	restore_flags(flags);
+
+	report_str(report, "ticks ");
+	report_field(report, now);
+	report_str(report, "tick_us ");
+	report_field(report, pit_tick_ns() / NS_PER_US);
+	report_str(report, "\npid ppid term user kernel idle switches syscalls faults start name\n");
+	for (i = 0; i < MAX_PCB; i++) {
+		pcb_t* pcb = &snapshot[i];
+		if (pcb->flag == TASK_NOT_PRESENT)
+			continue;
+
+		report_field(report, pcb->pid);
+		if (pcb->parent_pid == (uint32_t)INVALID_PID)
+			report_str(report, "- ");
+		else
+			report_field(report, pcb->parent_pid);
+		report_field(report, pcb->terminal_idx);
+		report_field(report, pcb->user_ticks);
+		report_field(report, pcb->kernel_ticks);
+		report_field(report, pcb->idle_ticks);
+		report_field(report, pcb->switches);
+		report_field(report, pcb->syscall_calls);
+		report_field(report, pcb->page_faults);
+		report_field(report, pcb->start_tick);
+		report_str(report, (int8_t*)pcb->name);
+		report_str(report, "\n");
+	}
+}
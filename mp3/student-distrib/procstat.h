@@ -0,0 +1,15 @@
+#ifndef _PROCSTAT_H
+#define _PROCSTAT_H
+
+#include "types.h"
+#include "task.h"
+
+//see c file for more
+extern void procstat_reset(pcb_t* pcb, const uint8_t* name);
+extern void procstat_tick(uint32_t context_top);
+extern int32_t procstat_open(const uint8_t* fname);
+extern int32_t procstat_read(int32_t fd, void* buf, int32_t nbytes);
+extern int32_t procstat_write(int32_t fd, const void* buf, int32_t nbytes);
+extern int32_t procstat_close(int32_t fd);
+
+#endif /* _PROCSTAT_H */
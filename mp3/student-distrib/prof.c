@@ -0,0 +1,140 @@
+#include "prof.h"
+#include "lib.h"
+#include "task.h"
+
+/* commands written to the profile pseudo file */
+#define PROF_CMD_START '1'
+#define PROF_CMD_STOP '0'
+
+/* single producer (the rtc interrupt), single consumer (prof_read) ring.
+head and tail run freely and are masked on use, so head - tail is the fill
+level even across wraparound. Only the producer writes head and only the
+consumer writes tail, so neither side needs to lock out the other. */
+static prof_sample_t prof_ring[PROF_RING_SIZE];
+static volatile uint32_t prof_head = 0;
+static volatile uint32_t prof_tail = 0;
+static volatile int32_t prof_enabled = false;
+
+/* compiler barrier - orders the ring slot access against the index update */
+#define barrier() asm volatile("" : : : "memory")
+
+
+/*
+ * prof_sample
+ *   DESCRIPTION: record where the processor was when a timer interrupt hit.
+ *				  Called from rtc_handler_40, i.e. at 1024Hz.
+ *   INPUTS: context_top: address of the registers saved by the interrupt
+ *			 wrapper, see CONTEXT_SIZE in task.h
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: one sample added to the ring, dropped if the ring is
+ *				   full
+ */
+void prof_sample(uint32_t context_top) {
+	if (!prof_enabled)
+		return;
+
+	uint32_t head = prof_head;
+	if (head - prof_tail >= PROF_RING_SIZE)
+		return;
+
+	prof_sample_t* sample = &prof_ring[head & PROF_RING_MASK];
+	sample->eip = *(uint32_t*)(context_top + RETURN_ADDRESS_OFFSET);
+	sample->cs = *(uint32_t*)(context_top + CS_OFFSET);
+	if (active_task_idx == ERR || current_pcb[active_task_idx] == NULL)
+		sample->pid = PROF_NO_PID;
+	else
+		sample->pid = current_pcb[active_task_idx]->pid;
+
+	/* the sample must be complete before the reader can see it */
+	barrier();
+	prof_head = head + 1;
+}
+
+/*
+ * prof_open
+ *   DESCRIPTION: open the profile pseudo file
+ *   INPUTS: fname: unused
+ *   OUTPUTS: none
+ *   RETURN VALUE: always succeeds and returns 0
+ *   SIDE EFFECTS: none
+ */
+int32_t prof_open(const uint8_t* fname) {
+	return SUCCESS;
+}
+
+/*
+ * prof_close
+ *   DESCRIPTION: close the profile pseudo file
+ *   INPUTS: fd: unused
+ *   OUTPUTS: none
+ *   RETURN VALUE: always succeeds and returns 0
+ *   SIDE EFFECTS: none
+ */
+int32_t prof_close(int32_t fd) {
+	return SUCCESS;
+}
+
+/*
+ * prof_read
+ *   DESCRIPTION: drain samples from the ring, whole samples only. Does not
+ *				  block.
+ *   INPUTS: fd: unused
+ *           nbytes: size of buf
+ *   OUTPUTS: buf: array of prof_sample_t
+ *   RETURN VALUE: number of bytes read, 0 once the ring is empty
+ *   SIDE EFFECTS: samples read are removed from the ring
+ */
+int32_t prof_read(int32_t fd, void* buf, int32_t nbytes) {
+	if (buf == NULL || nbytes < 0)
+		return ERR;
+
+	uint32_t tail = prof_tail;
+	uint32_t count = prof_head - tail;
+	if (count > nbytes / sizeof(prof_sample_t))
+		count = nbytes / sizeof(prof_sample_t);
+
+	/* copy up to the end of the ring, then from its start */
+	uint32_t first = PROF_RING_SIZE - (tail & PROF_RING_MASK);
+	if (first > count)
+		first = count;
+	memcpy(buf, &prof_ring[tail & PROF_RING_MASK], first * sizeof(prof_sample_t));
+	memcpy((prof_sample_t*)buf + first, prof_ring, (count - first) * sizeof(prof_sample_t));
+
+	/* the copies must be done before the producer may reuse the slots */
+	barrier();
+	prof_tail = tail + count;
+	return count * sizeof(prof_sample_t);
+}
+
+/*
+ * prof_write
+ *   DESCRIPTION: control the profiler - '1' discards old samples and starts
+ *				  sampling, '0' stops it
+ *   INPUTS: fd: unused
+ *           buf: the command, only the first byte counts
+ *           nbytes: length of buf
+ *   OUTPUTS: none
+ *   RETURN VALUE: nbytes for success, -1 for an unknown command
+ *   SIDE EFFECTS: starts or stops sampling
+ */
+int32_t prof_write(int32_t fd, const void* buf, int32_t nbytes) {
+	if (buf == NULL || nbytes < 1)
+		return ERR;
+
+	switch (*(const uint8_t*)buf) {
+		case PROF_CMD_START:
+			prof_enabled = false;
+			barrier();
+			/* the consumer owns tail, so it may empty the ring */
+			prof_tail = prof_head;
+			barrier();
+			prof_enabled = true;
+			return nbytes;
+		case PROF_CMD_STOP:
+			prof_enabled = false;
+			return nbytes;
+		default:
+			return ERR;
+	}
+}
@@ -0,0 +1,28 @@
+#ifndef _PROF_H
+#define _PROF_H
+
+#include "types.h"
+
+/* number of samples the ring holds, must be a power of 2 */
+#define PROF_RING_SIZE 4096
+#define PROF_RING_MASK (PROF_RING_SIZE - 1)
+
+/* pid recorded when no process is running yet */
+#define PROF_NO_PID 0xFFFF
+
+/* one sample as read from the profile pseudo file - ece391prof.c in the
+syscalls library must agree */
+typedef struct prof_sample {
+	uint32_t eip;
+	uint16_t cs;
+	uint16_t pid;
+} prof_sample_t;
+
+//see c file for more
+extern void prof_sample(uint32_t context_top);
+extern int32_t prof_open(const uint8_t* fname);
+extern int32_t prof_read(int32_t fd, void* buf, int32_t nbytes);
+extern int32_t prof_write(int32_t fd, const void* buf, int32_t nbytes);
+extern int32_t prof_close(int32_t fd);
+
+#endif /* _PROF_H */
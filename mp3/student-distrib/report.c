@@ -0,0 +1,143 @@
+#include "report.h"
+#include "lib.h"
+#include "task.h"
+#include "spinlock.h"
+
+/* reports open at once over all processes, a reader past this fails */
+#define NUM_REPORTS MAX_PCB
+#define NUM_BUF_LEN 12
+
+/* text of the statistics pseudo files, one per open file so readers do
+not overwrite each other's. An open file takes one on its first read and
+gives it back on close. */
+static report_t reports[NUM_REPORTS];
+/* the render functions copy the statistics into static snapshots, so one
+renders at a time */
+static int32_t report_rendering = false;
+/* guards the in_use flags and report_rendering */
+static spinlock_t report_lock = SPINLOCK_INIT("report");
+
+/* function prototypes for internal functions */
+static report_t* report_alloc();
+
+
+/*
+ * report_read
+ *   DESCRIPTION: read for a statistics pseudo file. The text is rendered
+ *				  into the open file's own report when reading from offset
+ *				  0, later reads continue in that same text.
+ *   INPUTS: fd: file descriptor, its pos is the offset into the report
+ *           nbytes: length in bytes to be read
+ *           render: formats the statistics of the pseudo file
+ *   OUTPUTS: buf: destination of the data
+ *   RETURN VALUE: number of bytes read, 0 at the end of the report, -1 for
+ *				   fail or when every report is in use
+ *   SIDE EFFECTS: a report is taken on the first read, see report_close
+ */
+int32_t report_read(int32_t fd, void* buf, int32_t nbytes,
+	report_render_t render) {
+	file_desc_t* file = &current_pcb[active_task_idx]->file_descriptors[fd];
+	report_t* report;
+	int32_t flags;
+
+	if (nbytes < 0)
+		return ERR;
+
+	if (file->report == NULL && (file->report = report_alloc()) == NULL)
+		return ERR;
+	report = file->report;
+
+	if (file->pos == 0) {
+		/* the renderer we wait for may be a task this processor runs */
+		spin_lock_irqsave(&report_lock, flags);
+		while (report_rendering) {
+			spin_unlock_irqrestore(&report_lock, flags);
+			kernel_lock_relax();
+			spin_lock_irqsave(&report_lock, flags);
+		}
+		report_rendering = true;
+		spin_unlock_irqrestore(&report_lock, flags);
+
+		report->len = 0;
+		render(report);
+		report_rendering = false;
+	}
+
+	if (file->pos >= report->len)
+		return 0;
+	if ((uint32_t)nbytes > report->len - file->pos)
+		nbytes = report->len - file->pos;
+
+	memcpy(buf, report->text + file->pos, nbytes);
+	file->pos += nbytes;
+	return nbytes;
+}
+
+/*
+ * report_close
+ *   DESCRIPTION: give back the report of an open statistics pseudo file
+ *   INPUTS: fd: file descriptor being closed
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void report_close(int32_t fd) {
+	file_desc_t* file = &current_pcb[active_task_idx]->file_descriptors[fd];
+
+	if (file->report == NULL)
+		return;
+	file->report->in_use = false;
+	file->report = NULL;
+}
+
+/*
+ * report_str
+ *   DESCRIPTION: append a string to a report, truncating when it is full
+ *   INPUTS: report: the report being rendered
+ *           s: string to append
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: the report's text and len updated
+ */
+void report_str(report_t* report, const int8_t* s) {
+	while (*s != '\0' && report->len < REPORT_SIZE)
+		report->text[report->len++] = *s++;
+}
+
+/*
+ * report_num
+ *   DESCRIPTION: append a decimal number to a report
+ *   INPUTS: report: the report being rendered
+ *           value: number to append
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: the report's text and len updated
+ */
+void report_num(report_t* report, uint32_t value) {
+	int8_t num[NUM_BUF_LEN];
+	report_str(report, itoa(value, num, 10));
+}
+
+/*
+ * report_alloc
+ *   DESCRIPTION: take a free report
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: the report, or NULL when all are in use
+ *   SIDE EFFECTS: none
+ */
+static report_t* report_alloc() {
+	report_t* report = NULL;
+	int32_t flags, i;
+
+	spin_lock_irqsave(&report_lock, flags);
+	for (i = 0; i < NUM_REPORTS; i++) {
+		if (!reports[i].in_use) {
+			report = &reports[i];
+			report->in_use = true;
+			break;
+		}
+	}
+	spin_unlock_irqrestore(&report_lock, flags);
+	return report;
+}
@@ -0,0 +1,27 @@
+#ifndef _REPORT_H
+#define _REPORT_H
+
+#include "types.h"
+#include "paging.h"
+
+/* longest text a statistics pseudo file renders, the rest is cut off */
+#define REPORT_SIZE (8 * KILO)
+
+/* the text of a statistics pseudo file as one open file sees it */
+typedef struct report_n {
+	int32_t in_use;
+	uint32_t len;
+	int8_t text[REPORT_SIZE];
+} report_t;
+
+/* formats the statistics of one pseudo file, with report_str and report_num */
+typedef void (*report_render_t)(report_t* report);
+
+//see c file for more
+extern int32_t report_read(int32_t fd, void* buf, int32_t nbytes,
+	report_render_t render);
+extern void report_close(int32_t fd);
+extern void report_str(report_t* report, const int8_t* s);
+extern void report_num(report_t* report, uint32_t value);
+
+#endif /* _REPORT_H */
@@ -3,6 +3,10 @@
 #include "i8259.h"
 #include "terminal.h"
 #include "task.h"
+#include "prof.h"
+#include "trace.h"
+#include "softirq.h"
+#include "spinlock.h"
 
 /* RTC port/register constants */
 #define RTC_ADDR_PORT 0x70
@@ -34,21 +38,24 @@ clk */
 /* specified in Appendix B of MP3 spec - user program limited to max 1024HZ
 interrupts to avoid DOSing*/
 #define USER_MAX_FREQ_HZ 1024
-#define ALARM_SIG_FREQ_HZ 16
 
 /* struct to hold current RTC status */
 typedef struct rtc_status {
 	uint32_t curr_freq_hz; /* current RTC frequency in HZ */
-	uint32_t rtc_alarm_ctr; /* counter for the alarm signal */
 } rtc_status_t;
 
 static rtc_status_t rtc_stat = {
-	.curr_freq_hz = 0, //default to 1024hz, changed in rtc_init
-	.rtc_alarm_ctr = 0
+	.curr_freq_hz = 0 //default to 1024hz, changed in rtc_init
 };
 
+/* interrupts not yet counted against the tasks by rtc_softirq */
+static volatile uint32_t rtc_pending_ticks = 0;
+/* guards rtc_pending_ticks and the rtc fields of every PCB */
+static spinlock_t rtc_lock = SPINLOCK_INIT("rtc");
+
 static int32_t rtc_change_freq_hz(int32_t freq);
 static int32_t task_rtc_change_freq_hz(int32_t freq);
+static void rtc_softirq();
 
 
 /*
@@ -67,8 +74,8 @@ int32_t rtc_open (const uint8_t* fname) {
 	}
 	
 	int32_t flags;
-	cli_and_save(flags);
-	current_pcb[active_task_idx]->rtc_interrupt_occurred = false;
+	spin_lock_irqsave(&rtc_lock, flags);
+	current_pcb[active_task_idx]->rtc_periods = 0;
 	/* initalize to the first interrupt has occurred already to prevent a 
 	spurious printf of rtc read being unblocked by interrupt handler */
 	current_pcb[active_task_idx]->rtc_counter = 0;
@@ -77,7 +84,7 @@ int32_t rtc_open (const uint8_t* fname) {
 	/* default users to 2hz */
 	current_pcb[active_task_idx]->rtc_freq = DEFAULT_FREQ_HZ_USER;
 	current_pcb[active_task_idx]->using_rtc = true;
-	restore_flags(flags);
+	spin_unlock_irqrestore(&rtc_lock, flags);
 	return SUCCESS;
 }
 
@@ -97,26 +104,31 @@ int32_t rtc_close(int32_t fd) {
 	}
 
 	int32_t flags;
-	cli_and_save(flags);
+	spin_lock_irqsave(&rtc_lock, flags);
 
 	/* disable updating the rtc counter */
 	current_pcb[active_task_idx]->using_rtc = false;
-	restore_flags(flags);
+	spin_unlock_irqrestore(&rtc_lock, flags);
 	return SUCCESS;
 }
 
 /*
  * rtc_read
- *   DESCRIPTION: read from the RTC. Blocks until an interrupt occurs
+ *   DESCRIPTION: read from the RTC. Returns at once if periods elapsed since
+ *				  the last read, otherwise blocks until the next one. A program
+ *				  that fell behind learns how many periods it missed and can
+ *				  catch up instead of drifting.
  *   INPUTS: fd: unused - open in syscall.c validates that the RTC has been
  *			 opened by the current process
- *           buf: destination of the data
- *           nbytes: length in bytes to be read
-*			 Both buf and nbytes are unused.
- *   OUTPUTS: none
- *   RETURN VALUE: always returns 0 for success, but blocks until an interrupt 
- *				   occurs
- *   SIDE EFFECTS: none, but depends on the interrupt handler updating a flag.
+ *           buf: destination of the data - treated as a uint32_t* that gets
+ *			 (periods << RTC_READ_COUNT_SHIFT) | RTC_READ_IRQF | RTC_READ_PF.
+ *			 May be NULL if the caller only wants to wait.
+ *           nbytes: length in bytes to be read - the count is only written
+ *			 if this is at least 4
+ *   OUTPUTS: the period count in buf
+ *   RETURN VALUE: 4 if the count was written, 0 otherwise, but blocks until
+ *				   an interrupt occurs
+ *   SIDE EFFECTS: clears the period count of the current task
  */
 int32_t rtc_read(int32_t fd, void* buf, int32_t nbytes) {
 	/* no task is actually running */
@@ -124,24 +136,32 @@ int32_t rtc_read(int32_t fd, void* buf, int32_t nbytes) {
 		return ERR;
 	}
 
-	/* this is a critical section since rtc_stat.interrupt_occurred is also 
-	modified by the interrupt handler */
+	/* block until at least one period has elapsed, then take the count - this
+	is a critical section since rtc_periods is also modified by the interrupt
+	handler */
 	int32_t flags;
-	cli_and_save(flags);
-	current_pcb[active_task_idx]->rtc_interrupt_occurred = false;
-	restore_flags(flags);
-
-	/* block until an interrupt occurs */
+	uint32_t periods;
+	current_pcb[active_task_idx]->blocked = true;
 	while(true) {
-		cli_and_save(flags);
-		if(current_pcb[active_task_idx]->rtc_interrupt_occurred == true) {
-			restore_flags(flags);
+		spin_lock_irqsave(&rtc_lock, flags);
+		periods = current_pcb[active_task_idx]->rtc_periods;
+		if(periods != 0) {
+			current_pcb[active_task_idx]->rtc_periods = 0;
+			spin_unlock_irqrestore(&rtc_lock, flags);
 			break;
 		}
-		restore_flags(flags);
+		spin_unlock_irqrestore(&rtc_lock, flags);
+		kernel_lock_relax();
 	};
+	current_pcb[active_task_idx]->blocked = false;
 
-	return SUCCESS;
+	if(buf == NULL || nbytes < (int32_t)sizeof(uint32_t)) {
+		return SUCCESS;
+	}
+
+	*((uint32_t*)buf) = (periods << RTC_READ_COUNT_SHIFT) | RTC_READ_IRQF | 
+		RTC_READ_PF;
+	return sizeof(uint32_t);
 }
 
 /*
@@ -171,18 +191,14 @@ int32_t rtc_write(int32_t fd, const void* buf, int32_t nbytes) {
 		return ERR;
 	}
 
-	int32_t flags;
-	cli_and_save(flags);
-
+	/* task_rtc_change_freq_hz takes the rtc lock itself */
 	int32_t freq = *((int32_t*)buf);
 
 	if(task_rtc_change_freq_hz(freq) == SUCCESS) {
 		/* the change to RTC succeeded, return the number of bytes written */
-		restore_flags(flags);
 		return sizeof(int32_t);
 	} else {
 		/* freq was an invalid frequency */
-		restore_flags(flags);
 		return ERR;
 	}
 }
@@ -195,10 +211,8 @@ int32_t rtc_write(int32_t fd, const void* buf, int32_t nbytes) {
  *   OUTPUTS: none
  *   RETURN VALUE: none
  *   SIDE EFFECTS: Reads from RTC reg C, writes to RTC addr port. RTC state
- *				   changes to continue generating interrupts. Modifies
- *				   rtc_stat.interrupt_ocurred and causes pending rtc_reads to
- *				   unblock and return. updates the counter field for each user
- *				   program and triggers an interrupt when approriate
+ *				   changes to continue generating interrupts. Counts the
+ *				   interrupt for rtc_softirq, which updates the tasks.
  */
 void rtc_handler_40() {
     disable_irq(IRQ_8);
@@ -209,30 +223,77 @@ void rtc_handler_40() {
     outb(RTC_REG_C, RTC_ADDR_PORT);
     inb(RTC_DATA_PORT);
 
-    int32_t i;
+    /* sample the interrupted code for the profiler - we are called straight
+    from the interrupt wrapper, so its saved registers sit above our frame */
+    uint32_t ebp;
+    asm volatile(
+        "movl %%ebp, %0;"
+        : "=r"(ebp)
+        :
+        : "cc");
+    prof_sample(ebp + 2*4);
+
+    int32_t flags;
+    spin_lock_irqsave(&rtc_lock, flags);
+    rtc_pending_ticks++;
+    spin_unlock_irqrestore(&rtc_lock, flags);
+    raise_softirq(SOFTIRQ_RTC);
+
+    enable_irq(IRQ_8);
+}
+
+/*
+ * rtc_softirq
+ *   DESCRIPTION: SOFTIRQ_RTC handler - count the interrupts since the last
+ *				  call against every task using the rtc
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: Modifies the period count of each task using the rtc, which
+ *				   causes pending rtc_reads to unblock and return. updates
+ *				   the counter field for each user program and counts a
+ *				   period when approriate
+ */
+static void rtc_softirq() {
+    int32_t i, flags;
+    uint32_t ticks, period, fired = 0;
+
+    spin_lock_irqsave(&rtc_lock, flags);
+    ticks = rtc_pending_ticks;
+    rtc_pending_ticks = 0;
+    spin_unlock_irqrestore(&rtc_lock, flags);
+
     for (i = 0; i < NUM_TERMINAL; ++i)
-    {	
+    {
+        /* the fields are also written by rtc_open/rtc_write, which no longer
+        shut us out by masking the irq */
+        spin_lock_irqsave(&rtc_lock, flags);
+
     	/* don't update the counter if there is no active task on a terminal, 
     	or if that task is not using the rtc */
     	if(current_pcb[i] == NULL || current_pcb[i]->flag == TASK_NOT_PRESENT ||
-    		current_pcb[i]->using_rtc == false) continue;
-    	current_pcb[i]->rtc_counter++;
-
-    	/* we have reached the correct number of counts, send a user level interrupt */
-    	if(current_pcb[i]->rtc_counter >= (DEFAULT_FREQ_HZ / current_pcb[i]->rtc_freq)) {
-    		current_pcb[i]->rtc_counter = 0;
-    		current_pcb[i]->rtc_interrupt_occurred = true;
+    		current_pcb[i]->using_rtc == false) {
+            spin_unlock_irqrestore(&rtc_lock, flags);
+            continue;
+        }
+    	current_pcb[i]->rtc_counter += ticks;
+
+    	/* we have reached the correct number of counts, send a user level
+    	interrupt - accumulate rather than set a flag so a task that is slow to
+    	read can tell how many periods it missed */
+        period = DEFAULT_FREQ_HZ / current_pcb[i]->rtc_freq;
+    	while(current_pcb[i]->rtc_counter >= period) {
+    		current_pcb[i]->rtc_counter -= period;
+    		current_pcb[i]->rtc_periods++;
+    		fired |= 1 << i;
     	}
+        spin_unlock_irqrestore(&rtc_lock, flags);
     }
 
-    rtc_stat.rtc_alarm_ctr++;
-    if(rtc_stat.rtc_alarm_ctr >= (DEFAULT_FREQ_HZ * ALARM_SIG_FREQ_HZ)) {
-    	//disable rtc signal for now
-        current_pcb[active_task_idx]->signal_flag[ALARM] = SIGNAL_PENDING;
-        rtc_stat.rtc_alarm_ctr = 0;
-    }
-
-    enable_irq(IRQ_8);
+    /* only trace interrupts that end a period for some task, tracing every
+    1024Hz tick would flush the trace ring in a few seconds */
+    if (fired != 0)
+        trace_event(TRACE_IRQ, IRQ_8, fired);
 }
 
 
@@ -299,7 +360,14 @@ static int32_t task_rtc_change_freq_hz(int32_t freq) {
 	/* if input frequency was valid i.e. was a power of 2 between 2Hz and
 	1024Hz, inclusive */
 	if(retval != ERR) {
+		/* rtc_softirq runs with the irq unmasked */
+		int32_t flags;
+		spin_lock_irqsave(&rtc_lock, flags);
 		current_pcb[active_task_idx]->rtc_freq = freq;
+		/* periods counted at the old rate are meaningless at the new one */
+		current_pcb[active_task_idx]->rtc_counter = 0;
+		current_pcb[active_task_idx]->rtc_periods = 0;
+		spin_unlock_irqrestore(&rtc_lock, flags);
 	}
 
 	enable_irq (IRQ_8);
@@ -396,6 +464,8 @@ void init_rtc () {
 	/* initalize to 2hz periodic interrupts - according to mp3.2 spec */
 	rtc_change_freq_hz(DEFAULT_FREQ_HZ);
 	rtc_stat.curr_freq_hz = DEFAULT_FREQ_HZ;
+	rtc_pending_ticks = 0;
+	open_softirq(SOFTIRQ_RTC, rtc_softirq);
 
 	outb(RTC_REG_B, RTC_ADDR_PORT);
 	/* read-modify-write to keep other flags in RTC reg B unchanged */
@@ -3,6 +3,12 @@
 
 #include "types.h"
 
+/* layout of the 4 bytes returned by rtc_read, same as the Linux rtc driver:
+number of periods since the last read in the upper bits, IRQ flags below */
+#define RTC_READ_COUNT_SHIFT 8
+#define RTC_READ_IRQF 0x80	/* an interrupt occurred */
+#define RTC_READ_PF 0x40	/* it was a periodic interrupt */
+
 extern int32_t rtc_open (const uint8_t* fname);
 extern int32_t rtc_close(int32_t fd);
 extern int32_t rtc_read(int32_t fd, void* buf, int32_t nbytes);
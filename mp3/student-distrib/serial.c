@@ -0,0 +1,427 @@
+#include "serial.h"
+#include "lib.h"
+#include "i8259.h"
+#include "task.h"
+#include "spinlock.h"
+
+/* 16550 UART registers, as offsets from the base port */
+#define UART_DATA 0		/* transmit/receive buffer, divisor low with DLAB */
+#define UART_IER 1		/* interrupt enable, divisor high with DLAB */
+#define UART_IIR 2		/* interrupt identification when read */
+#define UART_FCR 2		/* FIFO control when written */
+#define UART_LCR 3		/* line control */
+#define UART_MCR 4		/* modem control */
+#define UART_LSR 5		/* line status */
+#define UART_MSR 6		/* modem status */
+#define UART_SCRATCH 7
+
+#define IER_RX_DATA 0x01
+#define IER_TX_EMPTY 0x02
+
+#define IIR_NONE_PENDING 0x01
+#define IIR_ID_MASK 0x0E
+#define IIR_TX_EMPTY 0x02
+#define IIR_RX_DATA 0x04
+#define IIR_RX_LINE 0x06
+#define IIR_RX_TIMEOUT 0x0C
+
+#define LCR_DLAB 0x80
+#define LCR_8N1 0x03
+/* enable and clear both FIFOs, receive interrupt at 14 bytes */
+#define FCR_ENABLE_CLEAR 0xC7
+/* OUT2 gates the UART interrupt line through to the PIC */
+#define MCR_DTR_RTS_OUT2 0x0B
+#define LSR_DATA_READY 0x01
+#define LSR_THR_EMPTY 0x20
+
+/* bytes the transmit FIFO takes once the holding register is empty */
+#define UART_FIFO_LEN 16
+#define SCRATCH_TEST 0x5A
+
+/* 115200 baud is the 1.8432MHz UART clock / 16 with a divisor of 1 */
+#define BAUD_DIVISOR 1
+
+/* longest note of dropped console bytes, see serial_console_write */
+#define DROP_NOTE_LEN 40
+#define NUM_BUF_LEN 12
+
+/* any context may produce into the transmit ring, the interrupt handler
+consumes it. The receive ring is the other way around. Indices run freely
+and are masked on use. */
+static uint8_t tx_ring[SERIAL_TX_SIZE];
+static volatile uint32_t tx_head = 0;
+static volatile uint32_t tx_tail = 0;
+static uint8_t rx_ring[SERIAL_RX_SIZE];
+static volatile uint32_t rx_head = 0;
+static volatile uint32_t rx_tail = 0;
+
+/* the transmitter has bytes in flight and will interrupt when it drains */
+static volatile int32_t tx_busy = false;
+static int32_t serial_present = false;
+/* console bytes the mirror dropped because the transmit ring was full or
+the mirror was paused */
+static uint32_t tx_dropped = 0;
+static volatile int32_t mirror_paused = false;
+/* guards both rings and the UART registers */
+static spinlock_t serial_lock = SPINLOCK_INIT("serial");
+
+/* function prototypes for internal functions */
+static void tx_fill();
+static void tx_queue(uint8_t c);
+static void rx_drain();
+static void serial_text_putc(uint8_t c);
+
+
+/*
+ * init_serial
+ *   DESCRIPTION: set up COM1 at 115200 baud, 8N1, with FIFOs and receive
+ *				  and transmit interrupts. Does nothing without a UART.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: IRQ 4 enabled
+ */
+void init_serial() {
+	/* no 16550 answers if the scratch register does not hold a value */
+	outb(SCRATCH_TEST, COM1_PORT + UART_SCRATCH);
+	if (inb(COM1_PORT + UART_SCRATCH) != SCRATCH_TEST)
+		return;
+
+	disable_irq(IRQ_4);
+	outb(0x00, COM1_PORT + UART_IER);
+	outb(LCR_DLAB, COM1_PORT + UART_LCR);
+	outb(BAUD_DIVISOR & LOW_BYTE_MASK, COM1_PORT + UART_DATA);
+	outb(BAUD_DIVISOR >> LOW_BYTE, COM1_PORT + UART_IER);
+	outb(LCR_8N1, COM1_PORT + UART_LCR);
+	outb(FCR_ENABLE_CLEAR, COM1_PORT + UART_FCR);
+	outb(MCR_DTR_RTS_OUT2, COM1_PORT + UART_MCR);
+
+	/* drop whatever was pending from before */
+	inb(COM1_PORT + UART_LSR);
+	inb(COM1_PORT + UART_DATA);
+	inb(COM1_PORT + UART_IIR);
+	inb(COM1_PORT + UART_MSR);
+
+	tx_head = tx_tail = 0;
+	rx_head = rx_tail = 0;
+	tx_busy = false;
+	serial_present = true;
+
+	outb(IER_RX_DATA | IER_TX_EMPTY, COM1_PORT + UART_IER);
+	enable_irq(IRQ_4);
+}
+
+/*
+ * tx_fill
+ *   DESCRIPTION: move up to a FIFO's worth of bytes from the transmit ring
+ *				  into the UART. Caller holds serial_lock and has seen
+ *				  the holding register empty.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: tx_busy tells whether a transmit interrupt will follow
+ */
+static void tx_fill() {
+	int32_t i;
+	for (i = 0; i < UART_FIFO_LEN && tx_tail != tx_head; i++) {
+		outb(tx_ring[tx_tail & SERIAL_TX_MASK], COM1_PORT + UART_DATA);
+		tx_tail++;
+	}
+	tx_busy = (i != 0);
+}
+
+/*
+ * tx_queue
+ *   DESCRIPTION: add one byte to the transmit ring and start the UART if
+ *				  nothing is in flight. Caller holds serial_lock and has
+ *				  checked there is room.
+ *   INPUTS: c: byte to send
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: transmit ring modified
+ */
+static void tx_queue(uint8_t c) {
+	tx_ring[tx_head & SERIAL_TX_MASK] = c;
+	tx_head++;
+	/* nothing in flight means no interrupt is coming, so start sending */
+	if (!tx_busy && (inb(COM1_PORT + UART_LSR) & LSR_THR_EMPTY))
+		tx_fill();
+}
+
+/*
+ * rx_drain
+ *   DESCRIPTION: move received bytes from the UART into the receive ring,
+ *				  dropping them when it is full. Caller holds serial_lock.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: receive ring modified
+ */
+static void rx_drain() {
+	while (inb(COM1_PORT + UART_LSR) & LSR_DATA_READY) {
+		uint8_t c = inb(COM1_PORT + UART_DATA);
+		if (rx_head - rx_tail < SERIAL_RX_SIZE) {
+			rx_ring[rx_head & SERIAL_RX_MASK] = c;
+			rx_head++;
+		}
+	}
+}
+
+/*
+ * serial_handler_36
+ *   DESCRIPTION: COM1 interrupt handler - refills the transmit FIFO and
+ *				  empties the receive FIFO
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: transmit and receive rings modified
+ */
+void serial_handler_36() {
+	disable_irq(IRQ_4);
+	send_eoi(IRQ_4);
+
+	/* writers may run in any context */
+	int32_t flags;
+	uint8_t iir;
+	spin_lock_irqsave(&serial_lock, flags);
+	while (!((iir = inb(COM1_PORT + UART_IIR)) & IIR_NONE_PENDING)) {
+		switch (iir & IIR_ID_MASK) {
+			case IIR_TX_EMPTY:
+				/* a polled writer may have refilled the FIFO meanwhile */
+				if (inb(COM1_PORT + UART_LSR) & LSR_THR_EMPTY)
+					tx_fill();
+				break;
+			case IIR_RX_DATA:
+			case IIR_RX_TIMEOUT:
+				rx_drain();
+				break;
+			case IIR_RX_LINE:
+				inb(COM1_PORT + UART_LSR);
+				break;
+			default:
+				inb(COM1_PORT + UART_MSR);
+				break;
+		}
+	}
+	spin_unlock_irqrestore(&serial_lock, flags);
+
+	enable_irq(IRQ_4);
+}
+
+/*
+ * serial_putc
+ *   DESCRIPTION: queue one byte for transmission. Safe from any context.
+ *   INPUTS: c: byte to send
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: waits for room when the ring is full - the UART is then
+ *				   fed by polling, so this also works with interrupts off
+ */
+void serial_putc(uint8_t c) {
+	int32_t flags;
+
+	if (!serial_present)
+		return;
+
+	while (true) {
+		spin_lock_irqsave(&serial_lock, flags);
+		if (tx_head - tx_tail < SERIAL_TX_SIZE)
+			break;
+		/* the interrupt may be masked or held off by our caller */
+		if (inb(COM1_PORT + UART_LSR) & LSR_THR_EMPTY)
+			tx_fill();
+		spin_unlock_irqrestore(&serial_lock, flags);
+	}
+
+	tx_queue(c);
+	spin_unlock_irqrestore(&serial_lock, flags);
+}
+
+/*
+ * serial_text_putc
+ *   DESCRIPTION: send a character of text, a newline becomes CR LF for the
+ *				  terminal on the other end
+ *   INPUTS: c: character to send
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: see serial_putc
+ */
+static void serial_text_putc(uint8_t c) {
+	if (c == '\n')
+		serial_putc('\r');
+	serial_putc(c);
+}
+
+/*
+ * serial_puts
+ *   DESCRIPTION: send a string of text, waiting for room as serial_putc does
+ *   INPUTS: s: string to send
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: see serial_putc
+ */
+void serial_puts(const int8_t* s) {
+	for (; *s != '\0'; s++)
+		serial_text_putc(*s);
+}
+
+/*
+ * serial_console_write
+ *   DESCRIPTION: mirror console text to the serial port, newlines as CR LF.
+ *				  Never waits: the console is written with interrupts off, so
+ *				  what the transmit ring has no room for is dropped, and
+ *				  noted once there is room again.
+ *   INPUTS: s: characters to send
+ *           len: number of characters
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: transmit ring modified
+ */
+void serial_console_write(const uint8_t* s, int32_t len) {
+	int8_t note[DROP_NOTE_LEN];
+	int8_t num[NUM_BUF_LEN];
+	int32_t flags, i;
+	uint32_t j;
+
+	if (!serial_present)
+		return;
+
+	spin_lock_irqsave(&serial_lock, flags);
+	if (mirror_paused) {
+		tx_dropped += len;
+		spin_unlock_irqrestore(&serial_lock, flags);
+		return;
+	}
+	if (tx_dropped != 0 && tx_head - tx_tail <= SERIAL_TX_SIZE - DROP_NOTE_LEN) {
+		strcpy(note, "\r\n[serial: ");
+		strcpy(note + strlen(note), itoa(tx_dropped, num, 10));
+		strcpy(note + strlen(note), " bytes dropped]\r\n");
+		for (j = 0; note[j] != '\0'; j++)
+			tx_queue(note[j]);
+		tx_dropped = 0;
+	}
+	for (i = 0; i < len; i++) {
+		/* room for the CR too, a lone LF would leave the line open */
+		if (tx_head - tx_tail > SERIAL_TX_SIZE - 2) {
+			tx_dropped += len - i;
+			break;
+		}
+		if (s[i] == '\n')
+			tx_queue('\r');
+		tx_queue(s[i]);
+	}
+	spin_unlock_irqrestore(&serial_lock, flags);
+}
+
+/*
+ * serial_mirror_pause
+ *   DESCRIPTION: stop or restart the console mirror, for output that must
+ *				  reach the port whole, e.g. the trace dump
+ *   INPUTS: pause: true to stop the mirror, false to restart it
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: while paused console text is dropped from the port, see
+ *				   serial_console_write
+ */
+void serial_mirror_pause(int32_t pause) {
+	mirror_paused = pause;
+}
+
+/*
+ * serial_tx_room
+ *   DESCRIPTION: room left in the transmit ring, for a writer that would
+ *				  rather wait for it elsewhere than poll in serial_putc
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: free bytes, the whole ring when there is no UART since
+ *				   nothing is queued then
+ *   SIDE EFFECTS: none
+ */
+uint32_t serial_tx_room() {
+	if (!serial_present)
+		return SERIAL_TX_SIZE;
+	return SERIAL_TX_SIZE - (tx_head - tx_tail);
+}
+
+/*
+ * serial_open
+ *   DESCRIPTION: open the serial terminal
+ *   INPUTS: fname: unused
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 for success, -1 when there is no UART
+ *   SIDE EFFECTS: none
+ */
+int32_t serial_open(const uint8_t* fname) {
+	return serial_present ? SUCCESS : ERR;
+}
+
+/*
+ * serial_close
+ *   DESCRIPTION: close the serial terminal
+ *   INPUTS: fd: unused
+ *   OUTPUTS: none
+ *   RETURN VALUE: always succeeds and returns 0
+ *   SIDE EFFECTS: none
+ */
+int32_t serial_close(int32_t fd) {
+	return SUCCESS;
+}
+
+/*
+ * serial_read
+ *   DESCRIPTION: read received bytes, blocking until there is at least one.
+ *				  Carriage returns read as newlines since that is what the
+ *				  enter key sends.
+ *   INPUTS: fd: unused
+ *           nbytes: length of buf
+ *   OUTPUTS: buf: destination of the data
+ *   RETURN VALUE: number of bytes read, -1 for fail
+ *   SIDE EFFECTS: receive ring emptied by up to nbytes
+ */
+int32_t serial_read(int32_t fd, void* buf, int32_t nbytes) {
+	uint8_t* dest = (uint8_t*)buf;
+	int32_t flags, i;
+
+	if (buf == NULL || nbytes < 0)
+		return ERR;
+	if (nbytes == 0)
+		return 0;
+
+	current_pcb[active_task_idx]->blocked = true;
+	while (rx_head == rx_tail)
+		kernel_lock_relax();
+	current_pcb[active_task_idx]->blocked = false;
+
+	spin_lock_irqsave(&serial_lock, flags);
+	for (i = 0; i < nbytes && rx_tail != rx_head; i++) {
+		dest[i] = rx_ring[rx_tail & SERIAL_RX_MASK];
+		rx_tail++;
+		if (dest[i] == '\r')
+			dest[i] = '\n';
+	}
+	spin_unlock_irqrestore(&serial_lock, flags);
+	return i;
+}
+
+/*
+ * serial_write
+ *   DESCRIPTION: queue text for the serial terminal, returns once it is in
+ *				  the transmit ring rather than on the wire
+ *   INPUTS: fd: unused
+ *           buf: source of the data
+ *           nbytes: length of buf
+ *   OUTPUTS: none
+ *   RETURN VALUE: number of bytes written, -1 for fail
+ *   SIDE EFFECTS: see serial_putc
+ */
+int32_t serial_write(int32_t fd, const void* buf, int32_t nbytes) {
+	const uint8_t* src = (const uint8_t*)buf;
+	int32_t i;
+
+	if (buf == NULL || nbytes < 0)
+		return ERR;
+
+	for (i = 0; i < nbytes; i++)
+		serial_text_putc(src[i]);
+	return nbytes;
+}
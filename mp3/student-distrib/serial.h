@@ -0,0 +1,28 @@
+#ifndef _SERIAL_H
+#define _SERIAL_H
+
+#include "types.h"
+
+/* first serial port */
+#define COM1_PORT 0x3F8
+
+/* transmit and receive rings, must be powers of 2 */
+#define SERIAL_TX_SIZE 4096
+#define SERIAL_TX_MASK (SERIAL_TX_SIZE - 1)
+#define SERIAL_RX_SIZE 256
+#define SERIAL_RX_MASK (SERIAL_RX_SIZE - 1)
+
+//see c file for more
+extern void init_serial();
+extern void serial_handler_36();
+extern void serial_putc(uint8_t c);
+extern void serial_puts(const int8_t* s);
+extern void serial_console_write(const uint8_t* s, int32_t len);
+extern void serial_mirror_pause(int32_t pause);
+extern uint32_t serial_tx_room();
+extern int32_t serial_open(const uint8_t* fname);
+extern int32_t serial_read(int32_t fd, void* buf, int32_t nbytes);
+extern int32_t serial_write(int32_t fd, const void* buf, int32_t nbytes);
+extern int32_t serial_close(int32_t fd);
+
+#endif /* _SERIAL_H */
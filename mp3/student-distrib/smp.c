@@ -0,0 +1,395 @@
+#include "smp.h"
+#include "lib.h"
+#include "apic.h"
+#include "i8259.h"
+#include "paging.h"
+#include "task.h"
+#include "syscall.h"
+#include "timepage.h"
+#include "spinlock.h"
+#include "fpu.h"
+#include "frame.h"
+
+/* INIT, then two startup IPIs, with the waits the MP specification asks for */
+#define INIT_DELAY_US		10000
+#define STARTUP_DELAY_US	200
+#define STARTUP_IPIS		2
+/* how long the application processors get to report in */
+#define AP_BOOT_WAIT_US		50000
+#define US_PER_MS			1000
+
+/* startup IPI vector: the page the trampoline sits on */
+#define TRAMPOLINE_PAGE_SHIFT 12
+/* GDT index of a selector */
+#define SELECTOR_INDEX_SHIFT 3
+/* 32 bit TSS that is not busy, ltr marks it busy */
+#define TSS_TYPE_AVAILABLE 0x9
+
+/* the boot processor runs every terminal until init_smp hands some out */
+cpu_t cpus[MAX_CPUS] = {
+	{ BOOT_CPU, 0, ERR, TASK_KERNEL, &tss, true, false, ERR, false },
+};
+volatile int32_t smp_cpus = 1;
+/* processor that schedules each terminal's task */
+int32_t cpu_of_terminal[NUM_TERMINAL] = { BOOT_CPU, BOOT_CPU, BOOT_CPU };
+
+/* descriptor tables and boot stacks of the application processors, entry 0
+belongs to the boot processor which has its own in x86_desc.S */
+static seg_desc_t ap_gdt[MAX_CPUS][NUM_GDT_ENTRIES] __attribute__((aligned (8)));
+static tss_t ap_tss[MAX_CPUS];
+uint8_t ap_stacks[MAX_CPUS][AP_STACK_SIZE] __attribute__((aligned (16)));
+
+/* the kernel lock, every other lock is taken inside it */
+static spinlock_t kernel_spinlock = SPINLOCK_INIT("kernel");
+
+/* real mode code in smp_boot.S */
+extern uint8_t smp_trampoline[];
+extern uint8_t smp_trampoline_end[];
+
+/* function prototypes for internal functions */
+static void smp_delay_us(uint32_t us);
+static void ap_run(cpu_t* cpu);
+
+
+/*
+ * init_smp
+ *   DESCRIPTION: start the application processors with INIT and startup
+ *				  IPIs, then split the terminals between every processor
+ *				  that came up. Each processor then schedules only its own
+ *				  terminals' tasks, so programs on different terminals run
+ *				  at the same time. Needs the local APIC, see init_apic, and
+ *				  the TSC calibration, and must run with interrupts off.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: takes the kernel lock, the first return to user mode
+ *				   drops it and lets the application processors in
+ */
+void init_smp() {
+	int32_t online[MAX_CPUS];
+	int32_t i, n;
+
+	if (!apic_active)
+		return;
+
+	cpus[BOOT_CPU].apic_id = apic_id();
+	/* this_cpu reads through %gs as soon as a second processor counts */
+	SET_SEG_BASE(gdt[KERNEL_PERCPU >> SELECTOR_INDEX_SHIFT], &cpus[BOOT_CPU]);
+	load_percpu_gs();
+
+	/* the application processors wait in kernel_lock until the shells are
+	set up and the boot processor returns to user mode */
+	kernel_lock_enter();
+
+	/* they come up in real mode, which only reaches the first 1MB */
+	map_kilo_page(TRAMPOLINE_BASE, TRAMPOLINE_BASE, TASK_KERNEL, DPL_KERNEL);
+	memcpy((void*)TRAMPOLINE_BASE, smp_trampoline,
+		smp_trampoline_end - smp_trampoline);
+
+	apic_send_ipi(0, APIC_ICR_ALL_BUT_SELF | APIC_ICR_ASSERT | APIC_ICR_INIT);
+	smp_delay_us(INIT_DELAY_US);
+	for (i = 0; i < STARTUP_IPIS; i++) {
+		apic_send_ipi(0, APIC_ICR_ALL_BUT_SELF | APIC_ICR_ASSERT |
+			APIC_ICR_STARTUP | (TRAMPOLINE_BASE >> TRAMPOLINE_PAGE_SHIFT));
+		smp_delay_us(STARTUP_DELAY_US);
+	}
+	smp_delay_us(AP_BOOT_WAIT_US);
+
+	/* one that is late finds no terminal and idles */
+	n = 0;
+	for (i = 0; i < MAX_CPUS; i++) {
+		if (cpus[i].online)
+			online[n++] = i;
+	}
+	for (i = 0; i < NUM_TERMINAL; i++)
+		cpu_of_terminal[i] = online[i % n];
+
+	printf("smp: %d processors\n", n);
+}
+
+/*
+ * ap_main
+ *   DESCRIPTION: C entry of an application processor, called by ap_start
+ *				  on its boot stack with paging on. Loads its own GDT and
+ *				  TSS and the shared IDT, sets up its local APIC, then waits
+ *				  for the kernel lock and starts its first task.
+ *   INPUTS: id: cpus[] index this processor drew
+ *   OUTPUTS: none
+ *   RETURN VALUE: does not return
+ *   SIDE EFFECTS: smp_cpus incremented
+ */
+void ap_main(int32_t id) {
+	cpu_t* cpu = &cpus[id];
+	x86_desc_t gdt_ptr;
+
+	cpu->id = id;
+	cpu->apic_id = apic_id();
+	cpu->task_idx = ERR;
+	cpu->page_dir = TASK_KERNEL;
+	cpu->tss = &ap_tss[id];
+
+	/* ltr marks the TSS descriptor busy, so every processor needs its own
+	descriptor and therefore its own copy of the GDT. The copy also gives
+	it its own per processor data segment. */
+	memcpy(ap_gdt[id], gdt, sizeof(ap_gdt[id]));
+	memcpy(&ap_tss[id], &tss, sizeof(tss_t));
+	ap_tss[id].esp0 = (uint32_t)ap_stacks[id] + AP_STACK_SIZE;
+	ap_gdt[id][KERNEL_TSS >> SELECTOR_INDEX_SHIFT].type = TSS_TYPE_AVAILABLE;
+	SET_TSS_PARAMS(ap_gdt[id][KERNEL_TSS >> SELECTOR_INDEX_SHIFT], &ap_tss[id],
+		tss_size);
+	SET_SEG_BASE(ap_gdt[id][KERNEL_PERCPU >> SELECTOR_INDEX_SHIFT], cpu);
+
+	gdt_ptr.size = sizeof(ap_gdt[id]) - 1;
+	gdt_ptr.addr = (uint32_t)ap_gdt[id];
+	asm volatile("lgdt (%0)" : : "r"(&gdt_ptr.size) : "memory");
+	ltr(KERNEL_TSS);
+	lldt(KERNEL_LDT);
+	load_percpu_gs();
+
+	/* this_cpu works once %gs is ours */
+	asm volatile("lock incl %0" : "+m"(smp_cpus) : : "memory", "cc");
+	asm volatile("lidt (%0)" : : "r"(&idt_desc_ptr) : "memory");
+
+	init_apic_ap();
+	init_sysenter();
+	init_fpu();
+	cpu->online = true;
+
+	kernel_lock();
+	ap_run(cpu);
+}
+
+/*
+ * ap_run
+ *   DESCRIPTION: start the first task of the first terminal this processor
+ *				  owns, the way the PIT handler switches to a task. Without
+ *				  a terminal there is nothing to do but answer IPIs.
+ *   INPUTS: cpu: the calling processor
+ *   OUTPUTS: none
+ *   RETURN VALUE: does not return
+ *   SIDE EFFECTS: drops the kernel lock on the way to user mode
+ */
+static void ap_run(cpu_t* cpu) {
+	int32_t t;
+
+	for (t = 0; t < NUM_TERMINAL; t++) {
+		if (cpu_of_terminal[t] == cpu->id)
+			break;
+	}
+	if (t == NUM_TERMINAL) {
+		kernel_unlock();
+		/* the timer stays masked, IPIs need no lock. Anything else that
+		took it on the way in gives it back here. */
+		while (true) {
+			while (frame_zero_idle())
+				;
+			asm volatile("sti; hlt; cli" ::: "memory");
+			kernel_lock_exit();
+		}
+	}
+
+	cpu->task_idx = t;
+	update_page_directory(get_cur_pid() + PAGE_DIR_USER_IDX_OFFSET);
+	cpu->tss->ss0 = KERNEL_DS;
+	cpu->tss->esp0 = KERNEL_END - (get_cur_pid() * 8 * KILO) -
+		KMODE_STACK_OFFSET;
+	enable_irq(IRQ_0);
+
+	/* the task's saved frame returns into the timer interrupt wrapper,
+	which restores its registers and irets */
+	asm volatile(
+		"movl %0, %%esp;"
+		"movl %1, %%ebp;"
+		"leave;"
+		"ret;"
+		: /* no outputs */
+		: "r"(current_pcb[t]->esp), "r"(current_pcb[t]->ebp)
+		: "cc");
+}
+
+/*
+ * smp_next_task
+ *   DESCRIPTION: round robin over the terminals the calling processor owns
+ *   INPUTS: task_idx: terminal whose task runs now
+ *   OUTPUTS: none
+ *   RETURN VALUE: terminal to run next, task_idx if it is the only one
+ *   SIDE EFFECTS: none
+ */
+int32_t smp_next_task(int32_t task_idx) {
+	int32_t id = this_cpu()->id;
+	int32_t i, t;
+
+	for (i = 1; i <= NUM_TERMINAL; i++) {
+		t = (task_idx + i) % NUM_TERMINAL;
+		if (cpu_of_terminal[t] == id)
+			return t;
+	}
+	return task_idx;
+}
+
+/*
+ * smp_flush_tlb
+ *   DESCRIPTION: TLB shootdown - make every other processor that has the
+ *				  page directory loaded flush its TLB, and wait until they
+ *				  have. Called after a mapping in that directory changed.
+ *   INPUTS: task_id: index of the page directory that changed
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: IPIs sent. Caller holds the kernel lock, so the targets
+ *				   cannot be switching directories meanwhile.
+ */
+void smp_flush_tlb(uint32_t task_id) {
+	cpu_t* self;
+	int32_t i;
+
+	if (smp_cpus == 1)
+		return;
+
+	self = this_cpu();
+	for (i = 0; i < MAX_CPUS; i++) {
+		if (&cpus[i] == self || !cpus[i].online || cpus[i].page_dir != task_id)
+			continue;
+		cpus[i].tlb_flush = true;
+		apic_send_ipi(cpus[i].apic_id,
+			APIC_ICR_FIXED | APIC_ICR_ASSERT | TLB_SHOOTDOWN_VECTOR);
+	}
+	for (i = 0; i < MAX_CPUS; i++) {
+		while (cpus[i].tlb_flush)
+			cpu_relax();
+	}
+}
+
+/*
+ * tlb_shootdown_handler_253
+ *   DESCRIPTION: TLB shootdown IPI handler. Runs without the kernel lock,
+ *				  the sender holds it while it waits for us.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: TLB flushed
+ */
+void tlb_shootdown_handler_253() {
+	smp_flush_tlb_local(this_cpu());
+	apic_send_eoi();
+}
+
+/*
+ * smp_flush_tlb_local
+ *   DESCRIPTION: flush the TLB and acknowledge a shootdown, also called by
+ *				  spin_lock while it waits
+ *   INPUTS: cpu: the calling processor
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: CR3 reloaded
+ */
+void smp_flush_tlb_local(cpu_t* cpu) {
+	asm volatile(
+		"movl %%cr3, %%eax;"
+		"movl %%eax, %%cr3;"
+		: /* no outputs */
+		: /* no inputs */
+		: "eax", "memory");
+	cpu->tlb_flush = false;
+}
+
+/*
+ * kernel_lock
+ *   DESCRIPTION: take the kernel lock. Only one processor runs kernel code
+ *				  at a time; user code runs in parallel. Must be called with
+ *				  interrupts off.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: spins until the lock is ours, see spin_lock
+ */
+void kernel_lock() {
+	spin_lock(&kernel_spinlock);
+}
+
+/*
+ * kernel_unlock
+ *   DESCRIPTION: give the kernel lock to the next waiter
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void kernel_unlock() {
+	spin_unlock(&kernel_spinlock);
+}
+
+/*
+ * kernel_lock_enter
+ *   DESCRIPTION: called by the interrupt and system call wrappers on entry.
+ *				  Takes the kernel lock unless this processor holds it
+ *				  already, i.e. the interrupt nested in kernel code.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: may spin for the lock with interrupts off
+ */
+void kernel_lock_enter() {
+	int32_t flags;
+	cli_and_save(flags);
+	if (!spin_lock_held(&kernel_spinlock))
+		kernel_lock();
+	restore_flags(flags);
+}
+
+/*
+ * kernel_lock_exit
+ *   DESCRIPTION: called by the wrappers right before they return to user
+ *				  mode, with interrupts off until the iret. Returning to
+ *				  the kernel keeps the lock.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: drops the kernel lock if this processor holds it
+ */
+void kernel_lock_exit() {
+	if (spin_lock_held(&kernel_spinlock))
+		kernel_unlock();
+}
+
+/*
+ * kernel_lock_relax
+ *   DESCRIPTION: let the other processors into the kernel, called on every
+ *				  pass of a loop that waits for an interrupt. The ticket
+ *				  lock puts us behind whoever is waiting. The wait is also
+ *				  used to zero a free page frame.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void kernel_lock_relax() {
+	int32_t flags;
+
+	/* the caller only waits, a frame can be zeroed meanwhile */
+	frame_zero_idle();
+
+	if (smp_cpus == 1)
+		return;
+
+	cli_and_save(flags);
+	if (spin_lock_held(&kernel_spinlock)) {
+		kernel_unlock();
+		kernel_lock();
+	}
+	restore_flags(flags);
+}
+
+/*
+ * smp_delay_us
+ *   DESCRIPTION: busy wait on the TSC
+ *   INPUTS: us: microseconds to wait
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void smp_delay_us(uint32_t us) {
+	uint64_t end = rdtsc() +
+		div64_32((uint64_t)us * time_page->tsc_khz, US_PER_MS);
+	while ((int64_t)(rdtsc() - end) < 0)
+		cpu_relax();
+}
@@ -0,0 +1,81 @@
+#ifndef _SMP_H
+#define _SMP_H
+
+#include "x86_desc.h"
+
+/* processors the kernel runs on, the boot processor is number 0. One per
+terminal is all the scheduler can use, the rest would only idle. */
+#define MAX_CPUS		4
+#define BOOT_CPU		0
+/* physical address the application processors start at in real mode, page
+aligned and below 1MB. The startup IPI carries it as a page number. */
+#define TRAMPOLINE_BASE	0x7000
+
+/* kernel stack of an application processor until it runs its first task */
+#define AP_STACK_SIZE	0x2000
+
+/* vector of the IPI that asks a processor to flush its TLB */
+#define TLB_SHOOTDOWN_VECTOR 0xFD
+
+#ifndef ASM
+
+#include "types.h"
+#include "apic.h"
+
+typedef struct cpu {
+	int32_t id;					/* index into cpus[], first for this_cpu */
+	uint32_t apic_id;			/* local APIC ID */
+	int32_t task_idx;			/* terminal whose task runs here, or ERR */
+	uint32_t page_dir;			/* page directory loaded in CR3 */
+	tss_t* tss;					/* holds the kernel stack of task_idx */
+	volatile int32_t online;	/* set once the processor can take work */
+	volatile int32_t tlb_flush;	/* shootdown requested, cleared when done */
+	int32_t fpu_owner;			/* pid whose FPU registers are loaded, or ERR */
+	volatile int32_t in_softirq;	/* running do_softirq, not preempted */
+} cpu_t;
+
+extern cpu_t cpus[MAX_CPUS];
+extern volatile int32_t smp_cpus;
+extern int32_t cpu_of_terminal[];
+
+/*
+ * this_cpu
+ *   DESCRIPTION: the per processor data of the caller. The kernel runs
+ *				  with %gs on its processor's cpu_t, see KERNEL_PERCPU, so
+ *				  this is one load. With one processor it is always the
+ *				  boot processor.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: pointer into cpus[]
+ *   SIDE EFFECTS: none
+ */
+static inline cpu_t* this_cpu(void) {
+	int32_t id;
+
+	if (smp_cpus == 1)
+		return &cpus[BOOT_CPU];
+	asm volatile("movl %%gs:0, %0" : "=r"(id));
+	return &cpus[id];
+}
+
+/* spin loop hint, lets the other hyperthread run and saves power */
+static inline void cpu_relax(void) {
+	asm volatile("pause" ::: "memory");
+}
+
+//see c file for more
+extern void init_smp();
+extern void ap_main(int32_t id);
+extern int32_t smp_next_task(int32_t task_idx);
+extern void smp_flush_tlb(uint32_t task_id);
+extern void tlb_shootdown_handler_253();
+extern void smp_flush_tlb_local(cpu_t* cpu);
+extern void kernel_lock();
+extern void kernel_unlock();
+extern void kernel_lock_enter();
+extern void kernel_lock_exit();
+extern void kernel_lock_relax();
+
+#endif /* ASM */
+
+#endif /* _SMP_H */
@@ -0,0 +1,105 @@
+#include "softirq.h"
+#include "lib.h"
+#include "spinlock.h"
+#include "smp.h"
+
+/* interrupt handlers only acknowledge the device and raise a bit here, the
+work itself runs from do_softirq on the way out of the interrupt with
+interrupts on and every IRQ unmasked. One processor drains at a time. */
+static softirq_handler_t softirq_vec[NUM_SOFTIRQ];
+static volatile uint32_t softirq_pending = 0;
+static volatile int32_t softirq_running = false;
+static spinlock_t softirq_lock = SPINLOCK_INIT("softirq");
+
+
+/*
+ * init_softirq
+ *   DESCRIPTION: clear all softirq handlers and pending work
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void init_softirq() {
+	int32_t i;
+	for (i = 0; i < NUM_SOFTIRQ; i++)
+		softirq_vec[i] = NULL;
+	softirq_pending = 0;
+	softirq_running = false;
+}
+
+/*
+ * open_softirq
+ *   DESCRIPTION: install the handler for a softirq
+ *   INPUTS: nr: SOFTIRQ_* number
+ *           handler: run by do_softirq after nr is raised
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void open_softirq(uint32_t nr, softirq_handler_t handler) {
+	if (nr < NUM_SOFTIRQ)
+		softirq_vec[nr] = handler;
+}
+
+/*
+ * raise_softirq
+ *   DESCRIPTION: mark a softirq pending. Raising it again before it runs
+ *				  does nothing more, so handlers drain all queued work.
+ *   INPUTS: nr: SOFTIRQ_* number
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: the handler runs at the next do_softirq
+ */
+void raise_softirq(uint32_t nr) {
+	int32_t flags;
+	if (nr >= NUM_SOFTIRQ)
+		return;
+	spin_lock_irqsave(&softirq_lock, flags);
+	softirq_pending |= 1 << nr;
+	spin_unlock_irqrestore(&softirq_lock, flags);
+}
+
+/*
+ * do_softirq
+ *   DESCRIPTION: run the pending softirqs, called by the device interrupt
+ *				  wrappers before returning. Handlers run with interrupts
+ *				  on; an interrupt that nests in them only raises its bit
+ *				  and this loop picks it up. After SOFTIRQ_MAX_RESTART passes
+ *				  the rest waits for the next interrupt (the timer ticks
+ *				  often enough). The drainer is not preempted, see
+ *				  pit_handler_32, so no work waits on a task that is not
+ *				  running.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: see the softirq handlers
+ */
+void do_softirq() {
+	uint32_t pending, nr;
+	int32_t flags, restart = SOFTIRQ_MAX_RESTART;
+
+	spin_lock_irqsave(&softirq_lock, flags);
+	if (softirq_running) {
+		spin_unlock_irqrestore(&softirq_lock, flags);
+		return;
+	}
+	softirq_running = true;
+	this_cpu()->in_softirq = true;
+
+	while ((pending = softirq_pending) != 0 && restart-- > 0) {
+		softirq_pending = 0;
+		spin_unlock(&softirq_lock);
+		sti();
+		for (nr = 0; pending != 0; nr++, pending >>= 1) {
+			if ((pending & 1) && softirq_vec[nr] != NULL)
+				softirq_vec[nr]();
+		}
+		cli();
+		spin_lock(&softirq_lock);
+	}
+
+	this_cpu()->in_softirq = false;
+	softirq_running = false;
+	spin_unlock_irqrestore(&softirq_lock, flags);
+}
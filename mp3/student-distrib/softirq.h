@@ -0,0 +1,26 @@
+#ifndef _SOFTIRQ_H
+#define _SOFTIRQ_H
+
+#include "types.h"
+
+/* deferred interrupt work, lower numbers run first. The console goes last so
+it picks up the output of the others in the same pass. */
+#define SOFTIRQ_TIMER		0
+#define SOFTIRQ_KEYBOARD	1
+#define SOFTIRQ_RTC			2
+#define SOFTIRQ_CONSOLE		3
+#define NUM_SOFTIRQ			4
+
+/* passes do_softirq makes over newly raised work before leaving the rest
+for the next interrupt */
+#define SOFTIRQ_MAX_RESTART 8
+
+typedef void (*softirq_handler_t)();
+
+//see c file for more
+extern void init_softirq();
+extern void open_softirq(uint32_t nr, softirq_handler_t handler);
+extern void raise_softirq(uint32_t nr);
+extern void do_softirq();
+
+#endif /* _SOFTIRQ_H */
@@ -0,0 +1,224 @@
+#include "spinlock.h"
+#include "smp.h"
+#include "task.h"
+#include "clock.h"
+#include "report.h"
+
+#define NAME_COLUMN 10
+
+/* every lock that was ever taken, in the order of first use. A slot is
+reserved with an atomic add, so it may still be NULL while its lock is
+filling it in. */
+static spinlock_t* spinlocks[MAX_SPINLOCKS];
+static volatile uint32_t num_spinlocks = 0;
+
+/* function prototypes for internal functions */
+static void spinlock_register(spinlock_t* lock);
+static void render_report(report_t* report);
+
+
+/*
+ * spin_lock
+ *   DESCRIPTION: take a lock, spinning until it is ours. Shootdowns are
+ *				  answered while waiting since the holder may be waiting on
+ *				  us. Interrupts must be off if an interrupt handler can take
+ *				  the same lock, see spin_lock_irqsave.
+ *   INPUTS: lock: the lock to take
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: the lock's statistics updated, the lock is listed in the
+ *				   locks pseudo file on its first use
+ */
+void spin_lock(spinlock_t* lock) {
+	cpu_t* cpu = this_cpu();
+	uint32_t ticket = 1;
+	uint64_t start;
+
+	asm volatile("lock xaddl %0, %1"
+		: "+r"(ticket), "+m"(lock->next_ticket)
+		:
+		: "memory", "cc");
+	if (lock->now_serving != ticket) {
+		start = rdtsc();
+		while (lock->now_serving != ticket) {
+			if (cpu->tlb_flush)
+				smp_flush_tlb_local(cpu);
+			cpu_relax();
+		}
+		lock->stat.contended++;
+		lock->stat.wait_cycles += rdtsc() - start;
+	}
+
+	lock->owner = cpu->id;
+	lock->stat.acquires++;
+	if (!lock->registered)
+		spinlock_register(lock);
+	lock->acquired_at = rdtsc();
+}
+
+/*
+ * spin_unlock
+ *   DESCRIPTION: give a lock to the next waiter
+ *   INPUTS: lock: a lock the caller holds
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: the lock's hold time counted
+ */
+void spin_unlock(spinlock_t* lock) {
+	uint64_t held = rdtsc() - lock->acquired_at;
+
+	lock->stat.hold_cycles += held;
+	if (held > lock->stat.max_hold_cycles)
+		lock->stat.max_hold_cycles = held;
+	lock->owner = ERR;
+	/* stores are not reordered on x86, the compiler must not either */
+	barrier();
+	lock->now_serving++;
+}
+
+/*
+ * spin_lock_held
+ *   DESCRIPTION: check whether the calling processor holds a lock
+ *   INPUTS: lock: the lock to check
+ *   OUTPUTS: none
+ *   RETURN VALUE: true if it does, false otherwise
+ *   SIDE EFFECTS: none
+ */
+int32_t spin_lock_held(spinlock_t* lock) {
+	return lock->owner == this_cpu()->id;
+}
+
+/*
+ * spinlock_register
+ *   DESCRIPTION: list a lock in the locks pseudo file. Called by the holder,
+ *				  so a lock is registered once.
+ *   INPUTS: lock: a lock the caller holds
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: one slot of spinlocks[] taken, if there is one left
+ */
+static void spinlock_register(spinlock_t* lock) {
+	uint32_t slot = 1;
+
+	lock->registered = true;
+	asm volatile("lock xaddl %0, %1"
+		: "+r"(slot), "+m"(num_spinlocks)
+		:
+		: "memory", "cc");
+	if (slot < MAX_SPINLOCKS)
+		spinlocks[slot] = lock;
+}
+
+/*
+ * spinlock_open
+ *   DESCRIPTION: open the locks pseudo file
+ *   INPUTS: fname: unused
+ *   OUTPUTS: none
+ *   RETURN VALUE: always succeeds and returns 0
+ *   SIDE EFFECTS: none
+ */
+int32_t spinlock_open(const uint8_t* fname) {
+	return SUCCESS;
+}
+
+/*
+ * spinlock_close
+ *   DESCRIPTION: close the locks pseudo file
+ *   INPUTS: fd: file descriptor being closed
+ *   OUTPUTS: none
+ *   RETURN VALUE: always succeeds and returns 0
+ *   SIDE EFFECTS: its report given back
+ */
+int32_t spinlock_close(int32_t fd) {
+	report_close(fd);
+	return SUCCESS;
+}
+
+/*
+ * spinlock_read
+ *   DESCRIPTION: read the lock statistics as text - one line per lock with
+ *				  the acquire count, how many of those had to wait, and the
+ *				  total wait, total hold and longest hold time
+ *   INPUTS: fd: file descriptor, its pos is the offset into the report
+ *           nbytes: length in bytes to be read
+ *   OUTPUTS: buf: destination of the data
+ *   RETURN VALUE: number of bytes read, 0 at the end of the report
+ *   SIDE EFFECTS: see report_read
+ */
+int32_t spinlock_read(int32_t fd, void* buf, int32_t nbytes) {
+	return report_read(fd, buf, nbytes, render_report);
+}
+
+/*
+ * spinlock_write
+ *   DESCRIPTION: any write clears the statistics, to measure one workload
+ *   INPUTS: fd, buf: unused
+ *           nbytes: length of the write
+ *   OUTPUTS: none
+ *   RETURN VALUE: nbytes
+ *   SIDE EFFECTS: the counters of every registered lock zeroed
+ */
+int32_t spinlock_write(int32_t fd, const void* buf, int32_t nbytes) {
+	int32_t flags;
+	uint32_t i;
+	spinlock_t* lock;
+
+	for (i = 0; i < num_spinlocks && i < MAX_SPINLOCKS; i++) {
+		if ((lock = spinlocks[i]) == NULL)
+			continue;
+		/* we hold the kernel lock, taking it again would never return */
+		if (spin_lock_held(lock)) {
+			memset(&lock->stat, 0, sizeof(spinlock_stat_t));
+			continue;
+		}
+		spin_lock_irqsave(lock, flags);
+		memset(&lock->stat, 0, sizeof(spinlock_stat_t));
+		spin_unlock_irqrestore(lock, flags);
+	}
+	return nbytes;
+}
+
+/*
+ * render_report
+ *   DESCRIPTION: format the statistics of every registered lock into the
+ *				  report buffer
+ *   INPUTS: report: the report to append to, empty
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: the report's text and len updated
+ */
+static void render_report(report_t* report) {
+	spinlock_stat_t stat;
+	spinlock_t* lock;
+	int32_t flags, j;
+	uint32_t i;
+
+	report_str(report, "lock      acquires contended wait_us hold_us max_hold_us\n");
+	for (i = 0; i < num_spinlocks && i < MAX_SPINLOCKS; i++) {
+		if ((lock = spinlocks[i]) == NULL)
+			continue;
+
+		/* copy under the lock so the line is consistent */
+		if (spin_lock_held(lock)) {
+			stat = lock->stat;
+		} else {
+			spin_lock_irqsave(lock, flags);
+			stat = lock->stat;
+			spin_unlock_irqrestore(lock, flags);
+		}
+
+		report_str(report, lock->name);
+		for (j = strlen(lock->name); j < NAME_COLUMN; j++)
+			report_str(report, " ");
+		report_num(report, stat.acquires);
+		report_str(report, " ");
+		report_num(report, stat.contended);
+		report_str(report, " ");
+		report_num(report, clock_cycles_to_us(stat.wait_cycles));
+		report_str(report, " ");
+		report_num(report, clock_cycles_to_us(stat.hold_cycles));
+		report_str(report, " ");
+		report_num(report, clock_cycles_to_us(stat.max_hold_cycles));
+		report_str(report, "\n");
+	}
+}
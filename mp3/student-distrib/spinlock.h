@@ -0,0 +1,56 @@
+#ifndef _SPINLOCK_H
+#define _SPINLOCK_H
+
+#include "types.h"
+#include "lib.h"
+
+/* most locks the locks pseudo file reports, later ones still work */
+#define MAX_SPINLOCKS 32
+
+/* counters of one lock, kept by whoever holds it */
+typedef struct spinlock_stat {
+	uint32_t acquires;
+	uint32_t contended;			/* acquires that found the lock taken */
+	uint64_t wait_cycles;		/* spent spinning, over all acquires */
+	uint64_t hold_cycles;		/* from acquire to release, over all acquires */
+	uint64_t max_hold_cycles;
+} spinlock_stat_t;
+
+/* a ticket lock, waiters get it in the order they came. Not recursive. */
+typedef struct spinlock {
+	volatile uint32_t next_ticket;
+	volatile uint32_t now_serving;	/* only the holder changes it */
+	volatile int32_t owner;			/* cpus[] index of the holder, or ERR */
+	int32_t registered;				/* listed in the locks pseudo file */
+	const int8_t* name;
+	uint64_t acquired_at;			/* TSC when the holder got it */
+	spinlock_stat_t stat;
+} spinlock_t;
+
+#define SPINLOCK_INIT(lock_name) \
+	{ 0, 0, ERR, false, lock_name, 0, { 0, 0, 0, 0, 0 } }
+
+/* take a lock with interrupts off on this processor, so an interrupt
+handler that takes the same lock cannot deadlock against us */
+#define spin_lock_irqsave(lock, flags)	\
+do {									\
+	cli_and_save(flags);				\
+	spin_lock(lock);					\
+} while (0)
+
+#define spin_unlock_irqrestore(lock, flags)	\
+do {										\
+	spin_unlock(lock);						\
+	restore_flags(flags);					\
+} while (0)
+
+//see c file for more
+extern void spin_lock(spinlock_t* lock);
+extern void spin_unlock(spinlock_t* lock);
+extern int32_t spin_lock_held(spinlock_t* lock);
+extern int32_t spinlock_open(const uint8_t* fname);
+extern int32_t spinlock_read(int32_t fd, void* buf, int32_t nbytes);
+extern int32_t spinlock_write(int32_t fd, const void* buf, int32_t nbytes);
+extern int32_t spinlock_close(int32_t fd);
+
+#endif /* _SPINLOCK_H */
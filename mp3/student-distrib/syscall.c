@@ -10,6 +10,13 @@
 #include "paging.h"
 #include "x86_desc.h"
 #include "interrupt.h"
+#include "timer.h"
+#include "timepage.h"
+#include "clock.h"
+#include "procstat.h"
+#include "fpu.h"
+#include "frame.h"
+#include "syscall_stat.h"
 
 
 /* file system information - size, number of file, etc - bootblock info */
@@ -31,7 +38,10 @@ syscall_func_t syscall_func[NUM_SYSCALLS +
     (syscall_func_t) do_sigreturn,
     (syscall_func_t) do_malloc,
     (syscall_func_t) do_free,
-    (syscall_func_t) do_touch
+    (syscall_func_t) do_touch,
+    (syscall_func_t) do_sleep,
+    (syscall_func_t) do_setitimer,
+    (syscall_func_t) do_clock_gettime
 };
 
 /* stdin fops table */
@@ -76,6 +86,37 @@ static void interrupt_default(int32_t unused) {
 }
 
 
+/* timer callbacks, timer->data is the owning PCB
+ */
+
+static void sleep_timer_expired(timer_t* timer) {
+    ((pcb_t*)timer->data)->sleeping = false;
+}
+
+static void alarm_timer_expired(timer_t* timer) {
+    ((pcb_t*)timer->data)->signal_flag[ALARM] = SIGNAL_PENDING;
+}
+
+
+/*
+ * free_slabs
+ *   DESCRIPTION: give the frames behind a process's malloc slabs back to
+ *                the frame pool, which zeroes them before reuse
+ *   INPUTS: pcb: the process, halting or failing to start
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: the slabs have no frames until the next execute
+ */
+static void free_slabs(pcb_t* pcb) {
+    int32_t i;
+    for (i = 0; i < NUM_SLABS; i++) {
+        if (pcb->slab_cache[i].frame != 0)
+            frame_free(pcb->slab_cache[i].frame);
+        pcb->slab_cache[i].frame = 0;
+    }
+}
+
+
 void* signal_handler_default[NUM_SIGNAL] = {
     div_zero_default,
     segfault_default,
@@ -138,6 +179,36 @@ int32_t init_syscall() {
     return SUCCESS;
 }
 
+/*
+ * init_sysenter
+ *   DESCRIPTION: set up the sysenter/sysexit fast system call path, if the
+ *                processor has it. Programs that use it on a processor
+ *                without it get an invalid opcode exception.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 for success, -1 if sysenter is not supported
+ *   SIDE EFFECTS: writes the SYSENTER MSRs
+ */
+int32_t init_sysenter() {
+    uint32_t eax, ebx, ecx, edx;
+    asm volatile("cpuid"
+        : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx)
+        : "a"(CPUID_FEATURES)
+        : "cc");
+    if (!(edx & CPUID_EDX_SEP))
+        return ERR;
+
+    /* sysexit derives the user segments from this: USER_CS = KERNEL_CS + 16,
+    USER_DS = KERNEL_CS + 24, which is how the GDT is laid out */
+    wrmsr(MSR_SYSENTER_CS, KERNEL_CS);
+    /* the entry stub loads the kernel stack of the running process from the
+    TSS, so the MSR need not change on every context switch. Each processor
+    has its own TSS and MSRs, and calls this for itself. */
+    wrmsr(MSR_SYSENTER_ESP, (uint32_t)&this_cpu()->tss->esp0);
+    wrmsr(MSR_SYSENTER_EIP, (uint32_t)sysenter_entry);
+    return SUCCESS;
+}
+
 /*
  * do_halt
  *   DESCRIPTION: halts the current program with a return value of status 
@@ -170,6 +241,13 @@ int32_t do_halt (uint8_t status) {
         do_close(i);
     }   //close all files other than the preopened ones
 
+    /* nothing may fire on this PCB once it is reused */
+    timer_cancel(&current_pcb[active_task_idx]->sleep_timer);
+    timer_cancel(&current_pcb[active_task_idx]->alarm_timer);
+    /* nor may its FPU registers be saved into it or handed on */
+    fpu_release(current_pcb[active_task_idx]);
+    free_slabs(current_pcb[active_task_idx]);
+
     /* save the parent's pid and kmode stack pointer since we will change the 
     PCB */
     uint32_t parent_pid=current_pcb[active_task_idx]->parent_pid;
@@ -187,11 +265,14 @@ int32_t do_halt (uint8_t status) {
 
     /* restore the parent's stack pointer and PCB */
     current_pcb[active_task_idx]=pcb_array[parent_pid];
-    tss.ss0 = KERNEL_DS;
-    tss.esp0 = parent_esp;
+    this_cpu()->tss->ss0 = KERNEL_DS;
+    this_cpu()->tss->esp0 = parent_esp;
 
     //update paging to the parent's
     update_page_directory(current_pcb[active_task_idx]->pid + PAGE_DIR_USER_IDX_OFFSET);
+    fpu_switch(current_pcb[active_task_idx]);
+    /* the console only stays in direct mode if the parent mapped video too */
+    terminal_sync_direct(active_task_idx);
 
     /* jump back to the exec function call of the parent, copy the return value 
     to eax and zero out upper 24 bits */
@@ -241,6 +322,13 @@ int32_t do_halt_exception () {
         do_close(i);
     }   //close all files other than the preopened ones
 
+    /* nothing may fire on this PCB once it is reused */
+    timer_cancel(&current_pcb[active_task_idx]->sleep_timer);
+    timer_cancel(&current_pcb[active_task_idx]->alarm_timer);
+    /* nor may its FPU registers be saved into it or handed on */
+    fpu_release(current_pcb[active_task_idx]);
+    free_slabs(current_pcb[active_task_idx]);
+
     /* save the parent's pid and kmode stack pointer since we will change the 
     PCB */
     uint32_t parent_pid=current_pcb[active_task_idx]->parent_pid;
@@ -256,11 +344,14 @@ int32_t do_halt_exception () {
 
     /* restore the parent's stack pointer and PCB */
     current_pcb[active_task_idx]=pcb_array[parent_pid];
-    tss.ss0 = KERNEL_DS;
-    tss.esp0 = parent_esp;
+    this_cpu()->tss->ss0 = KERNEL_DS;
+    this_cpu()->tss->esp0 = parent_esp;
 
     //update paging to the parent's
     update_page_directory(current_pcb[active_task_idx]->pid + PAGE_DIR_USER_IDX_OFFSET);
+    fpu_switch(current_pcb[active_task_idx]);
+    /* the console only stays in direct mode if the parent mapped video too */
+    terminal_sync_direct(active_task_idx);
 
     /* jump back to the exec function call of the parent, copy the return value 
     to eax and zero out upper 16 bits */
@@ -394,6 +485,10 @@ int32_t do_execute (const uint8_t* command) {
     //switch current pcb pointer to new pcb pointer, make it alive
     current_pcb[active_task_idx]=new_pcb_ptr;
     current_pcb[active_task_idx]->flag=TASK_ACTIVE;
+    current_pcb[active_task_idx]->syscall_num = 0;
+    current_pcb[active_task_idx]->syscall_calls = 0;
+    current_pcb[active_task_idx]->syscall_cycles = 0;
+    procstat_reset(current_pcb[active_task_idx], fname);
     current_pcb[active_task_idx]->pid=i;
     current_pcb[active_task_idx]->parent_pid=old_pcb_ptr->pid;
     //inherit the current terminal
@@ -405,6 +500,15 @@ int32_t do_execute (const uint8_t* command) {
     current_pcb[active_task_idx]->signal_handler[ALARM] = signal_handler_default[ALARM];
     current_pcb[active_task_idx]->signal_handler[USER1] = signal_handler_default[USER1];
 
+    current_pcb[active_task_idx]->vidmap = false;
+
+    //timers start disarmed, they were cancelled when the slot was last halted
+    current_pcb[active_task_idx]->sleeping = false;
+    init_timer_entry(&current_pcb[active_task_idx]->sleep_timer, sleep_timer_expired,
+        current_pcb[active_task_idx]);
+    init_timer_entry(&current_pcb[active_task_idx]->alarm_timer, alarm_timer_expired,
+        current_pcb[active_task_idx]);
+
     //unmask signals in pcb, important, especially when the previous program terminates by exception
     unmask_signals(active_task_idx);
     unpend_signals(active_task_idx);
@@ -416,28 +520,26 @@ int32_t do_execute (const uint8_t* command) {
     map_mega_page(KERNEL_START, KERNEL_START, current_pcb[active_task_idx]->pid + 
         PAGE_DIR_USER_IDX_OFFSET, KERNEL_DPL);
 
-    map_kilo_page(VIDEO_MEM_START, VIDEO_MEM_START, current_pcb[active_task_idx]->pid + 
-        PAGE_DIR_USER_IDX_OFFSET, KERNEL_DPL);
-    //map al three video memory buffer, each buffer is assigned to a terminal
-    map_kilo_page(VIDEO_BUFFER_BASE, VIDEO_BUFFER_BASE, 
-        current_pcb[active_task_idx]->pid + PAGE_DIR_USER_IDX_OFFSET, KERNEL_DPL);
-    //second video memory buffer
-    map_kilo_page(VIDEO_BUFFER_BASE + VIDEO_MEM_SIZE, VIDEO_BUFFER_BASE + VIDEO_MEM_SIZE, 
-        current_pcb[active_task_idx]->pid + PAGE_DIR_USER_IDX_OFFSET, KERNEL_DPL);
-    //third video memory buffer
-    map_kilo_page(VIDEO_BUFFER_BASE + 2 * VIDEO_MEM_SIZE, VIDEO_BUFFER_BASE + 2 * VIDEO_MEM_SIZE, 
-        current_pcb[active_task_idx]->pid + PAGE_DIR_USER_IDX_OFFSET, KERNEL_DPL);
+    //map the text mode window, the terminals' background buffers are kernel memory
+    map_video_window(current_pcb[active_task_idx]->pid + PAGE_DIR_USER_IDX_OFFSET);
+    //interrupt handlers reach the APIC registers from any address space
+    map_apic_window(current_pcb[active_task_idx]->pid + PAGE_DIR_USER_IDX_OFFSET);
     //map user program image
     map_mega_page(USR_PRG_VIRTUAL_START, USR_PRG_PHY_BASE + (current_pcb[active_task_idx]->pid * 
         DIR_ADDRESSABLE), current_pcb[active_task_idx]->pid + PAGE_DIR_USER_IDX_OFFSET, USR_DPL);
 
+    //malloc slabs get frames the idle loops already zeroed, the pool holds
+    //far more than MAX_PCB * NUM_SLABS so it cannot run out
     for(i = 0; i < NUM_SLABS; i++) {
-        //need to be changed
-        map_kilo_page(USR_PRG_VIRTUAL_END + (i+1) * VIDEO_MEM_SIZE, 32 * MEGA + (i + current_pcb[active_task_idx]->pid * NUM_SLABS) * VIDEO_MEM_SIZE, 
-        current_pcb[active_task_idx]->pid + PAGE_DIR_USER_IDX_OFFSET, USR_DPL);
+        current_pcb[active_task_idx]->slab_cache[i].frame = frame_alloc();
+        map_frame(USR_PRG_VIRTUAL_END + (i+1) * VIDEO_MEM_SIZE, current_pcb[active_task_idx]->slab_cache[i].frame, 
+        current_pcb[active_task_idx]->pid + PAGE_DIR_USER_IDX_OFFSET);
         current_pcb[active_task_idx]->slab_cache[i].bitmap = 0;
         current_pcb[active_task_idx]->slab_cache[i].cache_ptr = (void*) (USR_PRG_VIRTUAL_END + (i+1) * VIDEO_MEM_SIZE);//from map kilo page
     }
+    //map the time page read only, right after the slabs
+    map_kilo_page_read_only(TIME_PAGE_VIRTUAL_START, (uint32_t)time_page, 
+        current_pcb[active_task_idx]->pid + PAGE_DIR_USER_IDX_OFFSET);
 
     update_page_directory(current_pcb[active_task_idx]->pid + PAGE_DIR_USER_IDX_OFFSET);
 
@@ -457,6 +559,7 @@ int32_t do_execute (const uint8_t* command) {
         process's context */
         printf("read error\n");
         do_close(fd);
+        free_slabs(current_pcb[active_task_idx]);
         current_pcb[active_task_idx]=old_pcb_ptr;
         update_page_directory(current_pcb[active_task_idx]->pid + PAGE_DIR_USER_IDX_OFFSET);
         return ERR;
@@ -466,9 +569,13 @@ int32_t do_execute (const uint8_t* command) {
 
     /* update the tss with the kmode stack in the new process, stack offset by 
     4 to avoid accessing next page's base addr */
-    tss.ss0 = KERNEL_DS;
-    tss.esp0 = KERNEL_END - (current_pcb[active_task_idx]->pid * 8 * KILO) - KMODE_STACK_OFFSET;
+    this_cpu()->tss->ss0 = KERNEL_DS;
+    this_cpu()->tss->esp0 = KERNEL_END - (current_pcb[active_task_idx]->pid * 8 * KILO) - KMODE_STACK_OFFSET;
     //see task.c , each Kmode stack + PCB is 8KB large
+    //the parent keeps its FPU registers until the child uses the FPU
+    fpu_switch(current_pcb[active_task_idx]);
+    //execute's latency ends here, not when the parent returns from it
+    syscall_stat_execute_done(old_pcb_ptr);
     // printf("entering user mode\n");
 
     /* the following code is adapted from 
@@ -487,6 +594,9 @@ int32_t do_execute (const uint8_t* command) {
         :
         :"cc");
 
+    /* user mode does not hold the kernel lock, interrupts are still off */
+    kernel_lock_exit();
+
     asm volatile(
         "movw %w0, %%ax;"
 
@@ -734,8 +844,12 @@ int32_t do_getargs (uint8_t* buf, int32_t nbytes) {
 
     /* map the actual video memory to the user virtual page, 
     adjust permissions */
-    map_kilo_page((uint32_t)*screen_start, VIDEO_MEM_START, 
+    map_kilo_page((uint32_t)*screen_start, console_page(active_task_idx), 
         current_pcb[active_task_idx]->pid + PAGE_DIR_USER_IDX_OFFSET, USR_DPL);
+    /* the page is in the terminal's part of the text window, keep the screen 
+    there */
+    current_pcb[active_task_idx]->vidmap = true;
+    terminal_sync_direct(active_task_idx);
     sti();
     return SUCCESS;
  }
@@ -830,6 +944,10 @@ int32_t do_sigreturn() {
     do_close(fd);
 
     pcb_array[pid]->flag=TASK_ACTIVE;
+    pcb_array[pid]->syscall_num = 0;
+    pcb_array[pid]->syscall_calls = 0;
+    pcb_array[pid]->syscall_cycles = 0;
+    procstat_reset(pcb_array[pid], (const uint8_t*)"shell");
     pcb_array[pid]->pid=pid;
 
     pcb_array[pid]->signal_handler[DIV_ZERO] = signal_handler_default[DIV_ZERO];
@@ -838,20 +956,20 @@ int32_t do_sigreturn() {
     pcb_array[pid]->signal_handler[ALARM] = signal_handler_default[ALARM];
     pcb_array[pid]->signal_handler[USER1] = signal_handler_default[USER1];
 
+    pcb_array[pid]->vidmap = false;
+    init_timer_entry(&pcb_array[pid]->sleep_timer, sleep_timer_expired, pcb_array[pid]);
+    init_timer_entry(&pcb_array[pid]->alarm_timer, alarm_timer_expired, pcb_array[pid]);
+
     //map kernel page
     map_mega_page(KERNEL_START, KERNEL_START, pid + PAGE_DIR_USER_IDX_OFFSET, KERNEL_DPL);
-    //map vieo memory
-    map_kilo_page(VIDEO_MEM_START, VIDEO_MEM_START, pid + PAGE_DIR_USER_IDX_OFFSET, KERNEL_DPL);
-    //map all three video memory buffer, each buffer is assigned to a terminal
-    map_kilo_page(VIDEO_BUFFER_BASE, VIDEO_BUFFER_BASE, pid + PAGE_DIR_USER_IDX_OFFSET, KERNEL_DPL);
-    //second video memory buffer
-    map_kilo_page(VIDEO_BUFFER_BASE + VIDEO_MEM_SIZE, VIDEO_BUFFER_BASE + VIDEO_MEM_SIZE, 
-        pid + PAGE_DIR_USER_IDX_OFFSET, KERNEL_DPL);
-    //third video memory buffer
-    map_kilo_page(VIDEO_BUFFER_BASE + 2 * VIDEO_MEM_SIZE, VIDEO_BUFFER_BASE + 2 * VIDEO_MEM_SIZE, 
-        pid + PAGE_DIR_USER_IDX_OFFSET, KERNEL_DPL);
+    //map the text mode window
+    map_video_window(pid + PAGE_DIR_USER_IDX_OFFSET);
+    //map the APIC registers
+    map_apic_window(pid + PAGE_DIR_USER_IDX_OFFSET);
     //map user program page
     map_mega_page(USR_PRG_VIRTUAL_START, USR_PRG_PHY_BASE + pid * DIR_ADDRESSABLE, pid + PAGE_DIR_USER_IDX_OFFSET, USR_DPL);
+    //map the time page read only
+    map_kilo_page_read_only(TIME_PAGE_VIRTUAL_START, (uint32_t)time_page, pid + PAGE_DIR_USER_IDX_OFFSET);
     //flush TLB
     update_page_directory(pid + PAGE_DIR_USER_IDX_OFFSET);
 
@@ -944,9 +1062,12 @@ int32_t do_sigreturn() {
         "pushl $0;"  /* stored ebp for the pit handler */
         "movw %w0, %%cx;"
         "movw %%cx, %%ds;"
+        /* this_cpu reads through %gs */
+        "movw %w1, %%cx;"
+        "movw %%cx, %%gs;"
         :
-        : "r"(KERNEL_DS)
-        : "cc");
+        : "r"(KERNEL_DS), "r"(KERNEL_PERCPU)
+        : "cc", "ecx");
 
     /* save the new shell's inital esp and ebp */
     asm volatile(
@@ -1012,3 +1133,88 @@ int32_t do_touch(const uint8_t* filename) {
 
     return filesystem_touch(filename);
 }
+
+/*
+ * do_sleep
+ *   DESCRIPTION: block the calling process for at least ms milliseconds. The
+ *                wait is driven by the timer wheel, so it costs nothing per
+ *                tick until it expires. A pending signal cuts the wait short.
+ *   INPUTS: ms: time to sleep in milliseconds
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 if the full time elapsed, otherwise the number of
+ *                 milliseconds left when a signal interrupted the sleep,
+ *                 -1 for fail
+ *   SIDE EFFECTS: arms the sleep timer of the current PCB
+ */
+int32_t do_sleep(uint32_t ms) {
+    pcb_t* pcb = current_pcb[active_task_idx];
+
+    /* no process is running, should not occur */
+    if(!pcb) {
+        return ERR;
+    }
+
+    if (ms == 0)
+        return SUCCESS;
+
+    int32_t flags;
+    cli_and_save(flags);
+    pcb->sleeping = true;
+    timer_arm(&pcb->sleep_timer, timer_ms_to_ticks(ms), 0);
+    restore_flags(flags);
+
+    /* block until the timer fires - interrupts are on in syscalls, so the
+    pit keeps scheduling the other terminals meanwhile */
+    pcb->blocked = true;
+    while (pcb->sleeping) {
+        int32_t i;
+        kernel_lock_relax();
+        for (i = 0; i < NUM_SIGNAL; i++) {
+            if (pcb->signal_flag[i] == SIGNAL_PENDING &&
+                pcb->signal_mask[i] == SIGNAL_MASK_OFF)
+                break;
+        }
+        if (i < NUM_SIGNAL)
+            break;
+    }
+    pcb->blocked = false;
+
+    if (!pcb->sleeping)
+        return SUCCESS;
+
+    /* interrupted by a signal, report the time left */
+    uint32_t remaining = timer_ticks_to_ms(timer_remaining(&pcb->sleep_timer));
+    timer_cancel(&pcb->sleep_timer);
+    pcb->sleeping = false;
+    return remaining;
+}
+
+/*
+ * do_setitimer
+ *   DESCRIPTION: arm the per-process interval timer, which raises ALARM on
+ *                the calling process when it expires
+ *   INPUTS: value_ms: milliseconds until the first ALARM, 0 disarms the timer
+ *           interval_ms: milliseconds between later ALARMs, 0 for one ALARM
+ *   OUTPUTS: none
+ *   RETURN VALUE: milliseconds that were left on the previous setting,
+ *                 -1 for fail
+ *   SIDE EFFECTS: arms or cancels the alarm timer of the current PCB
+ */
+int32_t do_setitimer(uint32_t value_ms, uint32_t interval_ms) {
+    pcb_t* pcb = current_pcb[active_task_idx];
+
+    /* no process is running, should not occur */
+    if(!pcb) {
+        return ERR;
+    }
+
+    uint32_t remaining = timer_ticks_to_ms(timer_remaining(&pcb->alarm_timer));
+
+    if (value_ms == 0)
+        timer_cancel(&pcb->alarm_timer);
+    else
+        timer_arm(&pcb->alarm_timer, timer_ms_to_ticks(value_ms),
+            interval_ms == 0 ? 0 : timer_ms_to_ticks(interval_ms));
+
+    return remaining;
+}
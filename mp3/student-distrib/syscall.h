@@ -3,7 +3,7 @@
 #include "types.h"
 #include "filesystem.h"
 
-#define NUM_SYSCALLS 13
+#define NUM_SYSCALLS 16
 
 /* filesystem file descriptor flag bitmasks */
 #define CLEAR_ALL_FLAGS 0x00
@@ -11,6 +11,7 @@
 #define FLAG_RTC 0x02
 #define FLAG_FILE 0x04
 #define FLAG_DIR 0x08
+#define FLAG_DEV 0x10
 #define FILE_ARRAY_LENGTH 8
 #define USR_PRG_VIRTUAL_START (128 * MEGA)
 #define USR_PRG_VIRTUAL_END (132 * MEGA)
@@ -58,12 +59,20 @@
 // for accessing jump table operations
 #define EXCEPTION_RETVAL 256
 
+/* sysenter setup */
+#define CPUID_FEATURES 1
+#define CPUID_EDX_SEP (1 << 11)
+#define MSR_SYSENTER_CS 0x174
+#define MSR_SYSENTER_ESP 0x175
+#define MSR_SYSENTER_EIP 0x176
+
 #define TWENTY_HIGH_BIT_MASK	0xFFFFF000		/* mask to get 20 high bits of linear address */
 
 typedef int32_t (*syscall_func_t)();
 
 //see c file for more
 extern int32_t init_syscall();
+extern int32_t init_sysenter();
 
 extern int32_t do_halt(uint8_t status);
 extern int32_t do_halt_exception();
@@ -81,6 +90,8 @@ extern int32_t do_close(int32_t fd);
 extern void* do_malloc(int32_t size);
 extern int32_t do_free(void* ptr);
 extern int32_t do_touch(const uint8_t* filename);
+extern int32_t do_sleep(uint32_t ms);
+extern int32_t do_setitimer(uint32_t value_ms, uint32_t interval_ms);
 
 
 extern int32_t launch_shell (uint32_t pid);
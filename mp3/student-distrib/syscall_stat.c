@@ -0,0 +1,245 @@
+#include "syscall_stat.h"
+#include "lib.h"
+#include "task.h"
+#include "clock.h"
+#include "trace.h"
+#include "report.h"
+
+#define NAME_COLUMN 14
+
+/* indexed by syscall number, entry 0 unused like in syscall_func */
+static syscall_stat_t syscall_stats[NUM_SYSCALLS + 1];
+
+static const int8_t* syscall_names[NUM_SYSCALLS + 1] = {
+	"", "halt", "execute", "read", "write", "open", "close", "getargs",
+	"vidmap", "set_handler", "sigreturn", "malloc", "free", "touch", "sleep",
+	"setitimer", "clock_gettime"
+};
+
+/* syscall_names index of execute, whose latency ends when the child starts */
+#define SYSCALL_EXECUTE 2
+/* syscall_start once the latency of the syscall in progress is recorded */
+#define SYSCALL_STAT_RECORDED 0
+
+/* function prototypes for internal functions */
+static void record_latency(pcb_t* pcb);
+static void render_report(report_t* report);
+
+
+/*
+ * syscall_stat_enter
+ *   DESCRIPTION: count a syscall and start timing it. Called by the
+ *				  dispatcher in interrupt.S once the number is validated.
+ *   INPUTS: num: syscall number
+ *           arg1: first syscall argument - the dispatcher pushes only the
+ *                 number, so this is the saved ebx sitting above it
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: the start time is kept in the PCB - a process makes one
+ *				   syscall at a time, so it cannot be overwritten early
+ */
+void syscall_stat_enter(uint32_t num, uint32_t arg1) {
+	pcb_t* pcb = current_pcb[active_task_idx];
+
+	trace_event(TRACE_SYSCALL_ENTER, num, arg1);
+
+	syscall_stats[num].calls++;
+	if (pcb == NULL)
+		return;
+	pcb->syscall_num = num;
+	pcb->syscall_calls++;
+	pcb->syscall_start = clock_cycles();
+}
+
+/*
+ * syscall_stat_exit
+ *   DESCRIPTION: record the latency of the syscall that is returning.
+ *				  Called by the dispatcher in interrupt.S.
+ *   INPUTS: retval: what the syscall returned
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: updates the histogram of the syscall and the PCB totals
+ */
+void syscall_stat_exit(int32_t retval) {
+	pcb_t* pcb = current_pcb[active_task_idx];
+	if (pcb == NULL || pcb->syscall_num == 0)
+		return;
+
+	trace_event(TRACE_SYSCALL_EXIT, pcb->syscall_num, retval);
+
+	/* an execute that started its child was recorded back then */
+	if (pcb->syscall_start != SYSCALL_STAT_RECORDED)
+		record_latency(pcb);
+	pcb->syscall_num = 0;
+}
+
+/*
+ * syscall_stat_execute_done
+ *   DESCRIPTION: record the latency of an execute when the child is about
+ *				  to enter user mode. The parent's execute only returns when
+ *				  the child halts, timing it until then would measure how
+ *				  long the child ran.
+ *   INPUTS: parent: the process that called execute
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: updates the execute histogram and the parent's totals.
+ *				   The execute stays in progress for the parent.
+ */
+void syscall_stat_execute_done(pcb_t* parent) {
+	/* the kernel also executes shells itself, from halt and at boot */
+	if (parent == NULL || parent->syscall_num != SYSCALL_EXECUTE ||
+		parent->syscall_start == SYSCALL_STAT_RECORDED)
+		return;
+
+	record_latency(parent);
+	parent->syscall_start = SYSCALL_STAT_RECORDED;
+}
+
+/*
+ * record_latency
+ *   DESCRIPTION: add the time since a process entered its syscall in
+ *				  progress to that syscall's histogram
+ *   INPUTS: pcb: the process
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: updates the histogram of the syscall and the PCB totals
+ */
+static void record_latency(pcb_t* pcb) {
+	uint64_t cycles = clock_cycles() - pcb->syscall_start;
+	syscall_stat_t* stat = &syscall_stats[pcb->syscall_num];
+
+	/* log2 bucket from the highest set bit */
+	uint32_t bucket = 0, high = (uint32_t)(cycles >> 32), low = (uint32_t)cycles;
+	if (high != 0) {
+		asm("bsrl %1, %0" : "=r"(bucket) : "rm"(high) : "cc");
+		bucket += 32;
+	} else if (low != 0) {
+		asm("bsrl %1, %0" : "=r"(bucket) : "rm"(low) : "cc");
+	}
+
+	int32_t flags;
+	cli_and_save(flags);
+	stat->returns++;
+	stat->cycles += cycles;
+	stat->hist[bucket]++;
+	pcb->syscall_cycles += cycles;
+	restore_flags(flags);
+}
+
+/*
+ * syscall_stat_open
+ *   DESCRIPTION: open the syscall statistics pseudo file
+ *   INPUTS: fname: unused
+ *   OUTPUTS: none
+ *   RETURN VALUE: always succeeds and returns 0
+ *   SIDE EFFECTS: none
+ */
+int32_t syscall_stat_open(const uint8_t* fname) {
+	return SUCCESS;
+}
+
+/*
+ * syscall_stat_close
+ *   DESCRIPTION: close the syscall statistics pseudo file
+ *   INPUTS: fd: file descriptor being closed
+ *   OUTPUTS: none
+ *   RETURN VALUE: always succeeds and returns 0
+ *   SIDE EFFECTS: its report given back
+ */
+int32_t syscall_stat_close(int32_t fd) {
+	report_close(fd);
+	return SUCCESS;
+}
+
+/*
+ * syscall_stat_read
+ *   DESCRIPTION: read the statistics as text - one line per syscall with
+ *				  the call count, average latency and the non-empty
+ *				  histogram buckets as log2(cycles):count, then the totals
+ *				  of each live process
+ *   INPUTS: fd: file descriptor, its pos is the offset into the report
+ *           nbytes: length in bytes to be read
+ *   OUTPUTS: buf: destination of the data
+ *   RETURN VALUE: number of bytes read, 0 at the end of the report
+ *   SIDE EFFECTS: see report_read
+ */
+int32_t syscall_stat_read(int32_t fd, void* buf, int32_t nbytes) {
+	return report_read(fd, buf, nbytes, render_report);
+}
+
+/*
+ * syscall_stat_write
+ *   DESCRIPTION: any write clears the statistics, to measure one workload
+ *   INPUTS: fd, buf: unused
+ *           nbytes: length of the write
+ *   OUTPUTS: none
+ *   RETURN VALUE: nbytes
+ *   SIDE EFFECTS: all syscall and process totals zeroed
+ */
+int32_t syscall_stat_write(int32_t fd, const void* buf, int32_t nbytes) {
+	int32_t flags, i;
+	cli_and_save(flags);
+	memset(syscall_stats, 0, sizeof(syscall_stats));
+	for (i = 0; i < MAX_PCB; i++) {
+		pcb_array[i]->syscall_calls = 0;
+		pcb_array[i]->syscall_cycles = 0;
+	}
+	restore_flags(flags);
+	return nbytes;
+}
+
+/*
+ * render_report
+ *   DESCRIPTION: format a snapshot of the statistics into the report buffer
+ *   INPUTS: report: the report to append to, empty
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: the report's text and len updated
+ */
+static void render_report(report_t* report) {
+	static syscall_stat_t snapshot[NUM_SYSCALLS + 1];
+	int32_t flags, i, j;
+
+	/* copy first so the formatting runs with interrupts on */
+	cli_and_save(flags);
+	memcpy(snapshot, syscall_stats, sizeof(snapshot));
+	restore_flags(flags);
+
+	report_str(report, "syscall       calls avg_us log2(cycles):count\n");
+	for (i = 1; i <= NUM_SYSCALLS; i++) {
+		if (snapshot[i].calls == 0)
+			continue;
+
+		report_str(report, syscall_names[i]);
+		for (j = strlen(syscall_names[i]); j < NAME_COLUMN; j++)
+			report_str(report, " ");
+		report_num(report, snapshot[i].calls);
+		report_str(report, " ");
+		if (snapshot[i].returns != 0)
+			report_num(report, clock_cycles_to_us(snapshot[i].cycles) / 
+				snapshot[i].returns);
+		else
+			report_str(report, "-");
+		for (j = 0; j < SYSCALL_STAT_BUCKETS; j++) {
+			if (snapshot[i].hist[j] == 0)
+				continue;
+			report_str(report, " ");
+			report_num(report, j);
+			report_str(report, ":");
+			report_num(report, snapshot[i].hist[j]);
+		}
+		report_str(report, "\n");
+	}
+
+	report_str(report, "pid calls total_us\n");
+	for (i = 0; i < MAX_PCB; i++) {
+		if (pcb_array[i]->flag == TASK_NOT_PRESENT)
+			continue;
+		report_num(report, i);
+		report_str(report, " ");
+		report_num(report, pcb_array[i]->syscall_calls);
+		report_str(report, " ");
+		report_num(report, clock_cycles_to_us(pcb_array[i]->syscall_cycles));
+		report_str(report, "\n");
+	}
+}
@@ -0,0 +1,28 @@
+#ifndef _SYSCALL_STAT_H
+#define _SYSCALL_STAT_H
+
+#include "types.h"
+#include "syscall.h"
+
+/* latency histogram bucket k counts calls that took [2^k, 2^(k+1)) cycles */
+#define SYSCALL_STAT_BUCKETS 64
+
+typedef struct syscall_stat {
+	uint32_t calls;
+	uint32_t returns;		/* halt never returns, execute counts when the child starts */
+	uint64_t cycles;		/* total over all returns */
+	uint32_t hist[SYSCALL_STAT_BUCKETS];
+} syscall_stat_t;
+
+struct pcb_n;
+
+//see c file for more
+extern void syscall_stat_enter(uint32_t num, uint32_t arg1);
+extern void syscall_stat_exit(int32_t retval);
+extern void syscall_stat_execute_done(struct pcb_n* parent);
+extern int32_t syscall_stat_open(const uint8_t* fname);
+extern int32_t syscall_stat_read(int32_t fd, void* buf, int32_t nbytes);
+extern int32_t syscall_stat_write(int32_t fd, const void* buf, int32_t nbytes);
+extern int32_t syscall_stat_close(int32_t fd);
+
+#endif /* _SYSCALL_STAT_H */
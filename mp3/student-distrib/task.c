@@ -2,6 +2,7 @@
 #include "terminal.h"
 #include "lib.h"
 #include "x86_desc.h"
+#include "trace.h"
 
 
 // Important!!!!!!!! the first pcb pointer correspond to the base shell of three terminals
@@ -12,9 +13,6 @@ pcb_t* current_pcb[NUM_TERMINAL];
 /* array to all PCBs maximum is 6 simultaneous processes */
 pcb_t* pcb_array[MAX_PCB];
 
-//currently executing task 
-int32_t active_task_idx=ERR;
-
 //asm(".globl check_signals")
 
 /*
@@ -86,6 +84,8 @@ static void handle_signal(uint32_t signum) {
 		return;
 
 	mask_signals(active_task_idx);
+	trace_event(TRACE_SIGNAL, signum,
+		(uint32_t)current_pcb[active_task_idx]->signal_handler[signum]);
 
 	uint32_t ebp, new_usr_stack_top, context_top, cs;
 
@@ -8,6 +8,9 @@
 #include "paging.h"
 #include "terminal.h"
 #include "lib.h"
+#include "timer.h"
+#include "smp.h"
+#include "fpu.h"
 
 #define FILE_ARRAY_LENGTH 8
 #define REGISTERS_NUM 8
@@ -46,6 +49,9 @@
 #define ESP_OFFSET 52
 #define SS_OFFSET 56
 
+//file name length + null, defined here to avoid recursive include
+#define PROC_NAME_LEN 33
+
 //for malloc
 #define NUM_SLABS 4
 
@@ -53,6 +59,7 @@ struct inode_n;
 struct file_desc_n;
 struct all_regs;
 struct pcb_n;
+struct report_n;
 
 typedef struct operations_n {
 	int32_t (*open)();
@@ -65,6 +72,7 @@ typedef struct file_desc_n {
 	uint32_t flags;
 	uint32_t pos;
 	struct inode_n *inode;
+	struct report_n *report;	/* text of a statistics pseudo file */
 	operations_t operations;
 } file_desc_t;
 
@@ -72,6 +80,7 @@ typedef struct slab_n
 {
 	int32_t bitmap;
 	void* cache_ptr;
+	uint32_t frame;		/* physical address, from frame_alloc */
 } slab_t;
 
 typedef struct pcb_n {
@@ -89,7 +98,14 @@ typedef struct pcb_n {
 	volatile int32_t using_rtc;
 	volatile uint32_t rtc_counter;
 	volatile int32_t rtc_freq;
-	volatile int32_t rtc_interrupt_occurred;
+	/* periods elapsed since the last rtc_read, reported and cleared by it */
+	volatile uint32_t rtc_periods;
+
+	/* sleep syscall - cleared by sleep_timer when it fires */
+	volatile int32_t sleeping;
+	timer_t sleep_timer;
+	/* setitimer syscall - raises ALARM on this process */
+	timer_t alarm_timer;
 
 	uint32_t signal_flag[NUM_SIGNAL];
 	uint32_t signal_mask[NUM_SIGNAL];
@@ -98,13 +114,37 @@ typedef struct pcb_n {
 	file_desc_t file_descriptors[FILE_ARRAY_LENGTH];
 
 	slab_t slab_cache[NUM_SLABS];
+	/* set once the program maps video memory with vidmap */
+	int32_t vidmap;
+
+	/* syscall statistics, see syscall_stat.c */
+	uint32_t syscall_num;		/* syscall in progress, 0 for none */
+	uint64_t syscall_start;		/* TSC when it was entered */
+	uint32_t syscall_calls;		/* totals since the process started */
+	uint64_t syscall_cycles;
+
+	/* cpu accounting, see procstat.c */
+	uint8_t name[PROC_NAME_LEN];		/* program name */
+	uint32_t start_tick;		/* timer tick at exec */
+	uint32_t user_ticks;		/* ticks that interrupted user code */
+	uint32_t kernel_ticks;		/* ticks that interrupted the kernel */
+	uint32_t idle_ticks;		/* ticks spent spinning in a blocking call */
+	uint32_t switches;			/* times the scheduler switched away */
+	uint32_t page_faults;
+	/* set while spinning in a blocking call, so the wait is not cpu time */
+	volatile int32_t blocked;
+
+	/* lazy FPU switching, see fpu.c */
+	int32_t fpu_used;			/* the program has touched the FPU */
+	uint8_t fpu_state[FPU_STATE_SIZE] __attribute__((aligned (FPU_STATE_ALIGN)));
 	
 } pcb_t;
 
 // Important!!!!!!!! the first three pcb pointer correspond to the base shell of three terminals
 extern pcb_t* pcb_array[MAX_PCB];
 extern pcb_t* current_pcb[NUM_TERMINAL];
-extern int32_t active_task_idx;
+/* terminal whose task the calling processor runs */
+#define active_task_idx (this_cpu()->task_idx)
 
 extern uint32_t get_cur_pid();
 extern void init_pcb();
@@ -4,6 +4,7 @@
 #include "syscall.h"
 #include "i8259.h"
 #include "task.h"
+#include "spinlock.h"
 
 /* screen printing constants */
 #define SCREEN_START_X 0
@@ -27,6 +28,9 @@
 /* max valid file descriptor */
 #define FD_MAX 8
 
+/* terminal_write holds the console lock for at most this many characters */
+#define WRITE_SPAN_LEN 256
+
 /* scancode map, scan set 1. Normal, then Shift, then Caps, then Shift + Caps */
 static uint8_t key_map[NEW_FIRST_KEYS] = {
     '\0', '\0', '1', '2', '3', '4', '5', '6', '7', '8', '9',
@@ -58,6 +62,9 @@ static uint8_t key_map[NEW_FIRST_KEYS] = {
 static terminal_state_t terminal_state[NUM_TERMINAL];
 /* index of currently displayed terminal */
 int32_t active_terminal_idx = 0;
+/* guards terminal_state and active_terminal_idx, taken before the console
+lock when both are needed */
+static spinlock_t terminal_lock = SPINLOCK_INIT("terminal");
 
 /* function prototypes for internal functions */
 static void clear_buffer(uint32_t terminal_idx);
@@ -98,76 +105,33 @@ static void clear_buffer(uint32_t terminal_idx) {
 static void init_terminal_idx(uint32_t terminal_idx) {
     if (terminal_idx >= NUM_TERMINAL)
         return;
-    // Terminal 0 always defaults to being open.
-    if (terminal_idx==TERM_0) {
+    // Terminal 0 always defaults to being open, and keeps the boot messages
+    if (terminal_idx==TERM_0)
         terminal_state[terminal_idx].open=true;
-        int32_t flags;
-        cli_and_save(flags);
-        terminal_state[terminal_idx].cursor_y=get_screen_y();
-        terminal_state[terminal_idx].cursor_x=get_screen_x();
-        restore_flags(flags);
-    }
-    else
+    else {
         terminal_state[terminal_idx].open=false;
-    //set video_buffer
-    terminal_state[terminal_idx].video_buffer = (int8_t*)(VIDEO_BUFFER_BASE + terminal_idx * VIDEO_MEM_SIZE);
+        console_clear(terminal_idx);
+    }
     clear_buffer(terminal_idx);
 }
 
 /*
- * get_terminal_vid_buffer
- *   DESCRIPTION: none
- *   INPUTS: none
- *   OUTPUTS: video_buffer
- *   RETURN VALUE: none
- *   SIDE EFFECTS: none
- */
-int8_t* get_terminal_vid_buffer(uint32_t terminal_idx) {
-    return terminal_state[terminal_idx].video_buffer;
-}
-
-
-/*
- * save_screen
- *   DESCRIPTION: Save the current screen of the terminal to its internal
- *                buffer. Save the cursor location.
- *   INPUTS: none
- *   OUTPUTS: none
- *   RETURN VALUE: none
- *   SIDE EFFECTS: Reads from video RAM.
- */
- void save_screen() {
-    int32_t flags;
-    cli_and_save(flags);
-    //save screen bytes
-    memcpy(terminal_state[active_terminal_idx].video_buffer, (int8_t*)VIDEO, VIDEO_MEM_SIZE);
-
-    //Save cursor loc
-    terminal_state[active_terminal_idx].cursor_y=get_screen_y();
-    terminal_state[active_terminal_idx].cursor_x=get_screen_x();
-
-    restore_flags(flags);
-}
-
-/*
- * restore_screen
- *   DESCRIPTION: restore screen to video buffer
- *   INPUTS: terminal_idx
+ * terminal_sync_direct
+ *   DESCRIPTION: keep a terminal's console in direct mode while its program
+ *                has video memory mapped, see console_set_direct
+ *   INPUTS: terminal_idx: terminal whose program may have changed
  *   OUTPUTS: none
  *   RETURN VALUE: none
- *   SIDE EFFECTS: update cursor
+ *   SIDE EFFECTS: console mode may change
  */
- void restore_screen(uint32_t terminal_idx) {
-    int32_t flags;
-    cli_and_save(flags);
-    /* rewrite the terminal with the data from the target terminal */
-    memcpy((int8_t*)VIDEO, terminal_state[terminal_idx].video_buffer, VIDEO_MEM_SIZE);
-    update_cursor(terminal_state[terminal_idx].cursor_y, terminal_state[terminal_idx].cursor_x);
-    restore_flags(flags);
+void terminal_sync_direct(uint32_t terminal_idx) {
+    if (terminal_idx >= NUM_TERMINAL)
+        return;
+    console_set_direct(terminal_idx, current_pcb[terminal_idx] != NULL && 
+        current_pcb[terminal_idx]->vidmap);
 }
 
 
-
 /*
  * init_terminal
  *   DESCRIPTION: initialize all terminals - default initalize 3 terminals, and 
@@ -193,8 +157,8 @@ void init_terminal() {
  *   INPUTS: terminal_idx: the idx of the terminal
  *   OUTPUTS: none
  *   RETURN VALUE: none
- *   SIDE EFFECTS: terminal switched, current terminal's buffers modified.
- *                 video RAM reloaded with data from target terminal's buffer
+ *   SIDE EFFECTS: terminal switched, the target terminal's console is put
+ *                 on display
  */
 void switch_terminal(uint32_t terminal_idx) {
     if (terminal_idx >= NUM_TERMINAL)
@@ -202,27 +166,17 @@ void switch_terminal(uint32_t terminal_idx) {
     /* do nothing if it is already the active one */
     if (terminal_idx == active_terminal_idx)
         return;
-    /* save the current screen bytes to the internal buffer of the
-    current terminal */
-    
     int32_t flags;
-    cli_and_save(flags);
-    //diable interrupts, especially from pit
-    save_screen();
-
-    map_kilo_page(USR_VIDMAP_VIRTUAL_START, (uint32_t)terminal_state[active_terminal_idx].video_buffer,
-        current_pcb[active_terminal_idx]->pid + PAGE_DIR_USER_IDX_OFFSET, USR_DPL);
-
+    spin_lock_irqsave(&terminal_lock, flags);
     /* set the current terminal to the one we want to switch to */
     active_terminal_idx=terminal_idx;
 
-    /* rewrite the terminal with the data from the target terminal */
-    restore_screen(terminal_idx);
-
-    map_kilo_page(USR_VIDMAP_VIRTUAL_START, VIDEO_MEM_START,
-        current_pcb[active_terminal_idx]->pid + PAGE_DIR_USER_IDX_OFFSET, USR_DPL);
+    /* every terminal draws into its own part of video memory all the time,
+    and vidmap maps a program its own terminal's page - so only the display
+    start and the cursor move */
+    console_show(terminal_idx);
 
-    restore_flags(flags);
+    spin_unlock_irqrestore(&terminal_lock, flags);
 }
 
 
@@ -272,10 +226,13 @@ int32_t terminal_read (int32_t fd, void* buf, int32_t nbytes) {
         return ERR;
 
     /* block until user presses enter */
-    while (terminal_state[active_task_idx].enter_pressed==false);
+    current_pcb[active_task_idx]->blocked = true;
+    while (terminal_state[active_task_idx].enter_pressed==false)
+        kernel_lock_relax();
+    current_pcb[active_task_idx]->blocked = false;
 
     int32_t flags;
-    cli_and_save(flags);
+    spin_lock_irqsave(&terminal_lock, flags);
     /* read as many bytes as possible */
     uint32_t boundary = nbytes > terminal_state[active_task_idx].buffer_end_location 
         - terminal_state[active_task_idx].read_location ? 
@@ -295,7 +252,7 @@ int32_t terminal_read (int32_t fd, void* buf, int32_t nbytes) {
     if(terminal_state[active_task_idx].read_location >= terminal_state[active_task_idx].buffer_end_location-1) {
         clear_buffer(active_task_idx);
     }
-    restore_flags(flags);
+    spin_unlock_irqrestore(&terminal_lock, flags);
     
     return boundary;
 }
@@ -315,23 +272,18 @@ int32_t terminal_write (int32_t fd, const void* buf, int32_t nbytes) {
     /* validate the file descriptor/ pointer to buf */
     if (fd < 0 || fd >= FD_MAX || buf == NULL)
         return ERR;
-    int32_t i;
+    int32_t i, len;
     uint8_t* buff = (uint8_t*)buf;
 
-    /* print all characters - screen printing routines take care of advancing 
-    screen so no risk of overflow */
-    int32_t flags;
-    cli_and_save(flags);
+    /* print the characters in spans - screen printing routines take care of
+    advancing screen so no risk of overflow. console_write only takes the
+    console lock for one span at a time, and the terminal on screen may
+    change in between. */
     //assume terminal write never write backspace, since backspace can only be typed by user
-    for (i=0; i<nbytes; i++) {
-        if (active_terminal_idx == active_task_idx)
-            putc(buff[i]);
-        else
-            putchar(buff[i], terminal_state[active_task_idx].video_buffer, 
-                    &(terminal_state[active_task_idx].cursor_x), 
-                    &(terminal_state[active_task_idx].cursor_y));
+    for (i=0; i<nbytes; i+=len) {
+        len = nbytes - i < WRITE_SPAN_LEN ? nbytes - i : WRITE_SPAN_LEN;
+        console_write(active_task_idx, buff + i, len);
     }
-    restore_flags(flags);
     return nbytes;
 }
 
@@ -352,6 +304,30 @@ static uint32_t buffer_char(uint8_t key) {
         (key==55 || key==57)); /* is key <space> or a control character */
 }
 
+/*
+ * terminal_key_char
+ *   DESCRIPTION: translate the last key pressed to the character it types
+ *                with the current shift and caps lock state
+ *   INPUTS: keyboard_state: the state of the keyboard
+ *   OUTPUTS: none
+ *   RETURN VALUE: the character, 0 if the key has none
+ *   SIDE EFFECTS: none
+ */
+uint8_t terminal_key_char(keyboard_state_t keyboard_state) {
+    uint32_t key = keyboard_state.last_key;
+    if (key == 0 || key >= FIRST_KEYS)
+        return 0;
+
+    if ((!keyboard_state.caps_lock_on)&&(!keyboard_state.shift_on))
+        return key_map[key];                    //no shift no cap
+    else if ((!keyboard_state.shift_on)&&(keyboard_state.caps_lock_on))
+        return key_map[key + FIRST_KEYS];       //no shift but cap
+    else if ((keyboard_state.shift_on)&&(keyboard_state.caps_lock_on))
+        return key_map[key + THIRD_KEYS];       //shift and cap
+    else
+        return key_map[key + SECOND_KEYS];      //shift but no cap
+}
+
 
 
 /*
@@ -364,8 +340,10 @@ static uint32_t buffer_char(uint8_t key) {
  */
 void keyboard_to_terminal (keyboard_state_t keyboard_state) {
     int32_t flags;
-    cli_and_save(flags);
+    spin_lock_irqsave(&terminal_lock, flags);
 
+    /* echo with putc, not printf - the echo must be on screen before a
+    following backspace erases it, printf output only shows up a tick later */
     // key pressed
     if (keyboard_state.last_key>0 && keyboard_state.last_key<FIRST_KEYS) {
         uint32_t current='\0';
@@ -395,7 +373,7 @@ void keyboard_to_terminal (keyboard_state_t keyboard_state) {
             /* so that we also copy the newline inserted at index 127, i.e. the 
             128th character in the buffer */
             terminal_state[active_terminal_idx].buffer_location=0;
-            printf("%c", key_map[(uint32_t)(keyboard_state.last_key)]);
+            putc(key_map[(uint32_t)(keyboard_state.last_key)]);
         }
 
         /* cntl+l -> should clear the screen */
@@ -408,25 +386,8 @@ void keyboard_to_terminal (keyboard_state_t keyboard_state) {
             terminal_state[active_terminal_idx].buffer_location<BUFFER_LEN - 1){
             /* ignore non-newline characters after buffer already has 127 
             characters*/
-            if ((!keyboard_state.caps_lock_on)&&(!keyboard_state.shift_on)) {
-                printf("%c", key_map[(uint32_t)(keyboard_state.last_key)]);
-                current=key_map[(uint32_t)(keyboard_state.last_key)];
-            }   //no shift no cap
-            else if ((!keyboard_state.shift_on)&&(keyboard_state.caps_lock_on)) {
-                printf("%c", key_map[(uint32_t)(keyboard_state.last_key) + 
-                    FIRST_KEYS]);
-                current=key_map[(uint32_t)(keyboard_state.last_key) + FIRST_KEYS];
-            }   //no shift but cap
-            else if ((keyboard_state.shift_on)&&(keyboard_state.caps_lock_on)) {
-                printf("%c", key_map[(uint32_t)(keyboard_state.last_key) + 
-                    THIRD_KEYS]);
-                current=key_map[(uint32_t)(keyboard_state.last_key) + THIRD_KEYS];
-            }   //shift and cap
-            else {
-                printf("%c", key_map[(uint32_t)(keyboard_state.last_key) + 
-                    SECOND_KEYS]);
-                current=key_map[(uint32_t)(keyboard_state.last_key) + SECOND_KEYS];
-            }   //shift but no cap
+            current = terminal_key_char(keyboard_state);
+            putc(current);
 
             /* set buffer */
             terminal_state[active_terminal_idx].buffer[terminal_state[active_terminal_idx].
@@ -434,7 +395,9 @@ void keyboard_to_terminal (keyboard_state_t keyboard_state) {
             terminal_state[active_terminal_idx].buffer_location++;
         }
     }
-    restore_flags(flags);
+    /* show the echo now rather than on the next tick */
+    console_flush();
+    spin_unlock_irqrestore(&terminal_lock, flags);
 }
 
 
@@ -19,8 +19,6 @@
 #define THIRD_KEYS 0x3B*3 // caps + shift
 #define NEW_FIRST_KEYS (FIRST_KEYS * 4) /* size of scancode map */
 
-#define VIDEO_BUFFER_BASE 0xB9000
-
 /*testing */
 #define EVERY_EIGHT_KEYSTROKES 8
 
@@ -37,10 +35,7 @@ typedef struct terminal_state_n {
 	uint32_t buffer_end_location;
 	uint32_t read_location;
 	uint32_t enter_pressed;
-	int32_t cursor_y;
-	int32_t cursor_x;
 	uint8_t buffer[BUFFER_LEN];
-	int8_t* video_buffer;
 } terminal_state_t;
 
 extern int32_t active_terminal_idx;
@@ -51,10 +46,9 @@ extern int32_t terminal_close (int32_t fd);
 extern int32_t terminal_read (int32_t fd, void* buf, int32_t nbytes);
 extern int32_t terminal_write (int32_t fd, const void* buf, int32_t nbytes);
 extern void keyboard_to_terminal (keyboard_state_t keyboard_state);
-extern int8_t* get_terminal_vid_buffer(uint32_t terminal_idx);
-extern void save_screen();
-extern void restore_screen(uint32_t terminal_idx);
+extern uint8_t terminal_key_char(keyboard_state_t keyboard_state);
 extern void switch_terminal (uint32_t terminal_idx);
+extern void terminal_sync_direct(uint32_t terminal_idx);
 
 extern void test_terminal_read();
 extern void test_terminal_write();
@@ -0,0 +1,66 @@
+#include "timepage.h"
+#include "lib.h"
+#include "paging.h"
+#include "pit.h"
+#include "timer.h"
+
+/* the page is mapped into user space, so it may hold nothing but the time -
+pad it to a whole page */
+static union {
+	time_page_t page;
+	uint8_t pad[PAGE_SIZE];
+} time_page_mem __attribute__((aligned (PAGE_SIZE)));
+
+time_page_t* const time_page = &time_page_mem.page;
+
+/* compiler barrier - keeps the seq updates around the data they protect */
+#define barrier() asm volatile("" : : : "memory")
+
+
+/*
+ * init_time_page
+ *   DESCRIPTION: calibrate the TSC and fill in the time page. Must be called
+ *				  after init_pit with interrupts off.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: busy waits a few PIT periods for the calibration
+ */
+void init_time_page() {
+	memset(&time_page_mem, 0, sizeof(time_page_mem));
+
+	uint32_t khz = pit_calibrate_tsc_khz();
+	if (khz == 0)
+		khz = 1;	/* no usable TSC, keeps the divisions below defined */
+
+	/* ns per cycle is 10^6 / khz, use the largest shift whose multiplier
+	still fits in 32 bits for the best precision */
+	uint32_t shift = TSC_SHIFT_MAX;
+	while (shift > 0 && (((uint64_t)NS_PER_MS << shift) >> 32) >= khz)
+		shift--;
+
+	time_page->tick_ns = pit_tick_ns();
+	time_page->tsc_khz = khz;
+	time_page->tsc_mult = div64_32((uint64_t)NS_PER_MS << shift, khz);
+	time_page->tsc_shift = shift;
+	time_page->ticks = 0;
+	time_page->tsc_at_tick = rdtsc();
+	time_page->tsc_at_boot = time_page->tsc_at_tick;
+}
+
+/*
+ * time_page_tick
+ *   DESCRIPTION: publish a new tick count, called from the PIT interrupt
+ *   INPUTS: ticks: ticks since boot
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: time page updated
+ */
+void time_page_tick(uint32_t ticks) {
+	time_page->seq++;
+	barrier();
+	time_page->ticks = ticks;
+	time_page->tsc_at_tick = rdtsc();
+	barrier();
+	time_page->seq++;
+}
@@ -0,0 +1,33 @@
+#ifndef _TIMEPAGE_H
+#define _TIMEPAGE_H
+
+#include "types.h"
+
+/* user virtual address of the time page, the page after the malloc slabs -
+ece391time.h in the syscalls library must agree */
+#define TIME_PAGE_VIRTUAL_START 0x08405000
+
+/* ns since boot = (tsc - tsc_at_boot) * tsc_mult >> tsc_shift */
+#define TSC_SHIFT_MAX 31
+
+/* layout of the time page shared with user programs, read it with a retry
+loop on seq: a reader that sees seq odd or changed during the read must
+read again */
+typedef struct time_page {
+	volatile uint32_t seq;			/* odd while the kernel is updating */
+	volatile uint32_t ticks;		/* PIT ticks since boot */
+	volatile uint32_t tick_ns;		/* length of a tick in nanoseconds */
+	volatile uint32_t tsc_khz;		/* calibrated TSC frequency */
+	volatile uint32_t tsc_mult;		/* TSC cycles to ns scale factor */
+	volatile uint32_t tsc_shift;
+	volatile uint64_t tsc_at_tick;	/* TSC sampled at the last tick */
+	volatile uint64_t tsc_at_boot;	/* TSC when the clock read 0 */
+} time_page_t;
+
+extern time_page_t* const time_page;
+
+//see c file for more
+extern void init_time_page();
+extern void time_page_tick(uint32_t ticks);
+
+#endif /* _TIMEPAGE_H */
@@ -0,0 +1,256 @@
+#include "timer.h"
+#include "lib.h"
+#include "softirq.h"
+#include "spinlock.h"
+
+/* each bucket holds the timers whose expiry tick hashes to it, kept sorted by
+expiry so a tick only has to look at the timers that actually fire */
+static timer_t* timer_wheel[TIMER_WHEEL_SLOTS];
+
+/* length of one tick of the timer wheel in microseconds */
+static uint32_t timer_tick_us;
+
+volatile uint32_t timer_ticks = 0;
+/* last tick whose bucket timer_run has processed, trails timer_ticks while
+the timer softirq is pending */
+static uint32_t timer_run_ticks = 0;
+/* guards the wheel and the fields of armed timers */
+static spinlock_t timer_lock = SPINLOCK_INIT("timer");
+
+/* function prototypes for internal functions */
+static void timer_insert(timer_t* timer);
+static void timer_unlink(timer_t* timer);
+static void timer_run();
+
+
+/*
+ * init_timer
+ *   DESCRIPTION: initialize the timer wheel
+ *   INPUTS: tick_us: length in microseconds of one call to timer_tick
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: all buckets emptied, timer softirq registered
+ */
+void init_timer(uint32_t tick_us) {
+	int32_t i;
+	for (i = 0; i < TIMER_WHEEL_SLOTS; i++)
+		timer_wheel[i] = NULL;
+	timer_tick_us = tick_us;
+	timer_ticks = 0;
+	timer_run_ticks = 0;
+	open_softirq(SOFTIRQ_TIMER, timer_run);
+}
+
+/*
+ * init_timer_entry
+ *   DESCRIPTION: set up a timer so it can be armed later
+ *   INPUTS: timer: the timer to set up
+ *           callback: function run from the tick when the timer fires
+ *           data: passed back to the callback through timer->data
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none - the timer must not be armed
+ */
+void init_timer_entry(timer_t* timer, timer_callback_t callback, void* data) {
+	timer->next = NULL;
+	timer->prev = NULL;
+	timer->expires = 0;
+	timer->interval = 0;
+	timer->armed = false;
+	timer->callback = callback;
+	timer->data = data;
+}
+
+/*
+ * timer_insert
+ *   DESCRIPTION: link a timer into the bucket for its expiry tick, keeping the
+ *                bucket sorted by expiry. Caller holds timer_lock.
+ *   INPUTS: timer: timer with expires already set
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: timer wheel modified
+ */
+static void timer_insert(timer_t* timer) {
+	timer_t** link = &timer_wheel[timer->expires & TIMER_WHEEL_MASK];
+	timer_t* prev = NULL;
+
+	/* compare with a signed difference so the order survives tick wraparound */
+	while (*link != NULL && (int32_t)((*link)->expires - timer->expires) <= 0) {
+		prev = *link;
+		link = &((*link)->next);
+	}
+
+	timer->prev = prev;
+	timer->next = *link;
+	if (*link != NULL)
+		(*link)->prev = timer;
+	*link = timer;
+	timer->armed = true;
+}
+
+/*
+ * timer_unlink
+ *   DESCRIPTION: remove a timer from its bucket. Caller holds timer_lock.
+ *   INPUTS: timer: an armed timer
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: timer wheel modified
+ */
+static void timer_unlink(timer_t* timer) {
+	if (timer->prev != NULL)
+		timer->prev->next = timer->next;
+	else
+		timer_wheel[timer->expires & TIMER_WHEEL_MASK] = timer->next;
+
+	if (timer->next != NULL)
+		timer->next->prev = timer->prev;
+
+	timer->next = NULL;
+	timer->prev = NULL;
+	timer->armed = false;
+}
+
+/*
+ * timer_arm
+ *   DESCRIPTION: (re)start a timer
+ *   INPUTS: timer: the timer to start
+ *           ticks: ticks from now until the first expiry, at least 1
+ *           interval: ticks between later expiries, 0 for a one-shot timer
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: timer wheel modified, a previously armed timer is moved
+ */
+void timer_arm(timer_t* timer, uint32_t ticks, uint32_t interval) {
+	int32_t flags;
+	spin_lock_irqsave(&timer_lock, flags);
+
+	if (timer->armed)
+		timer_unlink(timer);
+
+	if (ticks == 0)
+		ticks = 1;
+	timer->expires = timer_ticks + ticks;
+	timer->interval = interval;
+	timer_insert(timer);
+
+	spin_unlock_irqrestore(&timer_lock, flags);
+}
+
+/*
+ * timer_cancel
+ *   DESCRIPTION: stop a timer, does nothing if it is not armed
+ *   INPUTS: timer: the timer to stop
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: timer wheel modified
+ */
+void timer_cancel(timer_t* timer) {
+	int32_t flags;
+	spin_lock_irqsave(&timer_lock, flags);
+	if (timer->armed)
+		timer_unlink(timer);
+	spin_unlock_irqrestore(&timer_lock, flags);
+}
+
+/*
+ * timer_remaining
+ *   DESCRIPTION: number of ticks left before a timer fires
+ *   INPUTS: timer: the timer to query
+ *   OUTPUTS: none
+ *   RETURN VALUE: ticks until expiry, 0 if the timer is not armed
+ *   SIDE EFFECTS: none
+ */
+uint32_t timer_remaining(timer_t* timer) {
+	int32_t flags;
+	uint32_t remaining = 0;
+	spin_lock_irqsave(&timer_lock, flags);
+	if (timer->armed && (int32_t)(timer->expires - timer_ticks) > 0)
+		remaining = timer->expires - timer_ticks;
+	spin_unlock_irqrestore(&timer_lock, flags);
+	return remaining;
+}
+
+/*
+ * timer_tick
+ *   DESCRIPTION: advance the wheel by one tick, called from the timer
+ *                interrupt. Expired timers are run later by the timer
+ *                softirq.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: timer_ticks incremented, SOFTIRQ_TIMER raised
+ */
+void timer_tick() {
+	timer_ticks++;
+	raise_softirq(SOFTIRQ_TIMER);
+}
+
+/*
+ * timer_run
+ *   DESCRIPTION: SOFTIRQ_TIMER handler - run every timer that expired on the
+ *                ticks since the last call. Only the head of one bucket per
+ *                tick is inspected, so the cost is proportional to the
+ *                number of expiring timers. Callbacks run with interrupts
+ *                off but without timer_lock, so they may arm and cancel
+ *                timers. Interrupts are let in between ticks.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: expired timers unlinked (periodic ones relinked), callbacks
+ *                 run
+ */
+static void timer_run() {
+	timer_t* timer;
+	int32_t flags;
+
+	spin_lock_irqsave(&timer_lock, flags);
+	while (timer_run_ticks != timer_ticks) {
+		timer_run_ticks++;
+		while ((timer = timer_wheel[timer_run_ticks & TIMER_WHEEL_MASK]) != NULL &&
+			(int32_t)(timer->expires - timer_run_ticks) <= 0) {
+			timer_unlink(timer);
+
+			/* periodic timers are rearmed relative to now so a late tick does
+			not cause a burst of catch-up expiries */
+			if (timer->interval != 0) {
+				timer->expires = timer_ticks + timer->interval;
+				timer_insert(timer);
+			}
+
+			/* the bucket head is read again afterwards, whatever the
+			callback changed is seen */
+			spin_unlock(&timer_lock);
+			timer->callback(timer);
+			spin_lock(&timer_lock);
+		}
+		spin_unlock_irqrestore(&timer_lock, flags);
+		spin_lock_irqsave(&timer_lock, flags);
+	}
+	spin_unlock_irqrestore(&timer_lock, flags);
+}
+
+/*
+ * timer_ms_to_ticks
+ *   DESCRIPTION: convert a duration to wheel ticks, rounding up so a timer
+ *                never fires early
+ *   INPUTS: ms: duration in milliseconds
+ *   OUTPUTS: none
+ *   RETURN VALUE: number of ticks
+ *   SIDE EFFECTS: none
+ */
+uint32_t timer_ms_to_ticks(uint32_t ms) {
+	/* tick length is at least a millisecond so the quotient fits 32 bits */
+	return div64_32((uint64_t)ms * US_PER_MS + timer_tick_us - 1, timer_tick_us);
+}
+
+/*
+ * timer_ticks_to_ms
+ *   DESCRIPTION: convert wheel ticks to milliseconds
+ *   INPUTS: ticks: number of ticks
+ *   OUTPUTS: none
+ *   RETURN VALUE: duration in milliseconds
+ *   SIDE EFFECTS: none
+ */
+uint32_t timer_ticks_to_ms(uint32_t ticks) {
+	return div64_32((uint64_t)ticks * timer_tick_us, US_PER_MS);
+}
@@ -0,0 +1,44 @@
+#ifndef _TIMER_H
+#define _TIMER_H
+
+#include "types.h"
+
+/* number of buckets in the hashed timer wheel, must be a power of 2 */
+#define TIMER_WHEEL_SLOTS 64
+#define TIMER_WHEEL_MASK (TIMER_WHEEL_SLOTS - 1)
+
+#define MS_PER_SEC 1000
+#define US_PER_MS 1000
+#define NS_PER_US 1000
+#define NS_PER_MS 1000000
+#define NS_PER_SEC 1000000000
+
+struct timer_n;
+typedef void (*timer_callback_t)(struct timer_n* timer);
+
+/* a software timer - lives inside whatever object owns it (e.g. the PCB),
+the wheel only links it into a bucket */
+typedef struct timer_n {
+	struct timer_n* next;
+	struct timer_n* prev;
+	uint32_t expires;	/* absolute tick at which the timer fires */
+	uint32_t interval;	/* reload value in ticks, 0 for one-shot timers */
+	int32_t armed;
+	timer_callback_t callback;
+	void* data;
+} timer_t;
+
+/* ticks since the timer wheel was started */
+extern volatile uint32_t timer_ticks;
+
+//see c file for more
+extern void init_timer(uint32_t tick_us);
+extern void init_timer_entry(timer_t* timer, timer_callback_t callback, void* data);
+extern void timer_arm(timer_t* timer, uint32_t ticks, uint32_t interval);
+extern void timer_cancel(timer_t* timer);
+extern uint32_t timer_remaining(timer_t* timer);
+extern void timer_tick();
+extern uint32_t timer_ms_to_ticks(uint32_t ms);
+extern uint32_t timer_ticks_to_ms(uint32_t ticks);
+
+#endif /* _TIMER_H */
@@ -0,0 +1,190 @@
+#include "trace.h"
+#include "lib.h"
+#include "task.h"
+#include "serial.h"
+#include "timepage.h"
+#include "spinlock.h"
+
+/* commands written to the trace pseudo file */
+#define TRACE_CMD_DUMP 'd'
+#define TRACE_CMD_CLEAR 'c'
+
+#define HEX_BUF_LEN 12
+/* longest dump line: "T ", six numbers of up to 8 digits and a space, CR LF */
+#define TRACE_LINE_MAX 64
+
+/* flight recorder - the newest TRACE_RING_SIZE records of this boot. head
+runs freely and is masked on use */
+static trace_record_t trace_ring[TRACE_RING_SIZE];
+static uint32_t trace_head = 0;
+static volatile int32_t trace_enabled = true;
+/* a dump lets go of the kernel lock, another must not start meanwhile */
+static int32_t trace_dumping = false;
+static spinlock_t trace_lock = SPINLOCK_INIT("trace");
+
+/* function prototypes for internal functions */
+static void trace_dump();
+static void dump_hex(uint32_t value);
+
+
+/*
+ * trace_event
+ *   DESCRIPTION: append a record to the trace ring, overwriting the oldest
+ *				  one when it is full. Safe from any context.
+ *   INPUTS: type: one of the TRACE_ record types
+ *           arg0, arg1: meaning depends on type, see trace.h
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: trace ring modified
+ */
+void trace_event(uint32_t type, uint32_t arg0, uint32_t arg1) {
+	if (!trace_enabled)
+		return;
+
+	uint64_t tsc = rdtsc();
+	int32_t flags;
+	/* interrupts may nest, keep the slot reservation and fill atomic */
+	spin_lock_irqsave(&trace_lock, flags);
+	trace_record_t* record = &trace_ring[trace_head & TRACE_RING_MASK];
+	trace_head++;
+	record->type = type;
+	if (active_task_idx == ERR || current_pcb[active_task_idx] == NULL)
+		record->pid = TRACE_NO_PID;
+	else
+		record->pid = current_pcb[active_task_idx]->pid;
+	record->tsc_low = (uint32_t)tsc;
+	record->tsc_high = (uint32_t)(tsc >> 32);
+	record->arg0 = arg0;
+	record->arg1 = arg1;
+	spin_unlock_irqrestore(&trace_lock, flags);
+}
+
+/*
+ * trace_open
+ *   DESCRIPTION: open the trace pseudo file
+ *   INPUTS: fname: unused
+ *   OUTPUTS: none
+ *   RETURN VALUE: always succeeds and returns 0
+ *   SIDE EFFECTS: none
+ */
+int32_t trace_open(const uint8_t* fname) {
+	return SUCCESS;
+}
+
+/*
+ * trace_close
+ *   DESCRIPTION: close the trace pseudo file
+ *   INPUTS: fd: unused
+ *   OUTPUTS: none
+ *   RETURN VALUE: always succeeds and returns 0
+ *   SIDE EFFECTS: none
+ */
+int32_t trace_close(int32_t fd) {
+	return SUCCESS;
+}
+
+/*
+ * trace_read
+ *   DESCRIPTION: the trace is only read over the serial port, see
+ *				  trace_write
+ *   INPUTS: ignored
+ *   OUTPUTS: none
+ *   RETURN VALUE: always 0, end of file
+ *   SIDE EFFECTS: none
+ */
+int32_t trace_read(int32_t fd, void* buf, int32_t nbytes) {
+	return 0;
+}
+
+/*
+ * trace_write
+ *   DESCRIPTION: control the trace - 'd' dumps the ring over the serial
+ *				  port, 'c' empties it
+ *   INPUTS: fd: unused
+ *           buf: the command, only the first byte counts
+ *           nbytes: length of buf
+ *   OUTPUTS: none
+ *   RETURN VALUE: nbytes for success, -1 for an unknown command or while
+ *				   a dump is running
+ *   SIDE EFFECTS: a dump blocks the caller until all but the last serial
+ *				   ring of it is sent, ~20s for a full trace ring
+ */
+int32_t trace_write(int32_t fd, const void* buf, int32_t nbytes) {
+	if (buf == NULL || nbytes < 1 || trace_dumping)
+		return ERR;
+
+	switch (*(const uint8_t*)buf) {
+		case TRACE_CMD_DUMP:
+			trace_dump();
+			return nbytes;
+		case TRACE_CMD_CLEAR:
+			trace_head = 0;
+			return nbytes;
+		default:
+			return ERR;
+	}
+}
+
+/*
+ * dump_hex
+ *   DESCRIPTION: send a number in hex and a separating space
+ *   INPUTS: value: number to send
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: may wait for room in the serial transmit ring
+ */
+static void dump_hex(uint32_t value) {
+	int8_t buf[HEX_BUF_LEN];
+	serial_puts(itoa(value, buf, 16));
+	serial_putc(' ');
+}
+
+/*
+ * trace_dump
+ *   DESCRIPTION: send the ring, oldest record first, as text lines that
+ *				  tools/tracedecode turns into a timeline:
+ *				  TRACE BEGIN <tsc khz> <records>
+ *				  T <type> <pid> <tsc high> <tsc low> <arg0> <arg1>, all hex
+ *				  TRACE END
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: tracing and the console mirror are paused while the
+ *				   dump runs, so the ring holds still and no console text
+ *				   lands inside a line. The events of the dump itself are
+ *				   not recorded.
+ */
+static void trace_dump() {
+	trace_dumping = true;
+	trace_enabled = false;
+	serial_mirror_pause(true);
+
+	uint32_t count = trace_head < TRACE_RING_SIZE ? trace_head : TRACE_RING_SIZE;
+	uint32_t i = trace_head - count;
+
+	serial_puts("\nTRACE BEGIN ");
+	dump_hex(time_page->tsc_khz);
+	dump_hex(count);
+	serial_puts("\n");
+	for (; i != trace_head; i++) {
+		/* wait for the UART with the kernel lock let go rather than poll
+		for it in serial_putc, other processors run meanwhile */
+		while (serial_tx_room() < TRACE_LINE_MAX)
+			kernel_lock_relax();
+
+		trace_record_t* record = &trace_ring[i & TRACE_RING_MASK];
+		serial_puts("T ");
+		dump_hex(record->type);
+		dump_hex(record->pid);
+		dump_hex(record->tsc_high);
+		dump_hex(record->tsc_low);
+		dump_hex(record->arg0);
+		dump_hex(record->arg1);
+		serial_puts("\n");
+	}
+	serial_puts("TRACE END\n");
+
+	serial_mirror_pause(false);
+	trace_enabled = true;
+	trace_dumping = false;
+}
@@ -0,0 +1,36 @@
+#ifndef _TRACE_H
+#define _TRACE_H
+
+#include "types.h"
+
+/* number of records the ring holds, must be a power of 2 */
+#define TRACE_RING_SIZE 8192
+#define TRACE_RING_MASK (TRACE_RING_SIZE - 1)
+
+/* record types - tools/tracedecode.c must agree */
+#define TRACE_IRQ 1				/* arg0: irq, arg1: irq specific */
+#define TRACE_SYSCALL_ENTER 2	/* arg0: syscall number, arg1: first argument */
+#define TRACE_SYSCALL_EXIT 3	/* arg0: syscall number, arg1: return value */
+#define TRACE_SWITCH 4			/* arg0: previous pid, arg1: next pid */
+#define TRACE_SIGNAL 5			/* arg0: signal number, arg1: handler */
+
+/* pid recorded when no process is running yet */
+#define TRACE_NO_PID 0xFFFF
+
+typedef struct trace_record {
+	uint16_t type;
+	uint16_t pid;
+	uint32_t tsc_low;
+	uint32_t tsc_high;
+	uint32_t arg0;
+	uint32_t arg1;
+} trace_record_t;
+
+//see c file for more
+extern void trace_event(uint32_t type, uint32_t arg0, uint32_t arg1);
+extern int32_t trace_open(const uint8_t* fname);
+extern int32_t trace_read(int32_t fd, void* buf, int32_t nbytes);
+extern int32_t trace_write(int32_t fd, const void* buf, int32_t nbytes);
+extern int32_t trace_close(int32_t fd);
+
+#endif /* _TRACE_H */
@@ -15,10 +15,16 @@
 #define USER_DS 0x002B
 #define KERNEL_TSS 0x0030
 #define KERNEL_LDT 0x0038
+/* kernel data whose base is the cpu_t of the processor, see this_cpu */
+#define KERNEL_PERCPU 0x0040
 
 /* Size of the task state segment (TSS) */
 #define TSS_SIZE 104
 
+/* Number of descriptors in the GDT, the TSS, LDT and per processor data
+come last */
+#define NUM_GDT_ENTRIES 9
+
 /* Number of vectors in the interrupt descriptor table (IDT) */
 #define NUM_VEC 256
 
@@ -118,6 +124,7 @@ extern uint16_t ldt_desc;
 extern uint32_t ldt_size;
 extern seg_desc_t ldt_desc_ptr;
 extern seg_desc_t gdt_desc_ptr;
+extern seg_desc_t gdt[NUM_GDT_ENTRIES];
 extern uint32_t ldt;
 
 extern uint32_t tss_size;
@@ -144,6 +151,14 @@ do { \
 		str.seg_lim_15_00 = (lim) & 0x0000FFFF; \
 } while(0)
 
+/* Sets the base of a data segment, the limit stays 4GB */
+#define SET_SEG_BASE(str, addr) \
+do { \
+	str.base_31_24 = ((uint32_t)(addr) & 0xFF000000) >> 24; \
+		str.base_23_16 = ((uint32_t)(addr) & 0x00FF0000) >> 16; \
+		str.base_15_00 = (uint32_t)(addr) & 0x0000FFFF; \
+} while(0)
+
 /* An interrupt descriptor entry (goes into the IDT) */
 typedef union idt_desc_t {
 	uint32_t val[2];
@@ -211,6 +226,16 @@ do {                                    \
 			: "memory" );               \
 } while(0)
 
+/* Load %gs with the per processor data segment.  The processor keeps a
+ * copy of the descriptor, so this is needed again after its base changed */
+#define load_percpu_gs()                \
+do {                                    \
+	asm volatile("movw %w0, %%gs"       \
+			:                           \
+			: "r" (KERNEL_PERCPU)       \
+			: "memory" );               \
+} while(0)
+
 #endif /* ASM */
 
 #endif /* _x86_DESC_H */
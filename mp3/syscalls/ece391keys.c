@@ -0,0 +1,110 @@
+#include <stdint.h>
+
+#include "ece391support.h"
+#include "ece391syscall.h"
+#include "ece391time.h"
+
+/*
+ * Print raw key events from the kernel's "kbd" pseudo file, the way a game
+ * would poll them once per frame.  While it runs the terminal does no line
+ * editing.  Each line shows how long the event waited between the keyboard
+ * interrupt and the read.
+ *
+ * usage: keys          poll until Esc is pressed
+ */
+
+#define FRAME_MS 16
+#define MAX_EVENTS 16
+#define NUM_LEN 12
+#define NS_PER_US 1000
+#define SCANCODE_ESC 0x01
+
+/* kbd_event_t flags and modifiers, see student-distrib/keyboard.h */
+#define KBD_EVENT_RELEASE 0x01
+#define KBD_EVENT_EXTENDED 0x02
+#define KBD_MOD_SHIFT 0x01
+#define KBD_MOD_CTRL 0x02
+#define KBD_MOD_ALT 0x04
+
+/* one event as read from "kbd", must match student-distrib/keyboard.h */
+typedef struct kbd_event {
+    uint64_t tsc;
+    uint8_t scancode;
+    uint8_t ascii;
+    uint8_t flags;
+    uint8_t modifiers;
+} kbd_event_t;
+
+static kbd_event_t events[MAX_EVENTS];
+
+static inline uint64_t rdtsc (void)
+{
+    uint64_t tsc;
+    asm volatile ("rdtsc" : "=A" (tsc));
+    return tsc;
+}
+
+/* microseconds since a TSC stamp, scaled with the time page's factors */
+static uint32_t us_since (uint64_t tsc)
+{
+    volatile ece391_time_page_t* tp = (ece391_time_page_t*)ECE391_TIME_PAGE;
+    uint32_t ns = ((rdtsc () - tsc) * tp->tsc_mult) >> tp->tsc_shift;
+    return ns / NS_PER_US;
+}
+
+static void print_event (kbd_event_t* ev)
+{
+    uint8_t buf[NUM_LEN];
+    uint8_t ch[2];
+
+    ece391_fdputs (1, (uint8_t*)((ev->flags & KBD_EVENT_RELEASE) ?
+      "up   " : "down "));
+    ece391_fdputs (1, (uint8_t*)((ev->flags & KBD_EVENT_EXTENDED) ?
+      "e0 " : "   "));
+    ece391_fdputs (1, ece391_itoa (ev->scancode, buf, 16));
+    if (ev->ascii >= ' ' && ev->ascii <= '~') {
+        ch[0] = ev->ascii;
+        ch[1] = '\0';
+        ece391_fdputs (1, (uint8_t*)" '");
+        ece391_fdputs (1, ch);
+        ece391_fdputs (1, (uint8_t*)"'");
+    }
+    if (ev->modifiers & KBD_MOD_SHIFT)
+        ece391_fdputs (1, (uint8_t*)" shift");
+    if (ev->modifiers & KBD_MOD_CTRL)
+        ece391_fdputs (1, (uint8_t*)" ctrl");
+    if (ev->modifiers & KBD_MOD_ALT)
+        ece391_fdputs (1, (uint8_t*)" alt");
+    ece391_fdputs (1, (uint8_t*)" after ");
+    ece391_fdputs (1, ece391_itoa (us_since (ev->tsc), buf, 10));
+    ece391_fdputs (1, (uint8_t*)"us\n");
+}
+
+int main ()
+{
+    int32_t fd, cnt, i;
+
+    if (-1 == (fd = ece391_open ((uint8_t*)"kbd"))) {
+        ece391_fdputs (1, (uint8_t*)"kernel has no raw keyboard\n");
+        return 2;
+    }
+    ece391_fdputs (1, (uint8_t*)"press Esc to quit\n");
+
+    while (1) {
+        cnt = ece391_read (fd, events, sizeof (events));
+        if (cnt < 0)
+            break;
+        for (i = 0; i < cnt / (int32_t)sizeof (kbd_event_t); i++) {
+            print_event (&events[i]);
+            if (events[i].scancode == SCANCODE_ESC &&
+              !(events[i].flags & KBD_EVENT_RELEASE)) {
+                ece391_close (fd);
+                return 0;
+            }
+        }
+        ece391_sleep (FRAME_MS);
+    }
+
+    ece391_close (fd);
+    return 1;
+}
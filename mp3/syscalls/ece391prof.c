@@ -0,0 +1,265 @@
+#include <stdint.h>
+
+#include "ece391support.h"
+#include "ece391syscall.h"
+
+/* 
+ * Flat profile of the kernel and user programs.  The kernel samples the
+ * interrupted EIP at 1024Hz into a ring that we drain through the "profile"
+ * pseudo file; kernel addresses are resolved with "ksyms", the output of
+ * nm for bootimg that the kernel Makefile puts on the file system.
+ *
+ * usage: prof <ms>         profile the whole system for <ms> milliseconds
+ *        prof <command>    profile the system while <command> runs
+ */
+
+#define BUFSIZE 1024
+#define SYMS_SIZE (96 * 1024)
+#define MAX_SYMS 4096
+#define MAX_ENTRIES 512
+#define TOP_ENTRIES 20
+#define DEFAULT_MS 5000
+#define NUM_LEN 12
+
+#define KERNEL_CS 0x0010
+#define NO_PID 0xFFFF
+
+/* one sample as read from "profile", see student-distrib/prof.h */
+typedef struct prof_sample {
+    uint32_t eip;
+    uint16_t cs;
+    uint16_t pid;
+} prof_sample_t;
+
+/* histogram entry - kernel samples are keyed by symbol, user samples by pid */
+typedef struct prof_entry {
+    uint32_t key;
+    uint32_t count;
+} prof_entry_t;
+
+#define KEY_USER 0x80000000
+#define KEY_UNKNOWN 0x40000000
+
+/* not zeroed by the loader, everything is initialized before use */
+static uint8_t syms_text[SYMS_SIZE];
+static uint32_t sym_addr[MAX_SYMS];
+static uint8_t* sym_name[MAX_SYMS];
+static int32_t num_syms;
+
+static prof_entry_t entries[MAX_ENTRIES];
+static int32_t num_entries;
+static uint32_t total, other;
+
+/* parse a hex number, stops at the first non hex digit */
+static uint32_t parse_hex (uint8_t** s)
+{
+    uint32_t value = 0;
+    for (;; (*s)++) {
+        if (**s >= '0' && **s <= '9')
+            value = (value << 4) | (**s - '0');
+        else if (**s >= 'a' && **s <= 'f')
+            value = (value << 4) | (**s - 'a' + 10);
+        else if (**s >= 'A' && **s <= 'F')
+            value = (value << 4) | (**s - 'A' + 10);
+        else
+            return value;
+    }
+}
+
+/* 
+ * Load "ksyms" - lines of "<hex address> <type> <name>", sorted by
+ * address.  Names are terminated in place.
+ */
+static void load_syms (void)
+{
+    int32_t fd, cnt, len = 0;
+    uint8_t* s;
+
+    num_syms = 0;
+    if (-1 == (fd = ece391_open ((uint8_t*)"ksyms"))) {
+        ece391_fdputs (1, (uint8_t*)"no ksyms, kernel addresses stay raw\n");
+        return;
+    }
+    while (len < SYMS_SIZE - 1 &&
+      0 < (cnt = ece391_read (fd, syms_text + len, SYMS_SIZE - 1 - len)))
+        len += cnt;
+    ece391_close (fd);
+    syms_text[len] = '\0';
+
+    s = syms_text;
+    while (*s != '\0' && num_syms < MAX_SYMS) {
+        sym_addr[num_syms] = parse_hex (&s);
+        /* skip " T " */
+        while (*s == ' ')
+            s++;
+        if (*s != '\0' && *s != '\n')
+            s++;
+        while (*s == ' ')
+            s++;
+        sym_name[num_syms++] = s;
+        while (*s != '\0' && *s != '\n')
+            s++;
+        if (*s == '\n')
+            *s++ = '\0';
+    }
+}
+
+/* index of the symbol containing addr, -1 if it is below all of them */
+static int32_t find_sym (uint32_t addr)
+{
+    int32_t lo = 0, hi = num_syms - 1, mid;
+
+    if (num_syms == 0 || addr < sym_addr[0])
+        return -1;
+    while (lo < hi) {
+        mid = (lo + hi + 1) >> 1;
+        if (sym_addr[mid] <= addr)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+    return lo;
+}
+
+static void count_key (uint32_t key)
+{
+    int32_t i;
+
+    total++;
+    for (i = 0; i < num_entries; i++) {
+        if (entries[i].key == key) {
+            entries[i].count++;
+            return;
+        }
+    }
+    if (num_entries == MAX_ENTRIES) {
+        other++;
+        return;
+    }
+    entries[num_entries].key = key;
+    entries[num_entries++].count = 1;
+}
+
+static void count_sample (prof_sample_t* sample)
+{
+    int32_t sym;
+
+    if (sample->cs != KERNEL_CS) {
+        count_key (KEY_USER | sample->pid);
+    } else if (num_syms == 0) {
+        count_key (sample->eip);
+    } else if (-1 == (sym = find_sym (sample->eip))) {
+        count_key (KEY_UNKNOWN);
+    } else {
+        count_key (sym);
+    }
+}
+
+static void drain (int32_t fd)
+{
+    static prof_sample_t samples[BUFSIZE / sizeof (prof_sample_t)];
+    int32_t cnt, i;
+
+    while (0 < (cnt = ece391_read (fd, samples, sizeof (samples)))) {
+        for (i = 0; i < cnt / (int32_t)sizeof (prof_sample_t); i++)
+            count_sample (&samples[i]);
+    }
+}
+
+static void put_num (uint32_t value, int32_t radix)
+{
+    uint8_t buf[NUM_LEN];
+    ece391_fdputs (1, ece391_itoa (value, buf, radix));
+}
+
+static void report (void)
+{
+    int32_t i, j, best;
+    prof_entry_t tmp;
+
+    put_num (total, 10);
+    ece391_fdputs (1, (uint8_t*)" samples\n");
+
+    /* selection sort of the top entries, the table is small */
+    for (i = 0; i < num_entries && i < TOP_ENTRIES; i++) {
+        best = i;
+        for (j = i + 1; j < num_entries; j++) {
+            if (entries[j].count > entries[best].count)
+                best = j;
+        }
+        tmp = entries[i];
+        entries[i] = entries[best];
+        entries[best] = tmp;
+
+        put_num (entries[i].count, 10);
+        ece391_fdputs (1, (uint8_t*)" ");
+        put_num ((entries[i].count * 100) / total, 10);
+        ece391_fdputs (1, (uint8_t*)"% ");
+        if (entries[i].key & KEY_USER) {
+            ece391_fdputs (1, (uint8_t*)"[user pid ");
+            if ((entries[i].key & ~KEY_USER) == NO_PID)
+                ece391_fdputs (1, (uint8_t*)"-");
+            else
+                put_num (entries[i].key & ~KEY_USER, 10);
+            ece391_fdputs (1, (uint8_t*)"]");
+        } else if (entries[i].key == KEY_UNKNOWN) {
+            ece391_fdputs (1, (uint8_t*)"[below kernel]");
+        } else if (num_syms == 0) {
+            ece391_fdputs (1, (uint8_t*)"0x");
+            put_num (entries[i].key, 16);
+        } else {
+            ece391_fdputs (1, sym_name[entries[i].key]);
+        }
+        ece391_fdputs (1, (uint8_t*)"\n");
+    }
+    if (other != 0) {
+        put_num (other, 10);
+        ece391_fdputs (1, (uint8_t*)" samples in other locations\n");
+    }
+}
+
+int main ()
+{
+    int32_t fd;
+    uint32_t ms = 0;
+    uint8_t args[BUFSIZE];
+    uint8_t* s;
+
+    if (0 != ece391_getargs (args, BUFSIZE))
+        args[0] = '\0';
+
+    num_entries = 0;
+    total = 0;
+    other = 0;
+    load_syms ();
+
+    if (-1 == (fd = ece391_open ((uint8_t*)"profile"))) {
+        ece391_fdputs (1, (uint8_t*)"kernel has no profiler\n");
+        return 2;
+    }
+
+    if (args[0] == '\0' || (args[0] >= '0' && args[0] <= '9')) {
+        for (s = args; *s >= '0' && *s <= '9'; s++)
+            ms = ms * 10 + (*s - '0');
+        if (ms == 0)
+            ms = DEFAULT_MS;
+        ece391_write (fd, "1", 1);
+        /* drain as we go so a long run does not overflow the ring */
+        while (ms > 0) {
+            uint32_t step = ms < DEFAULT_MS / 2 ? ms : DEFAULT_MS / 2;
+            ece391_sleep (step);
+            ms -= step;
+            drain (fd);
+        }
+        ece391_write (fd, "0", 1);
+    } else {
+        ece391_write (fd, "1", 1);
+        ece391_execute (args);
+        ece391_write (fd, "0", 1);
+    }
+    drain (fd);
+    ece391_close (fd);
+
+    report ();
+    return 0;
+}
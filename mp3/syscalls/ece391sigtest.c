@@ -24,6 +24,8 @@ int main ()
 		ece391_fdputs(1, (uint8_t*)"Installing signal handlers\n");
 		ece391_set_handler(SEGFAULT, segfault_sighandler);
 		ece391_set_handler(ALARM, alarm_sighandler);
+		/* ALARM every 16 seconds, the rate the kernel used to raise it */
+		ece391_setitimer(16000, 16000);
 	}
 
     ece391_fdputs (1, (uint8_t*)"Hi, what's your name? ");
@@ -2,6 +2,7 @@
 
 #include "ece391support.h"
 #include "ece391syscall.h"
+#include "ece391time.h"
 
 uint32_t ece391_strlen(const uint8_t* s)
 {
@@ -102,3 +103,30 @@ uint8_t* ece391_strrev(uint8_t* s)
    return s;
 }
 
+
+static inline uint64_t rdtsc (void)
+{
+    uint64_t tsc;
+    asm volatile ("rdtsc" : "=A" (tsc));
+    return tsc;
+}
+
+uint32_t ece391_ticks (void)
+{
+    return ((ece391_time_page_t*)ECE391_TIME_PAGE)->ticks;
+}
+
+uint64_t ece391_time_ns (void)
+{
+    volatile ece391_time_page_t* tp = (ece391_time_page_t*)ECE391_TIME_PAGE;
+    uint64_t cycles = rdtsc () - tp->tsc_at_boot;
+    uint32_t shift = tp->tsc_shift;
+    uint64_t lo, hi;
+
+    /* from the TSC alone, like the kernel's clock_ns, so it never steps
+       back when a timer tick is handled late. The product needs 96 bits,
+       so each half of cycles is scaled on its own. */
+    lo = (uint64_t)(uint32_t)cycles * tp->tsc_mult;
+    hi = (uint64_t)(uint32_t)(cycles >> 32) * tp->tsc_mult;
+    return (hi << (32 - shift)) + (lo >> shift);
+}
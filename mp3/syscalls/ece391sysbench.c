@@ -0,0 +1,51 @@
+#include <stdint.h>
+
+#include "ece391support.h"
+#include "ece391syscall.h"
+#include "ece391time.h"
+
+/* calls per round is a power of two so the average is a shift */
+#define LOG2_CALLS 14
+#define CALLS (1 << LOG2_CALLS)
+#define ROUNDS 5
+#define BUFSIZE 32
+
+/* close of an invalid fd is rejected before any work, so this times the
+entry and exit path alone */
+#define BAD_FD (-1)
+
+typedef int32_t (*close_call_t)(int32_t fd);
+
+/* best of ROUNDS, in nanoseconds per call */
+static uint32_t time_null_call (close_call_t call)
+{
+    uint32_t round, i, best = 0xFFFFFFFF;
+    uint64_t start, ns;
+
+    for (round = 0; round < ROUNDS; round++) {
+        start = ece391_time_ns ();
+        for (i = 0; i < CALLS; i++)
+            (void)call (BAD_FD);
+        ns = (ece391_time_ns () - start) >> LOG2_CALLS;
+        if (ns < best)
+            best = ns;
+    }
+    return best;
+}
+
+static void report (const uint8_t* name, uint32_t ns)
+{
+    uint8_t buf[BUFSIZE];
+
+    ece391_fdputs (1, name);
+    ece391_itoa (ns, buf, 10);
+    ece391_fdputs (1, buf);
+    ece391_fdputs (1, (uint8_t*)" ns per null syscall\n");
+}
+
+int main ()
+{
+    report ((uint8_t*)"int $0x80: ", time_null_call (ece391_close));
+    report ((uint8_t*)"sysenter:  ", time_null_call (ece391_fast_close));
+    return 0;
+}
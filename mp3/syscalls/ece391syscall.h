@@ -3,6 +3,14 @@
 
 #include <stdint.h>
 
+/* clock ids for ece391_clock_gettime */
+#define ECE391_CLOCK_MONOTONIC 1
+
+typedef struct ece391_timespec {
+    uint32_t tv_sec;
+    uint32_t tv_nsec;
+} ece391_timespec_t;
+
 /* All calls return >= 0 on success or -1 on failure. */
 
 /*  
@@ -24,6 +32,29 @@ extern int32_t ece391_sigreturn (void);
 extern void* ece391_malloc (int32_t size);
 extern int32_t ece391_free (void* ptr);
 extern int32_t ece391_touch (const uint8_t* filename);
+extern int32_t ece391_sleep (uint32_t ms);
+extern int32_t ece391_setitimer (uint32_t value_ms, uint32_t interval_ms);
+extern int32_t ece391_clock_gettime (int32_t clock_id, ece391_timespec_t* ts);
+
+/* 
+ * Same calls entered through sysenter instead of int $0x80; see
+ * ece391syscall.S.  There is no fast sigreturn.
+ */
+extern int32_t ece391_fast_halt (uint8_t status);
+extern int32_t ece391_fast_execute (const uint8_t* command);
+extern int32_t ece391_fast_read (int32_t fd, void* buf, int32_t nbytes);
+extern int32_t ece391_fast_write (int32_t fd, const void* buf, int32_t nbytes);
+extern int32_t ece391_fast_open (const uint8_t* filename);
+extern int32_t ece391_fast_close (int32_t fd);
+extern int32_t ece391_fast_getargs (uint8_t* buf, int32_t nbytes);
+extern int32_t ece391_fast_vidmap (uint8_t** screen_start);
+extern int32_t ece391_fast_set_handler (int32_t signum, void* handler);
+extern void* ece391_fast_malloc (int32_t size);
+extern int32_t ece391_fast_free (void* ptr);
+extern int32_t ece391_fast_touch (const uint8_t* filename);
+extern int32_t ece391_fast_sleep (uint32_t ms);
+extern int32_t ece391_fast_setitimer (uint32_t value_ms, uint32_t interval_ms);
+extern int32_t ece391_fast_clock_gettime (int32_t clock_id, ece391_timespec_t* ts);
 
 enum signums {
 	DIV_ZERO = 0,
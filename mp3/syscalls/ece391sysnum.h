@@ -14,5 +14,8 @@
 #define SYS_MALLOC 11
 #define SYS_FREE 12
 #define SYS_TOUCH 13
+#define SYS_SLEEP 14
+#define SYS_SETITIMER 15
+#define SYS_CLOCK_GETTIME 16
 
 #endif /* ECE391SYSNUM_H */
@@ -0,0 +1,27 @@
+#if !defined(ECE391TIME_H)
+#define ECE391TIME_H
+
+#include <stdint.h>
+
+/* 
+ * The kernel maps a read-only page holding the time into every program, so
+ * reading the clock needs no system call.  The layout must match
+ * student-distrib/timepage.h.
+ */
+#define ECE391_TIME_PAGE 0x08405000
+
+typedef struct ece391_time_page {
+    volatile uint32_t seq;          /* odd while the kernel is updating */
+    volatile uint32_t ticks;        /* timer ticks since boot */
+    volatile uint32_t tick_ns;      /* length of a tick in nanoseconds */
+    volatile uint32_t tsc_khz;      /* calibrated TSC frequency */
+    volatile uint32_t tsc_mult;     /* ns = (tsc delta * tsc_mult) >> tsc_shift */
+    volatile uint32_t tsc_shift;
+    volatile uint64_t tsc_at_tick;  /* TSC sampled at the last tick */
+    volatile uint64_t tsc_at_boot;  /* TSC when the clock read 0 */
+} ece391_time_page_t;
+
+extern uint32_t ece391_ticks (void);
+extern uint64_t ece391_time_ns (void);
+
+#endif /* ECE391TIME_H */
@@ -0,0 +1,230 @@
+#include <stdint.h>
+
+#include "ece391support.h"
+#include "ece391syscall.h"
+
+/* 
+ * Live cpu usage per process and per terminal, from the kernel's
+ * "procstat" pseudo file.  Ticks a process spent blocked in read or sleep
+ * do not count as cpu time.
+ *
+ * usage: top           refresh every second until interrupted
+ *        top <n>       refresh n times, then exit
+ */
+
+#define BUFSIZE 2048
+#define MAX_PROCS 6
+#define NUM_TERMINALS 3
+#define NAME_LEN 33
+#define NUM_LEN 12
+#define INTERVAL_MS 1000
+#define NO_PPID 0xFFFFFFFF
+
+/* one line of "procstat", see student-distrib/procstat.c */
+typedef struct proc {
+    uint32_t valid;
+    uint32_t pid, ppid, term;
+    uint32_t user, kernel, idle, switches, syscalls, faults, start;
+    uint8_t name[NAME_LEN];
+} proc_t;
+
+/* not zeroed by the loader, everything is initialized before use */
+static uint8_t text[BUFSIZE];
+static proc_t prev[MAX_PROCS];
+static proc_t cur[MAX_PROCS];
+static uint32_t prev_ticks, cur_ticks, tick_us;
+
+/* skip to the start of the next word on the line */
+static void skip_word (uint8_t** s)
+{
+    while (**s != '\0' && **s != ' ' && **s != '\n')
+        (*s)++;
+    while (**s == ' ')
+        (*s)++;
+}
+
+/* parse a decimal number and the space after it, - reads as NO_PPID */
+static uint32_t parse_num (uint8_t** s)
+{
+    uint32_t value = 0;
+    if (**s == '-') {
+        skip_word (s);
+        return NO_PPID;
+    }
+    for (; **s >= '0' && **s <= '9'; (*s)++)
+        value = value * 10 + (**s - '0');
+    while (**s == ' ')
+        (*s)++;
+    return value;
+}
+
+/* take a snapshot of "procstat" into cur, 0 on success */
+static int32_t sample (void)
+{
+    int32_t fd, cnt, len = 0, i;
+    uint8_t* s;
+    proc_t p;
+
+    /* the report is taken when reading from offset 0, so reopen each time */
+    if (-1 == (fd = ece391_open ((uint8_t*)"procstat")))
+        return -1;
+    while (len < BUFSIZE - 1 &&
+      0 < (cnt = ece391_read (fd, text + len, BUFSIZE - 1 - len)))
+        len += cnt;
+    ece391_close (fd);
+    text[len] = '\0';
+
+    for (i = 0; i < MAX_PROCS; i++)
+        cur[i].valid = 0;
+
+    /* "ticks <n> tick_us <n>", then the column header */
+    s = text;
+    skip_word (&s);
+    cur_ticks = parse_num (&s);
+    skip_word (&s);
+    tick_us = parse_num (&s);
+    for (i = 0; i < 2; i++) {
+        while (*s != '\0' && *s != '\n')
+            s++;
+        if (*s == '\n')
+            s++;
+    }
+
+    while (*s != '\0') {
+        p.pid = parse_num (&s);
+        p.ppid = parse_num (&s);
+        p.term = parse_num (&s);
+        p.user = parse_num (&s);
+        p.kernel = parse_num (&s);
+        p.idle = parse_num (&s);
+        p.switches = parse_num (&s);
+        p.syscalls = parse_num (&s);
+        p.faults = parse_num (&s);
+        p.start = parse_num (&s);
+        for (i = 0; i < NAME_LEN - 1 && *s != '\0' && *s != '\n'; i++)
+            p.name[i] = *s++;
+        p.name[i] = '\0';
+        while (*s != '\0' && *s != '\n')
+            s++;
+        if (*s == '\n')
+            s++;
+        if (p.pid < MAX_PROCS) {
+            p.valid = 1;
+            cur[p.pid] = p;
+        }
+    }
+    return 0;
+}
+
+/* print a number right aligned in a column of the given width */
+static void put_num (uint32_t value, int32_t width)
+{
+    uint8_t buf[NUM_LEN];
+    int32_t pad;
+
+    ece391_itoa (value, buf, 10);
+    for (pad = width - ece391_strlen (buf); pad > 0; pad--)
+        ece391_fdputs (1, (uint8_t*)" ");
+    ece391_fdputs (1, buf);
+}
+
+/* print a percentage of dt with one decimal */
+static void put_pct (uint32_t ticks, uint32_t dt)
+{
+    uint32_t tenths = (ticks * 1000 + dt / 2) / dt;
+    uint8_t buf[NUM_LEN];
+
+    put_num (tenths / 10, 4);
+    ece391_fdputs (1, (uint8_t*)".");
+    ece391_fdputs (1, ece391_itoa (tenths % 10, buf, 10));
+}
+
+static void report (void)
+{
+    uint32_t dt = cur_ticks - prev_ticks;
+    uint32_t busy[NUM_TERMINALS];
+    uint32_t i, elapsed_ms;
+    proc_t d;
+
+    if (dt == 0)
+        return;
+    elapsed_ms = dt * tick_us / 1000;
+    if (elapsed_ms == 0)
+        elapsed_ms = 1;
+
+    for (i = 0; i < NUM_TERMINALS; i++)
+        busy[i] = 0;
+
+    ece391_fdputs (1, (uint8_t*)"\n  PID PPID TTY  %CPU  %USR  %SYS SYSC/s FLT NAME\n");
+    for (i = 0; i < MAX_PROCS; i++) {
+        if (!cur[i].valid)
+            continue;
+
+        /* a process new since the last sample counts from its start */
+        d = cur[i];
+        if (prev[i].valid && prev[i].start == cur[i].start) {
+            d.user -= prev[i].user;
+            d.kernel -= prev[i].kernel;
+            d.faults -= prev[i].faults;
+            /* writing "syscalls" zeroes the syscall counts */
+            d.syscalls = cur[i].syscalls >= prev[i].syscalls ?
+                cur[i].syscalls - prev[i].syscalls : cur[i].syscalls;
+        }
+        if (d.term < NUM_TERMINALS)
+            busy[d.term] += d.user + d.kernel;
+
+        put_num (d.pid, 5);
+        if (d.ppid == NO_PPID)
+            ece391_fdputs (1, (uint8_t*)"    -");
+        else
+            put_num (d.ppid, 5);
+        put_num (d.term, 4);
+        put_pct (d.user + d.kernel, dt);
+        put_pct (d.user, dt);
+        put_pct (d.kernel, dt);
+        put_num (d.syscalls * 1000 / elapsed_ms, 7);
+        put_num (d.faults, 4);
+        ece391_fdputs (1, (uint8_t*)" ");
+        ece391_fdputs (1, d.name);
+        ece391_fdputs (1, (uint8_t*)"\n");
+    }
+
+    for (i = 0; i < NUM_TERMINALS; i++) {
+        ece391_fdputs (1, (uint8_t*)"term ");
+        put_num (i, 1);
+        ece391_fdputs (1, (uint8_t*)":");
+        put_pct (busy[i], dt);
+        ece391_fdputs (1, (uint8_t*)"%  ");
+    }
+    ece391_fdputs (1, (uint8_t*)"\n");
+}
+
+int main ()
+{
+    uint8_t args[BUFSIZE];
+    uint8_t* s;
+    uint32_t count = 0, forever, i;
+
+    if (0 != ece391_getargs (args, BUFSIZE))
+        args[0] = '\0';
+    for (s = args; *s >= '0' && *s <= '9'; s++)
+        count = count * 10 + (*s - '0');
+    forever = (count == 0);
+
+    if (0 != sample ()) {
+        ece391_fdputs (1, (uint8_t*)"kernel has no procstat\n");
+        return 2;
+    }
+
+    while (forever || count-- > 0) {
+        for (i = 0; i < MAX_PROCS; i++)
+            prev[i] = cur[i];
+        prev_ticks = cur_ticks;
+
+        ece391_sleep (INTERVAL_MS);
+        if (0 != sample ())
+            return 2;
+        report ();
+    }
+    return 0;
+}
@@ -0,0 +1,47 @@
+#include <stdint.h>
+
+#include "ece391support.h"
+#include "ece391syscall.h"
+
+/*
+ * Control the kernel event trace through the "trace" pseudo file.  The
+ * trace itself goes out on the first serial port; capture it on the host
+ * and feed it to tools/tracedecode for a timeline.
+ *
+ * usage: tracedump             dump the trace ring over the serial port
+ *        tracedump clear       empty the trace ring
+ *        tracedump <command>   empty the ring, run <command>, then dump
+ */
+
+#define BUFSIZE 1024
+
+int main ()
+{
+    int32_t fd;
+    uint8_t args[BUFSIZE];
+
+    if (0 != ece391_getargs (args, BUFSIZE))
+        args[0] = '\0';
+
+    if (-1 == (fd = ece391_open ((uint8_t*)"trace"))) {
+        ece391_fdputs (1, (uint8_t*)"kernel has no event trace\n");
+        return 2;
+    }
+
+    if (0 == ece391_strcmp (args, (uint8_t*)"clear")) {
+        ece391_write (fd, "c", 1);
+        ece391_close (fd);
+        return 0;
+    }
+
+    if (args[0] != '\0') {
+        ece391_write (fd, "c", 1);
+        ece391_execute (args);
+    }
+
+    ece391_fdputs (1, (uint8_t*)"dumping trace to serial port...\n");
+    ece391_write (fd, "d", 1);
+    ece391_close (fd);
+    ece391_fdputs (1, (uint8_t*)"done\n");
+    return 0;
+}
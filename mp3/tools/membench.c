@@ -0,0 +1,198 @@
+/*
+ * membench - time the kernel's memcpy, memset and memmove (see
+ * student-distrib/mem.c) on the host and print GB/s by length.
+ *
+ *     membench
+ *
+ * mem.c is compiled into this program under other names, as 32 bit code
+ * like the kernel, so the host needs its 32 bit C library (gcc-multilib).
+ * Each routine is first checked against the C library.  Each table has
+ * a column per way the kernel can take, forced on with the flags init_mem
+ * sets: "dwords" is rep movsl/stosl, which every processor has, "erms"
+ * adds rep movsb/stosb from MEM_ERMS_MIN bytes and "nt" adds movnti from
+ * MEM_NT_MIN bytes.  A way the host processor lacks prints "-".  The C
+ * library's routine is the last column, for comparison.  memmove is timed
+ * with dest just above src, the one case that does not go to memcpy.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* the kernel's types.h would clash with stdint.h */
+#define _TYPES_H
+#define memcpy kernel_memcpy
+#define memset kernel_memset
+#define memmove kernel_memmove
+#include "../student-distrib/mem.c"
+#undef memcpy
+#undef memset
+#undef memmove
+
+#define MIN_LEN 16
+#define MAX_LEN (32 * 1024 * 1024)
+/* bytes moved per measurement, so short lengths are called many times */
+#define BYTES_PER_RUN (256 * 1024 * 1024)
+#define BUF_ALIGN 64
+/* how far above src memmove writes */
+#define MOVE_OFFSET 8
+/* length of the memmove check, and of the buffer it checks */
+#define MOVE_CHECK_LEN 2051
+#define MOVE_CHECK_BUF 4096
+
+enum { BENCH_MEMCPY, BENCH_MEMSET, BENCH_MEMMOVE };
+
+struct variant {
+    const char *name;
+    int32_t erms;
+    int32_t sse2;
+};
+
+static const struct variant variants[] = {
+    { "dwords", 0, 0 },
+    { "erms", 1, 0 },
+    { "nt", 1, 1 },
+};
+#define NUM_VARIANTS (sizeof(variants) / sizeof(variants[0]))
+
+static const char *bench_names[] = { "memcpy", "memset", "memmove" };
+
+static uint8_t *buf_a, *buf_b;
+
+/* called through these so the compiler cannot drop or merge the calls */
+static void *(*volatile libc_memcpy)(void *, const void *, size_t) = memcpy;
+static void *(*volatile libc_memset)(void *, int, size_t) = memset;
+static void *(*volatile libc_memmove)(void *, const void *, size_t) = memmove;
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* one call of the routine under test, libc when kernel is 0 */
+static void run_once(int bench, int kernel, uint32_t len)
+{
+    switch (bench) {
+    case BENCH_MEMCPY:
+        if (kernel)
+            kernel_memcpy(buf_a, buf_b, len);
+        else
+            libc_memcpy(buf_a, buf_b, len);
+        break;
+    case BENCH_MEMSET:
+        if (kernel)
+            kernel_memset(buf_a, 0, len);
+        else
+            libc_memset(buf_a, 0, len);
+        break;
+    case BENCH_MEMMOVE:
+        if (kernel)
+            kernel_memmove(buf_a + MOVE_OFFSET, buf_a, len);
+        else
+            libc_memmove(buf_a + MOVE_OFFSET, buf_a, len);
+        break;
+    }
+}
+
+/* GB/s of one routine at one length */
+static double measure(int bench, int kernel, uint32_t len)
+{
+    uint32_t reps = BYTES_PER_RUN / len, i;
+    double start;
+
+    run_once(bench, kernel, len);
+    start = now_ns();
+    for (i = 0; i < reps; i++)
+        run_once(bench, kernel, len);
+    return (double)len * reps / (now_ns() - start);
+}
+
+/* the ways the host processor has */
+static int supported(const struct variant *v, int32_t erms, int32_t sse2)
+{
+    return (!v->erms || erms) && (!v->sse2 || sse2);
+}
+
+/* every way must agree with the C library on odd lengths and offsets */
+static void check(int32_t erms, int32_t sse2)
+{
+    uint32_t len = MEM_NT_MIN + 37, i, j;
+    const struct variant *v;
+
+    for (i = 0; i < NUM_VARIANTS; i++) {
+        v = &variants[i];
+        if (!supported(v, erms, sse2))
+            continue;
+        mem_erms = v->erms;
+        mem_sse2 = v->sse2;
+
+        memset(buf_a, 0, MAX_LEN);
+        memset(buf_b, 0x5A, MAX_LEN);
+        kernel_memcpy(buf_a + 3, buf_b + 1, len);
+        kernel_memset(buf_a + 3 + len, 0xC3, 5);
+        if (memcmp(buf_a + 3, buf_b + 1, len) != 0 || buf_a[3 + len] != 0xC3 ||
+            buf_a[2] != 0 || buf_a[8 + len] != 0) {
+            fprintf(stderr, "membench: %s memcpy or memset is wrong\n", v->name);
+            exit(1);
+        }
+
+        for (j = 0; j < MOVE_CHECK_BUF; j++)
+            buf_b[j] = buf_a[j] = (uint8_t)(j * 7);
+        kernel_memmove(buf_a + 5, buf_a, MOVE_CHECK_LEN);
+        memmove(buf_b + 5, buf_b, MOVE_CHECK_LEN);
+        if (memcmp(buf_a, buf_b, MOVE_CHECK_BUF) != 0) {
+            fprintf(stderr, "membench: %s memmove is wrong\n", v->name);
+            exit(1);
+        }
+    }
+}
+
+int main(void)
+{
+    int32_t host_erms, host_sse2;
+    uint32_t len, i;
+    int bench;
+
+    buf_a = aligned_alloc(BUF_ALIGN, MAX_LEN + BUF_ALIGN);
+    buf_b = aligned_alloc(BUF_ALIGN, MAX_LEN + BUF_ALIGN);
+    if (buf_a == NULL || buf_b == NULL) {
+        fprintf(stderr, "membench: out of memory\n");
+        return 1;
+    }
+    memset(buf_a, 0, MAX_LEN + BUF_ALIGN);
+    memset(buf_b, 0, MAX_LEN + BUF_ALIGN);
+
+    init_mem();
+    host_erms = mem_erms;
+    host_sse2 = mem_sse2;
+    printf("host: erms %s, sse2 %s\n", host_erms ? "yes" : "no",
+           host_sse2 ? "yes" : "no");
+    check(host_erms, host_sse2);
+
+    for (bench = BENCH_MEMCPY; bench <= BENCH_MEMMOVE; bench++) {
+        printf("\n%-10s", bench_names[bench]);
+        for (i = 0; i < NUM_VARIANTS; i++)
+            printf("%9s", variants[i].name);
+        printf("%9s\n", "libc");
+
+        for (len = MIN_LEN; len <= MAX_LEN; len *= 4) {
+            printf("%-10u", len);
+            for (i = 0; i < NUM_VARIANTS; i++) {
+                if (!supported(&variants[i], host_erms, host_sse2)) {
+                    printf("%9s", "-");
+                    continue;
+                }
+                mem_erms = variants[i].erms;
+                mem_sse2 = variants[i].sse2;
+                printf("%9.2f", measure(bench, 1, len));
+            }
+            printf("%9.2f\n", measure(bench, 0, len));
+            fflush(stdout);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,149 @@
+/*
+ * tracedecode - turn the event trace the kernel dumps on its first serial
+ * port (see student-distrib/trace.c) into a readable timeline.
+ *
+ * Capture the serial port, e.g. with qemu -serial file:serial.log, run
+ * "tracedump" in the guest, then:
+ *
+ *     tracedecode < serial.log
+ *
+ * Anything outside the TRACE BEGIN / TRACE END lines is skipped, so the
+ * capture may contain other output.  When it holds several dumps the
+ * last one is decoded.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* record types - must agree with student-distrib/trace.h */
+#define TRACE_IRQ 1
+#define TRACE_SYSCALL_ENTER 2
+#define TRACE_SYSCALL_EXIT 3
+#define TRACE_SWITCH 4
+#define TRACE_SIGNAL 5
+
+#define TRACE_NO_PID 0xFFFF
+
+#define LINE_LEN 256
+
+typedef struct record {
+    unsigned type, pid;
+    uint64_t tsc;
+    uint32_t arg0, arg1;
+} record_t;
+
+/* indexed by syscall number, see student-distrib/syscall.c */
+static const char* syscall_names[] = {
+    "", "halt", "execute", "read", "write", "open", "close", "getargs",
+    "vidmap", "set_handler", "sigreturn", "malloc", "free", "touch", "sleep",
+    "setitimer", "clock_gettime"
+};
+#define NUM_SYSCALL_NAMES (sizeof(syscall_names) / sizeof(syscall_names[0]))
+
+static const char* signal_names[] = {
+    "DIV_ZERO", "SEGFAULT", "INTERRUPT", "ALARM", "USER1"
+};
+#define NUM_SIGNAL_NAMES (sizeof(signal_names) / sizeof(signal_names[0]))
+
+static const char* syscall_name(uint32_t num)
+{
+    return num < NUM_SYSCALL_NAMES ? syscall_names[num] : "?";
+}
+
+static void print_event(const record_t* r)
+{
+    switch (r->type) {
+    case TRACE_IRQ:
+        if (r->arg0 == 0)
+            printf("irq 0 timer, tick %u\n", r->arg1);
+        else if (r->arg0 == 1)
+            printf("irq 1 keyboard, scancode 0x%02x\n", r->arg1);
+        else if (r->arg0 == 8)
+            printf("irq 8 rtc, period for terminals 0x%x\n", r->arg1);
+        else
+            printf("irq %u, 0x%x\n", r->arg0, r->arg1);
+        break;
+    case TRACE_SYSCALL_ENTER:
+        printf("-> %s(0x%x)\n", syscall_name(r->arg0), r->arg1);
+        break;
+    case TRACE_SYSCALL_EXIT:
+        printf("<- %s = %d\n", syscall_name(r->arg0), (int32_t)r->arg1);
+        break;
+    case TRACE_SWITCH:
+        printf("switch pid %u -> pid %u\n", r->arg0, r->arg1);
+        break;
+    case TRACE_SIGNAL:
+        printf("signal %s, handler 0x%08x\n",
+               r->arg0 < NUM_SIGNAL_NAMES ? signal_names[r->arg0] : "?",
+               r->arg1);
+        break;
+    default:
+        printf("type %u, 0x%x 0x%x\n", r->type, r->arg0, r->arg1);
+        break;
+    }
+}
+
+int main(void)
+{
+    char line[LINE_LEN];
+    record_t* records = NULL;
+    unsigned count = 0, expected = 0, khz = 0, i;
+    int in_trace = 0, complete = 0;
+
+    while (fgets(line, sizeof(line), stdin) != NULL) {
+        unsigned type, pid, hi, lo, a0, a1;
+
+        if (sscanf(line, "TRACE BEGIN %x %x", &khz, &expected) == 2) {
+            free(records);
+            records = calloc(expected ? expected : 1, sizeof(record_t));
+            if (records == NULL) {
+                perror("tracedecode");
+                return 1;
+            }
+            count = 0;
+            in_trace = 1;
+            complete = 0;
+        } else if (in_trace && strncmp(line, "TRACE END", 9) == 0) {
+            in_trace = 0;
+            complete = 1;
+        } else if (in_trace && count < expected &&
+                   sscanf(line, "T %x %x %x %x %x %x",
+                          &type, &pid, &hi, &lo, &a0, &a1) == 6) {
+            records[count].type = type;
+            records[count].pid = pid;
+            records[count].tsc = ((uint64_t)hi << 32) | lo;
+            records[count].arg0 = a0;
+            records[count].arg1 = a1;
+            count++;
+        }
+    }
+
+    if (records == NULL) {
+        fprintf(stderr, "tracedecode: no trace found\n");
+        return 1;
+    }
+    if (!complete || count != expected)
+        fprintf(stderr, "tracedecode: trace truncated, %u of %u records\n",
+                count, expected);
+    if (khz == 0)
+        khz = 1;
+
+    printf("%u records, TSC at %u kHz\n", count, khz);
+    printf("%12s %10s %5s  event\n", "time_us", "delta_us", "pid");
+    for (i = 0; i < count; i++) {
+        uint64_t since = records[i].tsc - records[0].tsc;
+        uint64_t delta = i ? records[i].tsc - records[i - 1].tsc : 0;
+
+        printf("%12.1f %10.1f ", since * 1000.0 / khz, delta * 1000.0 / khz);
+        if (records[i].pid == TRACE_NO_PID)
+            printf("%5s  ", "-");
+        else
+            printf("%5u  ", records[i].pid);
+        print_event(&records[i]);
+    }
+
+    free(records);
+    return 0;
+}